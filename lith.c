@@ -5,6 +5,10 @@
 #include <stdlib.h>
 #include <string.h>
 
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
 static void *emalloc(lith_st *L, size_t len)
 {
     void *p;
@@ -26,6 +30,235 @@ static char *lith__strndup(lith_st *L, char *str, size_t len)
     return newstr;
 }
 
+static lith_value *make_symbol(lith_st *L, char *name, size_t len)
+{
+    lith_value *val;
+    char *sym;
+    val = lith_new_value(L);
+    if (!val) return NULL;
+    sym = lith__strndup(L, name, len);
+    if (!sym) return NULL;
+    val->type = LITH_TYPE_SYMBOL;
+    val->value.symbol.name = sym;
+    val->value.symbol.form = LITH_FORM_NONE;
+    return val;
+}
+
+/* the symbol table: open addressing with linear probing,
+ * the hash and the length in the slots avoid most comparisons
+ */
+
+static unsigned long hash_name(char *name, size_t len)
+{
+    unsigned long h;
+    h = 2166136261UL;
+    while (len--) {
+        h ^= (unsigned char) *name++;
+        h = (h * 16777619UL) & 0xFFFFFFFFUL;
+    }
+    return h;
+}
+
+static struct lith_symbol_slot *find_slot(struct lith_symbol_table *T, unsigned long hash)
+{
+    size_t i;
+    for (i = hash & (T->cap - 1); T->slots[i].sym; i = (i + 1) & (T->cap - 1))
+        ;
+    return &T->slots[i];
+}
+
+static int grow_symbols(lith_st *L)
+{
+    struct lith_symbol_table *T, old;
+    size_t i;
+    T = &L->symbols;
+    old = *T;
+    T->cap = old.cap ? (2 * old.cap) : 256;
+    T->slots = calloc(T->cap, sizeof(*T->slots));
+    if (!T->slots) {
+        *T = old;
+        L->error = LITH_ERR_NOMEM;
+        return 0;
+    }
+    for (i = 0; i < old.cap; i++)
+        if (old.slots[i].sym)
+            *find_slot(T, old.slots[i].hash) = old.slots[i];
+    free(old.slots);
+    return 1;
+}
+
+/* find the symbol with the name in [name, name+len), make it if missing */
+static lith_value *intern(lith_st *L, char *name, size_t len)
+{
+    struct lith_symbol_table *T;
+    struct lith_symbol_slot *slot;
+    unsigned long hash;
+    size_t i;
+    T = &L->symbols;
+    if ((4 * (T->count + 1) > 3 * T->cap) && !grow_symbols(L))
+        return NULL;
+    hash = hash_name(name, len);
+    for (i = hash & (T->cap - 1); T->slots[i].sym; i = (i + 1) & (T->cap - 1)) {
+        slot = &T->slots[i];
+        if ((slot->hash == hash) && (slot->len == len)
+        && !memcmp(slot->sym->value.symbol.name, name, len))
+            return slot->sym;
+    }
+    slot = &T->slots[i];
+    slot->sym = make_symbol(L, name, len);
+    if (!slot->sym) return NULL;
+    slot->hash = hash;
+    slot->len = len;
+    T->count++;
+    return slot->sym;
+}
+
+static int push_root(lith_st *, lith_value *);
+
+/* the strings, the numbers on the heap and the pairs read from the source
+ * are kept in the table of constants: the pairs by their car and cdr,
+ * which are the ones in the table already
+ */
+static int is_constant(lith_value *val)
+{
+    return (LITH_TAG(val) == LITH_TAG_PAIR) || ((LITH_TAG(val) == LITH_TAG_HEAP)
+        && ((val->type == LITH_TYPE_STRING) || (val->type == LITH_TYPE_INTEGER)
+        || (val->type == LITH_TYPE_NUMBER)));
+}
+
+static unsigned long hash_constant(lith_value *val)
+{
+    unsigned long h;
+    double number;
+    switch (LITH_TYPE_OF(val)) {
+    case LITH_TYPE_STRING:
+        return hash_name(val->value.string.buf, val->value.string.len);
+    case LITH_TYPE_NUMBER:
+        number = val->value.number;
+        return hash_name((char *) &number, sizeof(number));
+    case LITH_TYPE_INTEGER:
+        h = (unsigned long) val->value.integer;
+        break;
+    default:
+        h = (unsigned long) (LITH_WORD(LITH_CAR(val)) >> 3) * 31UL
+            + (unsigned long) (LITH_WORD(LITH_CDR(val)) >> 3);
+        break;
+    }
+    h ^= h >> 16;
+    h *= 0x45D9F3BUL;
+    h ^= h >> 16;
+    return h;
+}
+
+static int same_constant(lith_value *a, lith_value *b)
+{
+    if (LITH_TYPE_OF(a) != LITH_TYPE_OF(b)) return 0;
+    switch (LITH_TYPE_OF(a)) {
+    case LITH_TYPE_STRING:
+        return (a->value.string.len == b->value.string.len)
+            && !memcmp(a->value.string.buf, b->value.string.buf, a->value.string.len);
+    case LITH_TYPE_NUMBER:
+        return !memcmp(&a->value.number, &b->value.number, sizeof(double));
+    case LITH_TYPE_INTEGER:
+        return a->value.integer == b->value.integer;
+    default:
+        return (LITH_CAR(a) == LITH_CAR(b)) && (LITH_CDR(a) == LITH_CDR(b));
+    }
+}
+
+static struct lith_constant_slot *constant_slot(struct lith_constant_table *T,
+                                                unsigned long hash, lith_value *val)
+{
+    size_t i;
+    for (i = hash & (T->cap - 1); T->slots[i].val; i = (i + 1) & (T->cap - 1))
+        if ((T->slots[i].hash == hash) && same_constant(T->slots[i].val, val))
+            break;
+    return &T->slots[i];
+}
+
+static int grow_constants(struct lith_constant_table *T)
+{
+    struct lith_constant_table old;
+    size_t i;
+    old = *T;
+    T->cap = old.cap ? (2 * old.cap) : 64;
+    T->slots = calloc(T->cap, sizeof(*T->slots));
+    if (!T->slots) {
+        *T = old;
+        return 0;
+    }
+    for (i = 0; i < old.cap; i++)
+        if (old.slots[i].val)
+            *constant_slot(T, old.slots[i].hash, old.slots[i].val) = old.slots[i];
+    free(old.slots);
+    return 1;
+}
+
+/* the constant in the table the same as the value, the value when missing:
+ * without the memory for it, the value is not shared
+ */
+static lith_value *intern_constant(lith_st *L, lith_value *val)
+{
+    struct lith_constant_table *T;
+    struct lith_constant_slot *slot;
+    unsigned long hash;
+    T = &L->constants;
+    if ((4 * (T->count + 1) > 3 * T->cap) && !grow_constants(T))
+        return val;
+    hash = hash_constant(val);
+    slot = constant_slot(T, hash, val);
+    if (slot->val) return slot->val;
+    slot->hash = hash;
+    slot->val = val;
+    T->count++;
+    return val;
+}
+
+/* a datum just read, shared with the equal ones read before:
+ * the pairs of a list are kept on the eval stack while going down it,
+ * then interned from its end
+ */
+static lith_value *share_constant(lith_st *L, lith_value *val)
+{
+    lith_value *p, *q;
+    size_t sp;
+    if (!val || !is_constant(val)) return val;
+    if (!LITH_IS(val, LITH_TYPE_PAIR)) return intern_constant(L, val);
+    sp = L->gc.sp;
+    for (p = val; LITH_IS(p, LITH_TYPE_PAIR); p = LITH_CDR(p)) {
+        if (!push_root(L, p)) {
+            L->gc.sp = sp;
+            return NULL;
+        }
+        if (!(q = share_constant(L, LITH_CAR(p)))) {
+            L->gc.sp = sp;
+            return NULL;
+        }
+        LITH_CAR(p) = q;
+    }
+    val = share_constant(L, p);
+    while (L->gc.sp > sp) {
+        p = L->gc.stack[--L->gc.sp];
+        LITH_CDR(p) = val;
+        val = intern_constant(L, p);
+    }
+    return val;
+}
+
+/* the quoted data in the source is shared */
+static lith_value *share_quoted(lith_st *L, lith_value *list)
+{
+    lith_value *rest, *datum;
+    if (!LITH_IS(list, LITH_TYPE_PAIR) || (LITH_CAR(list) != L->forms[LITH_FORM_QUOTE]))
+        return list;
+    rest = LITH_CDR(list);
+    if (!LITH_IS(rest, LITH_TYPE_PAIR) || !LITH_IS_NIL(LITH_CDR(rest)))
+        return list;
+    if (!(datum = share_constant(L, LITH_CAR(rest)))) return NULL;
+    LITH_CAR(rest) = datum;
+    return list;
+}
+
 static void print_string(lith_string string, FILE *file)
 {
     size_t i;
@@ -160,7 +393,7 @@ static lith_value *read_atom(lith_st *L, char *start, char *end)
     }
     if ((*start == '#') && ((end - start) == 2)
     && ((start[1] == 't') || (start[1] == 'f'))) {
-        return (start[1] == 'f') ? L->False : L->True;
+        return (start[1] == 'f') ? LITH_FALSE : LITH_TRUE;
     }
     sign = (*start == '-') ? -1 : 1;
     integer = strtol(start, &next, 10);
@@ -172,11 +405,7 @@ static lith_value *read_atom(lith_st *L, char *start, char *end)
     } else if (next == end) {
         return lith_make_integer(L, integer);
     } else {
-        string = lith__strndup(L, start, end - start);
-        if (!string) return NULL;
-        val = lith_get_symbol(L, string);
-        free(string);
-        return val;
+        return intern(L, start, end - start);
     }
 }
 
@@ -196,34 +425,26 @@ static lith_value *read_list_expr(lith_st *L, char *start, char **end)
                     "while reading a list");
             return NULL;
         }
-        if (*t == ')') return list;
+        if (*t == ')') return share_quoted(L, list);
         if (*t == '.' && (*end - t == 1)) {
             if (LITH_IS_NIL(p)) {
                 lith_simple_error(L, LITH_ERR_SYNTAX,
                     "improper lists do not start with '.'");
-                lith_free_value(list);
                 return NULL;
             }
             expr = read_expr(L, *end, end);
-            if (LITH_IS_ERR(L)) {
-                 lith_free_value(list);
-                 return NULL;
-            }
+            if (LITH_IS_ERR(L)) return NULL;
             LITH_CDR(p) = expr;
             lex(L, *end, &t, end);
             if (LITH_IS_ERR(L) || (*t != ')')) {
                 lith_simple_error(L, LITH_ERR_SYNTAX,
                     "expecting ')' at the end of this improper list");
-                lith_free_value(list);
                 return NULL;
             }
             return list;
         }
         expr = read_expr(L, t, end);
-        if (LITH_IS_ERR(L)) {
-            lith_free_value(list);
-            return NULL;
-        }
+        if (LITH_IS_ERR(L)) return NULL;
         if (LITH_IS_NIL(p)) {
             list = LITH_CONS(L, expr, L->nil);
             p = list;
@@ -234,6 +455,25 @@ static lith_value *read_list_expr(lith_st *L, char *start, char **end)
     }
 }
 
+/* #(a b c): the items are not evaluated, and the vector is not
+ * shared with the equal ones, since its items can be changed */
+static lith_value *read_vector_expr(lith_st *L, char *start, char **end)
+{
+    lith_value *list, *p, *vec;
+    size_t i;
+    list = read_list_expr(L, start, end);
+    if (LITH_IS_ERR(L)) return NULL;
+    for (i = 0, p = list; LITH_IS(p, LITH_TYPE_PAIR); p = LITH_CDR(p)) i++;
+    if (!LITH_IS_NIL(p)) {
+        lith_simple_error(L, LITH_ERR_SYNTAX, "a vector is not an improper list");
+        return NULL;
+    }
+    if (!(vec = lith_make_vector(L, i, L->nil))) return NULL;
+    for (i = 0, p = list; !LITH_IS_NIL(p); p = LITH_CDR(p))
+        vec->value.vector.items[i++] = LITH_CAR(p);
+    return vec;
+}
+
 static lith_value *read_expr(lith_st *L, char *start, char **end)
 {
     lith_value *p, *q, *v;
@@ -242,6 +482,8 @@ static lith_value *read_expr(lith_st *L, char *start, char **end)
     if (LITH_IS_ERR(L)) return NULL;
     if (*t == '(') {
         return read_list_expr(L, *end, end);
+    } else if ((*t == '#') && (*end - t == 1) && (**end == '(')) {
+        return read_vector_expr(L, *end + 1, end);
     } else if (*t == ')') {
         lith_simple_error(L, LITH_ERR_SYNTAX,
             "unbalanced parenthesis, expected an expression");
@@ -257,13 +499,13 @@ static lith_value *read_expr(lith_st *L, char *start, char **end)
                 : "unquote";
         p = LITH_CONS(L, lith_get_symbol(L, s), L->nil);
         v = read_expr(L, *end, end);
-        if (!v) { lith_free_value(p); return NULL; }
+        if (!p || !v) return NULL;
         q = LITH_CONS(L, v, L->nil);
-        if (!q) { lith_free_value(v); lith_free_value(p); return NULL; }
+        if (!q) return NULL;
         LITH_CDR(p) = q;
-        return p;
+        return share_quoted(L, p);
     } else {
-        return read_atom(L, t, *end);
+        return share_constant(L, read_atom(L, t, *end));
     }
 }
 
@@ -285,33 +527,53 @@ static size_t list_length(lith_value *v)
     return len;
 }
 
+static int is_list(lith_value *v)
+{
+    return (LITH_IS_NIL(v) || LITH_IS(v, LITH_TYPE_PAIR)) && is_proper_list(v);
+}
+
+/* a copy of the list a, ending with b: for unquote-splicing */
+static lith_value *append_list(lith_st *L, lith_value *a, lith_value *b)
+{
+    lith_value *head, **tail;
+    tail = &head;
+    for (; LITH_IS(a, LITH_TYPE_PAIR); a = LITH_CDR(a)) {
+        *tail = LITH_CONS(L, LITH_CAR(a), b);
+        if (!*tail) return NULL;
+        tail = &LITH_CDR(*tail);
+    }
+    if (!LITH_IS_NIL(a)) {
+        lith_expect_type(L, "unquote-splicing", 1, LITH_TYPE_PAIR, a);
+        return NULL;
+    }
+    *tail = b;
+    return head;
+}
+
 /* builtin functions of lith */
 
 /* car[1] :: (car '(a . b)) -> a */
-static lith_value *builtin__car(lith_st *L, lith_value *args)
+static lith_value *builtin__car(lith_st *L, size_t argc, lith_value **argv)
 {
     lith_value *list;
-    list = LITH_CAR(args);
+    list = argv[0];
     if (!lith_expect_type(L, "car", 1, LITH_TYPE_PAIR, list)) return NULL;
     return LITH_CAR(list);
 }
 
 /* cdr[1] :: (cdr '(a . b)) -> b */
-static lith_value *builtin__cdr(lith_st *L, lith_value *args)
+static lith_value *builtin__cdr(lith_st *L, size_t argc, lith_value **argv)
 {
     lith_value *pair;
-    pair = LITH_CAR(args);
+    pair = argv[0];
     if (!lith_expect_type(L, "cdr", 1, LITH_TYPE_PAIR, pair)) return NULL;
     return LITH_CDR(pair);
 }
 
 /* cons[2] :: (cons a b) -> (a . b) */
-static lith_value *builtin__cons(lith_st *L, lith_value *args)
+static lith_value *builtin__cons(lith_st *L, size_t argc, lith_value **argv)
 {
-    lith_value *head, *tail;
-    head = LITH_CAR(args);
-    tail = LITH_CAR(LITH_CDR(args));
-    return LITH_CONS(L, head, tail);
+    return LITH_CONS(L, argv[0], argv[1]);
 }
 
 static void lith__print(lith_st *L, lith_value *v)
@@ -329,16 +591,13 @@ static void lith__print(lith_st *L, lith_value *v)
  * separated by ' '
  * and a newline ('\n')
  */
-static lith_value *builtin__print(lith_st *L, lith_value *args)
+static lith_value *builtin__print(lith_st *L, size_t argc, lith_value **argv)
 {
-    lith_value *v;
-    v = args;
-    lith__print(L, LITH_CAR(v));
-    v = LITH_CDR(v);
-    while (!LITH_IS_NIL(v)) {
+    size_t i;
+    lith__print(L, argv[0]);
+    for (i = 1; i < argc; i++) {
         putchar(' ');
-        lith__print(L, LITH_CAR(v));
-        v = LITH_CDR(v);
+        lith__print(L, argv[i]);
     }
     putchar('\n');
     return L->nil;
@@ -349,8 +608,8 @@ static lith_value *builtin__print(lith_st *L, lith_value *args)
         n2_is_integer, n2_is_number, \
         n1_is_numeric, n2_is_numeric; \
     lith_value *arg1, *arg2; \
-    arg1 = LITH_CAR(args); \
-    arg2 = LITH_CAR(LITH_CDR(args)); \
+    arg1 = argv[0]; \
+    arg2 = argv[1]; \
     n1_is_integer = LITH_IS(arg1, LITH_TYPE_INTEGER); \
     n1_is_number = LITH_IS(arg1, LITH_TYPE_NUMBER); \
     n1_is_numeric = n1_is_integer || n1_is_number; \
@@ -365,16 +624,16 @@ static lith_value *builtin__print(lith_st *L, lith_value *args)
 
 #define COMMON2(op) \
     if (n1_is_integer && n2_is_integer) { \
-        return lith_make_integer(L, arg1->value.integer op arg2->value.integer); \
+        return lith_make_integer(L, LITH_INTEGER(arg1) op LITH_INTEGER(arg2)); \
     } else { \
         return lith_make_number(L, \
           (n1_is_integer \
-            ? ((double) (arg1->value.integer)) \
-            : arg1->value.number) \
+            ? ((double) LITH_INTEGER(arg1)) \
+            : LITH_NUMBER(arg1)) \
           op \
           (n2_is_integer \
-            ? ((double) (arg2->value.integer)) \
-            : arg2->value.number)); \
+            ? ((double) LITH_INTEGER(arg2)) \
+            : LITH_NUMBER(arg2))); \
     }
 
 /* op1[2] ::: op1 <- (:+), (:-), (:*)
@@ -384,26 +643,26 @@ static lith_value *builtin__print(lith_st *L, lith_value *args)
  * (op1 num num) -> num
  */
 
-static lith_value *builtin__add(lith_st *L, lith_value *args)
+static lith_value *builtin__add(lith_st *L, size_t argc, lith_value **argv)
 {
     COMMON1(":+")
     COMMON2(+)
 }
 
-static lith_value *builtin__subtract(lith_st *L, lith_value *args)
+static lith_value *builtin__subtract(lith_st *L, size_t argc, lith_value **argv)
 {
     COMMON1(":-")
     COMMON2(-)
 }
 
-static lith_value *builtin__multiply(lith_st *L, lith_value *args)
+static lith_value *builtin__multiply(lith_st *L, size_t argc, lith_value **argv)
 {
     COMMON1(":*")
     COMMON2(*)
 }
 
 #define COMMON3(op, q) \
-    if (q && (arg2->value.integer == 0L)) { \
+    if (q && (LITH_INTEGER(arg2) == 0L)) { \
         lith_simple_error(L, LITH_ERR_TYPE, "cannot " op " by zero!!"); \
         return NULL; \
     }
@@ -416,7 +675,7 @@ static lith_value *builtin__multiply(lith_st *L, lith_value *args)
  * (:/ num num) -> num
  */
 
-static lith_value *builtin__divide(lith_st *L, lith_value *args)
+static lith_value *builtin__divide(lith_st *L, size_t argc, lith_value **argv)
 {
     COMMON1(":/")
     COMMON3("divide", n2_is_integer)
@@ -424,31 +683,31 @@ static lith_value *builtin__divide(lith_st *L, lith_value *args)
 }
 
 /* :%[2] (:% int int) -> int */
-static lith_value *builtin__modulus(lith_st *L, lith_value *args)
+static lith_value *builtin__modulus(lith_st *L, size_t argc, lith_value **argv)
 {
     lith_value *arg1, *arg2;
-    arg1 = LITH_CAR(args);
-    arg2 = LITH_CAR(LITH_CDR(args));
+    arg1 = argv[0];
+    arg2 = argv[1];
     if (!LITH_IS(arg1, LITH_TYPE_INTEGER) || !LITH_IS(arg2, LITH_TYPE_INTEGER)) {
         lith_simple_error(L, LITH_ERR_TYPE, "can calculate modulus with integral arguments only");
         return NULL;
     }
     COMMON3("mod", 1)
-    return lith_make_integer(L, arg1->value.integer % arg2->value.integer);
+    return lith_make_integer(L, LITH_INTEGER(arg1) % LITH_INTEGER(arg2));
 }
 
 #define COMMON4(op) \
     if (n1_is_integer && n2_is_integer) { \
-        return LITH_IN_BOOL(arg1->value.integer op arg2->value.integer); \
+        return LITH_IN_BOOL(LITH_INTEGER(arg1) op LITH_INTEGER(arg2)); \
     } else { \
         return LITH_IN_BOOL( \
           (n1_is_integer \
-            ? ((double) (arg1->value.integer)) \
-            : arg1->value.number) \
+            ? ((double) LITH_INTEGER(arg1)) \
+            : LITH_NUMBER(arg1)) \
           op \
           (n2_is_integer \
-            ? ((double) (arg2->value.integer)) \
-            : arg2->value.number) \
+            ? ((double) LITH_INTEGER(arg2)) \
+            : LITH_NUMBER(arg2)) \
         ); \
     }
 
@@ -457,19 +716,19 @@ static lith_value *builtin__modulus(lith_st *L, lith_value *args)
  * (op2 numeric numeric) -> bool
  */
 
-static lith_value *builtin__is_less_than(lith_st *L, lith_value *args)
+static lith_value *builtin__is_less_than(lith_st *L, size_t argc, lith_value **argv)
 {
     COMMON1(":<")
     COMMON4(<)
 }
 
-static lith_value *builtin__is_num_equal(lith_st *L, lith_value *args)
+static lith_value *builtin__is_num_equal(lith_st *L, size_t argc, lith_value **argv)
 {
     COMMON1(":==")
     COMMON4(==)
 }
 
-static lith_value *builtin__is_greater_than(lith_st *L, lith_value *args)
+static lith_value *builtin__is_greater_than(lith_st *L, size_t argc, lith_value **argv)
 {
     COMMON1(":>")
     COMMON4(>)
@@ -480,220 +739,4777 @@ static lith_value *builtin__is_greater_than(lith_st *L, lith_value *args)
 #undef COMMON2
 #undef COMMON1
 
-/* eq?[2] :: (eq? a b) -> bool */
-static lith_value *builtin__is_eq(lith_st *L, lith_value *args)
-{
-    int eq;
-    lith_value *arg1, *arg2;
-    arg1 = LITH_CAR(args);
-    arg2 = LITH_CAR(LITH_CDR(args));
-    if (arg1->type != arg2->type) return L->False;
-    switch (arg1->type) {
-    case LITH_TYPE_NIL:
-        return L->True;
-    case LITH_TYPE_INTEGER:
-        eq = arg1->value.integer == arg2->value.integer; break;
-    case LITH_TYPE_NUMBER:
-        eq = arg1->value.number == arg2->value.number; break;
-    case LITH_TYPE_STRING:
-        if (arg1->value.string.len != arg2->value.string.len) return L->False;
-        eq = !memcmp(arg1->value.string.buf, 
-            arg2->value.string.buf, arg2->value.string.len);
-        break;
-    default: eq = arg1 == arg2; break;
-    }
-    return LITH_IN_BOOL(eq);
-}
+enum { ARITH_ADD, ARITH_SUBTRACT, ARITH_MULTIPLY, ARITH_DIVIDE };
 
-/* typeof[1] :: (typeof a) -> sym */
-static lith_value *builtin__typeof(lith_st *L, lith_value *args)
+static int expect_numeric(lith_st *L, lith_value *v)
 {
-    lith_value *val;
-    val = LITH_CAR(args);
-    return lith_get_symbol(L, L->types[val->type]);
+    if ((LITH_TAG(v) == LITH_TAG_FIXNUM) || LITH_IS(v, LITH_TYPE_INTEGER)
+    || LITH_IS(v, LITH_TYPE_NUMBER)) return 1;
+    lith_simple_error(L, LITH_ERR_TYPE,
+        "expected numeric types (integers or numbers) as argument");
+    return 0;
 }
 
-/* nil?[1] :: (nil? a) -> bool */
-static lith_value *builtin__is_nil(lith_st *L, lith_value *args)
+/* the integers are added up in a long while there are only integers,
+ * in a double from the first number on: only the result is made,
+ * the integers wrap around as the unsigned ones do
+ */
+static lith_value *arith(lith_st *L, size_t argc, lith_value **argv, int op)
 {
-    return LITH_IN_BOOL(LITH_IS_NIL(LITH_CAR(args)));
+    long n, m;
+    double x, y;
+    int is_number;
+    size_t i;
+    lith_value *v;
+    if (!argc)
+        return LITH_FIXNUM(((op == ARITH_ADD) || (op == ARITH_SUBTRACT)) ? 0 : 1);
+    n = ((op == ARITH_ADD) || (op == ARITH_SUBTRACT)) ? 0 : 1;
+    x = 0.0;
+    is_number = 0;
+    i = 0;
+    if ((op == ARITH_SUBTRACT) || (op == ARITH_DIVIDE)) {
+        v = argv[i++];
+        if (!expect_numeric(L, v)) return NULL;
+        if (LITH_IS(v, LITH_TYPE_NUMBER)) {
+            x = LITH_NUMBER(v);
+            is_number = 1;
+        } else {
+            n = LITH_INTEGER(v);
+        }
+    }
+    for (; i < argc; i++) {
+        v = argv[i];
+        if (LITH_TAG(v) == LITH_TAG_FIXNUM) {
+            m = LITH_FIXNUM_VALUE(v);
+        } else if (!expect_numeric(L, v)) {
+            return NULL;
+        } else if (LITH_IS(v, LITH_TYPE_INTEGER)) {
+            m = LITH_INTEGER(v);
+        } else {
+            if (!is_number) {
+                x = (double) n;
+                is_number = 1;
+            }
+            y = LITH_NUMBER(v);
+            switch (op) {
+            case ARITH_ADD: x += y; break;
+            case ARITH_SUBTRACT: x -= y; break;
+            case ARITH_MULTIPLY: x *= y; break;
+            case ARITH_DIVIDE: x /= y; break;
+            }
+            continue;
+        }
+        if ((op == ARITH_DIVIDE) && (m == 0)) {
+            lith_simple_error(L, LITH_ERR_TYPE, "cannot divide by zero!!");
+            return NULL;
+        }
+        if (is_number) {
+            switch (op) {
+            case ARITH_ADD: x += m; break;
+            case ARITH_SUBTRACT: x -= m; break;
+            case ARITH_MULTIPLY: x *= m; break;
+            case ARITH_DIVIDE: x /= m; break;
+            }
+            continue;
+        }
+        switch (op) {
+        case ARITH_ADD:
+            n = (long) ((unsigned long) n + (unsigned long) m);
+            break;
+        case ARITH_SUBTRACT:
+            n = (long) ((unsigned long) n - (unsigned long) m);
+            break;
+        case ARITH_MULTIPLY:
+            n = (long) ((unsigned long) n * (unsigned long) m);
+            break;
+        case ARITH_DIVIDE:
+            n = ((m == -1) && (n == LONG_MIN)) ? n : (n / m);
+            break;
+        }
+    }
+    if (is_number)
+        return lith_make_number(L, x);
+    if (LITH_FITS_FIXNUM(n))
+        return LITH_FIXNUM(n);
+    return lith_make_integer(L, n);
 }
 
-/* list?[1] :: (list? a) -> bool */
-static lith_value *builtin__is_list(lith_st *L, lith_value *args)
+/* +[0+], -[0+], *[0+], /[0+] ::
+ * (+ numeric ...) -> numeric
+ * the sum, the difference from the first, the product and the quotient of
+ * the first, (+) -> 0, (-) -> 0, (*) -> 1, (/) -> 1,
+ * an integer as long as all are integers
+ */
+static lith_value *builtin__sum(lith_st *L, size_t argc, lith_value **argv)
 {
-    lith_value *val;
-    val = LITH_CAR(args);
-    return LITH_IN_BOOL(LITH_IS(val, LITH_TYPE_PAIR)
-        && is_proper_list(val));
+    return arith(L, argc, argv, ARITH_ADD);
 }
 
-/* apply[2] :: (apply (i... -> a) (i...)) -> a */
-static lith_value *builtin__apply(lith_st *L, lith_value *args)
+static lith_value *builtin__difference(lith_st *L, size_t argc, lith_value **argv)
 {
-    lith_value *f, *aargs, *cargs;
-    f = LITH_CAR(args);
-    aargs = LITH_CAR(LITH_CDR(args));
-    cargs = lith_copy_value(L, aargs);
-    if (!cargs) return NULL;
-    return lith_apply(L, f, cargs);
+    return arith(L, argc, argv, ARITH_SUBTRACT);
 }
 
-/* error[1] :: (error str) -> _|_ */
-static lith_value *builtin__error(lith_st *L, lith_value *args)
+static lith_value *builtin__product(lith_st *L, size_t argc, lith_value **argv)
 {
-    lith_value *arg;
-    arg = LITH_CAR(args);
-    if (!lith_expect_type(L, "error", 1, LITH_TYPE_STRING, arg)) return NULL;
-    L->error = LITH_ERR_CUSTOM;
-    L->error_state.msg = arg->value.string.buf;
-    return NULL;
+    return arith(L, argc, argv, ARITH_MULTIPLY);
 }
 
-/* load[1] :: (load str) -> ()
- * the contents of the file given by
- * the string containing the path of that file is executed
- */
-
-static lith_value *builtin__load(lith_st *L, lith_value *args)
+static lith_value *builtin__quotient(lith_st *L, size_t argc, lith_value **argv)
 {
-    lith_value *filename;
-    filename = LITH_CAR(args);
-    if (!lith_expect_type(L, "load", 1, LITH_TYPE_STRING, filename)) return NULL;
-    lith_run_file(L, L->global, filename->value.string.buf);
-    if (LITH_IS_ERR(L))
-        return NULL;
-    else
-        return L->nil;
+    return arith(L, argc, argv, ARITH_DIVIDE);
 }
 
-/* some more utilities */
+enum { COMPARE_LT, COMPARE_GT, COMPARE_EQ, COMPARE_LE, COMPARE_GE };
 
-static char *slurp(lith_st *L, char *filename)
+/* each argument with the next, up to the first which is out of order:
+ * (<= a b) is (not (> a b)) and (>= a b) is (not (< a b))
+ */
+static lith_value *compare(lith_st *L, size_t argc, lith_value **argv, int op)
 {
-    FILE *file;
-    char *buffer;
-    long length;
-    
-    file = fopen(filename, "r");
-    if (!file) {
-        lith_simple_error(L, LITH_ERR_CUSTOM, "could not open the file to be read");
-        return NULL;
+    lith_value *a, *b;
+    long n, m;
+    double x, y;
+    int in_order;
+    size_t i;
+    a = argv[0];
+    if (!expect_numeric(L, a)) return NULL;
+    for (i = 1; i < argc; i++, a = b) {
+        b = argv[i];
+        if (!expect_numeric(L, b)) return NULL;
+        if (!LITH_IS(a, LITH_TYPE_NUMBER) && !LITH_IS(b, LITH_TYPE_NUMBER)) {
+            n = LITH_INTEGER(a);
+            m = LITH_INTEGER(b);
+            switch (op) {
+            case COMPARE_LT: in_order = n < m; break;
+            case COMPARE_GT: in_order = n > m; break;
+            case COMPARE_EQ: in_order = n == m; break;
+            case COMPARE_LE: in_order = !(n > m); break;
+            default: in_order = !(n < m); break;
+            }
+        } else {
+            x = LITH_IS(a, LITH_TYPE_NUMBER) ? LITH_NUMBER(a) : (double) LITH_INTEGER(a);
+            y = LITH_IS(b, LITH_TYPE_NUMBER) ? LITH_NUMBER(b) : (double) LITH_INTEGER(b);
+            switch (op) {
+            case COMPARE_LT: in_order = x < y; break;
+            case COMPARE_GT: in_order = x > y; break;
+            case COMPARE_EQ: in_order = x == y; break;
+            case COMPARE_LE: in_order = !(x > y); break;
+            default: in_order = !(x < y); break;
+            }
+        }
+        if (!in_order) return L->False;
     }
-    
-    fseek(file, 0, SEEK_END);
-    length = ftell(file);
-    fseek(file, 0, SEEK_SET);
-    
-    buffer = emalloc(L, length + 1);
-    if (!buffer) return NULL;
-    
-    fread(buffer, 1, length, file);
-    buffer[length] = '\0';
-    fclose(file);
-    
-    return buffer;
+    return L->True;
 }
 
-static void init_types(char **types)
+/* <[2+], >[2+], =[2+], <=[2+], >=[2+] ::
+ * (< numeric numeric ...) -> bool
+ */
+static lith_value *builtin__less(lith_st *L, size_t argc, lith_value **argv)
 {
-    types[LITH_TYPE_NIL] = "nil";
-    types[LITH_TYPE_PAIR] = "pair";
-    types[LITH_TYPE_BOOLEAN] = "boolean";
-    types[LITH_TYPE_INTEGER] = "integer";
-    types[LITH_TYPE_NUMBER] = "number";
-    types[LITH_TYPE_SYMBOL] = "symbol";
-    types[LITH_TYPE_STRING] = "string";
-    types[LITH_TYPE_BUILTIN] = "builtin";
-    types[LITH_TYPE_CLOSURE] = "closure";
-    types[LITH_TYPE_MACRO] = "macro";
+    return compare(L, argc, argv, COMPARE_LT);
 }
 
-struct lith_lib_fn lith_builtins[] = {
-    {"car", 1, 1, builtin__car},
-    {"cdr", 1, 1, builtin__cdr},
-    {"cons", 2, 1, builtin__cons},
-    {"typeof", 1, 1, builtin__typeof},
-    {"print", 1, 0, builtin__print},
-    {":+", 2, 1, builtin__add},
-    {":-", 2, 1, builtin__subtract},
-    {":*", 2, 1, builtin__multiply},
-    {":/", 2, 1, builtin__divide},
-    {":%", 2, 1, builtin__modulus},
-    {":<", 2, 1, builtin__is_less_than},
-    {":==", 2, 1, builtin__is_num_equal},
-    {":>", 2, 1, builtin__is_greater_than},
-    {"eq?", 2, 1, builtin__is_eq},
-    {"nil?", 1, 1, builtin__is_nil},
-    {"list?", 1, 1, builtin__is_list},
-    {"apply", 2, 1, builtin__apply},
-    {"error", 1, 1, builtin__error},
-    {"load", 1, 1, builtin__load},
-    {NULL, 0, 0, NULL}
-};
-
-/* Public functions */
-
-void lith_init(lith_st *L)
+static lith_value *builtin__greater(lith_st *L, size_t argc, lith_value **argv)
 {
-    L->error = LITH_ERR_OK;
-    L->error_state.manual = 0;
-    L->error_state.success = 1;
-    L->error_state.sym = L->error_state.msg = L->error_state.name = NULL;
-    L->error_state.expr = NULL;
-    L->nil = lith_new_value(L);
-    L->nil->type = LITH_TYPE_NIL;
-    L->True = lith_new_value(L);
-    L->False = lith_new_value(L);
-    L->True->type = L->False->type = LITH_TYPE_BOOLEAN;
-    L->True->value.boolean = 1;
-    L->False->value.boolean = 0;
-    L->symbol_table = L->nil;
-    L->global = lith_new_env(L, L->nil);
-    L->global = lith_new_env(L, L->global);
-    L->filename = "<<unspecified>>";
-    init_types(L->types);
-    lith_fill_env(L, lith_builtins);
+    return compare(L, argc, argv, COMPARE_GT);
 }
 
-void lith_free(lith_st *L)
+static lith_value *builtin__num_equal(lith_st *L, size_t argc, lith_value **argv)
 {
-    lith_value *p, *v;
-    lith_free_value(L->global);
-    p = L->symbol_table;
-    while (!LITH_IS_NIL(p)) {
-        v = LITH_CAR(p);
-        free(v->value.symbol);
-        free(v);
-        p = LITH_CDR(p);
-    }
-    if (L->error_state.expr)
-        lith_free_value(L->error_state.expr);
-    free(L->False);
-    free(L->True);
-    free(L->nil);
+    return compare(L, argc, argv, COMPARE_EQ);
 }
 
-void lith_clear_error_state(lith_st *L)
+static lith_value *builtin__less_or_equal(lith_st *L, size_t argc, lith_value **argv)
 {
-    L->error = LITH_ERR_OK;
-    L->error_state.success = 1;
-    L->error_state.manual = 0;
-    L->error_state.msg = L->error_state.sym = L->error_state.name = NULL;
-    if (L->error_state.expr) {
-        lith_free_value(L->error_state.expr);
-        L->error_state.expr = NULL;
-    }
+    return compare(L, argc, argv, COMPARE_LE);
 }
 
-lith_value *lith_new_value(lith_st *L)
+static lith_value *builtin__greater_or_equal(lith_st *L, size_t argc, lith_value **argv)
 {
-    return emalloc(L, sizeof(lith_value));
+    return compare(L, argc, argv, COMPARE_GE);
 }
 
-lith_value *lith_make_integer(lith_st *L, long integer)
+/* equal numbers, or the same bits when keys are compared: a NaN is
+ * then the same as itself, so that it can be found again */
+static int same_number(double x, double y, int keys)
+{
+    return (x == y) || (keys && !memcmp(&x, &y, sizeof(x)));
+}
+
+static int is_eq(lith_value *arg1, lith_value *arg2)
+{
+    if (LITH_TYPE_OF(arg1) != LITH_TYPE_OF(arg2)) return 0;
+    switch (LITH_TYPE_OF(arg1)) {
+    case LITH_TYPE_INTEGER:
+        return LITH_INTEGER(arg1) == LITH_INTEGER(arg2);
+    case LITH_TYPE_NUMBER:
+        return LITH_NUMBER(arg1) == LITH_NUMBER(arg2);
+    case LITH_TYPE_STRING:
+        if (arg1->value.string.len != arg2->value.string.len) return 0;
+        return !memcmp(arg1->value.string.buf, 
+            arg2->value.string.buf, arg2->value.string.len);
+    case LITH_TYPE_VECTOR:
+        /* the items can change: only the same vector is eq? */
+    default: return arg1 == arg2;
+    }
+}
+
+static int equal_trees(lith_st *, lith_value *, lith_value *);
+static int check_depth(lith_st *);
+
+/* the same as eq? for the atoms, and made of equal items otherwise:
+ * the lists are gone along, and the pairs and the vectors gone into
+ * with the eval stack, not the C stack, as frames of the two values
+ * and the index of their items being compared; a vector is left only
+ * after its last item, so going around a cycle of vectors fills the
+ * eval stack, which is an error: 0 is returned, for the callers to
+ * check for it; the numbers of keys are compared with same_number
+ */
+static int equal_values(lith_st *L, lith_value *a, lith_value *b, int keys)
+{
+    lith_value **frame;
+    size_t base, i;
+    int equal;
+    base = L->gc.sp;
+    equal = 0;
+    for (;;) {
+        if ((a == b) && (keys || !LITH_IS(a, LITH_TYPE_NUMBER))) goto next;
+        if (LITH_TYPE_OF(a) != LITH_TYPE_OF(b)) goto done;
+        switch (LITH_TYPE_OF(a)) {
+        case LITH_TYPE_VECTOR:
+            if (a->value.vector.len != b->value.vector.len) goto done;
+            if (!a->value.vector.len) goto next;
+            /* fall through */
+        case LITH_TYPE_PAIR:
+            if (!push_root(L, a) || !push_root(L, b) || !push_root(L, LITH_FIXNUM(0)))
+                goto done;
+            a = LITH_IS(a, LITH_TYPE_PAIR) ? LITH_CAR(a) : a->value.vector.items[0];
+            b = LITH_IS(b, LITH_TYPE_PAIR) ? LITH_CAR(b) : b->value.vector.items[0];
+            continue;
+        case LITH_TYPE_F64ARRAY:
+            if (a->value.array.len != b->value.array.len) goto done;
+            for (i = 0; i < a->value.array.len; i++)
+                if (!same_number(a->value.array.items.f64[i], b->value.array.items.f64[i], keys))
+                    goto done;
+            break;
+        case LITH_TYPE_I64ARRAY:
+            if (a->value.array.len != b->value.array.len) goto done;
+            for (i = 0; i < a->value.array.len; i++)
+                if (a->value.array.items.i64[i] != b->value.array.items.i64[i]) goto done;
+            break;
+        case LITH_TYPE_PMAP:
+        case LITH_TYPE_PVECTOR:
+            if (!check_depth(L) || !equal_trees(L, a, b)) goto done;
+            break;
+        case LITH_TYPE_NUMBER:
+            if (!same_number(LITH_NUMBER(a), LITH_NUMBER(b), keys)) goto done;
+            break;
+        default:
+            if (!is_eq(a, b)) goto done;
+        }
+    next:
+        /* the next items of the innermost frame: the cdr of a pair is
+         * compared in place of it */
+        for (;;) {
+            if (L->gc.sp == base) {
+                equal = 1;
+                goto done;
+            }
+            frame = L->gc.stack + L->gc.sp - 3;
+            if (LITH_IS(frame[0], LITH_TYPE_PAIR)) {
+                a = LITH_CDR(frame[0]);
+                b = LITH_CDR(frame[1]);
+                L->gc.sp -= 3;
+                break;
+            }
+            i = (size_t) LITH_FIXNUM_VALUE(frame[2]) + 1;
+            if (i < frame[0]->value.vector.len) {
+                frame[2] = LITH_FIXNUM(i);
+                a = frame[0]->value.vector.items[i];
+                b = frame[1]->value.vector.items[i];
+                break;
+            }
+            L->gc.sp -= 3;
+        }
+    }
+done:
+    L->gc.sp = base;
+    return equal;
+}
+
+static int is_equal(lith_st *L, lith_value *a, lith_value *b)
+{
+    return equal_values(L, a, b, 0);
+}
+
+/* the same key of a table or of a map */
+static int same_key(lith_st *L, lith_value *a, lith_value *b)
+{
+    return equal_values(L, a, b, 1);
+}
+
+/* eq?[2] :: (eq? a b) -> bool */
+static lith_value *builtin__is_eq(lith_st *L, size_t argc, lith_value **argv)
+{
+    return LITH_IN_BOOL(is_eq(argv[0], argv[1]));
+}
+
+/* equal?[2] :: (equal? a b) -> bool */
+static lith_value *builtin__is_equal(lith_st *L, size_t argc, lith_value **argv)
+{
+    int equal;
+    equal = is_equal(L, argv[0], argv[1]);
+    return LITH_IS_ERR(L) ? NULL : LITH_IN_BOOL(equal);
+}
+
+/* typeof[1] :: (typeof a) -> sym */
+static lith_value *builtin__typeof(lith_st *L, size_t argc, lith_value **argv)
+{
+    return lith_get_symbol(L, L->types[LITH_TYPE_OF(argv[0])]);
+}
+
+/* nil?[1] :: (nil? a) -> bool */
+static lith_value *builtin__is_nil(lith_st *L, size_t argc, lith_value **argv)
+{
+    return LITH_IN_BOOL(LITH_IS_NIL(argv[0]));
+}
+
+/* list?[1] :: (list? a) -> bool */
+static lith_value *builtin__is_list(lith_st *L, size_t argc, lith_value **argv)
+{
+    lith_value *val;
+    val = argv[0];
+    return LITH_IN_BOOL(LITH_IS(val, LITH_TYPE_PAIR)
+        && is_proper_list(val));
+}
+
+/* apply[2] :: (apply (i... -> a) (i...)) -> a */
+static lith_value *builtin__apply(lith_st *L, size_t argc, lith_value **argv)
+{
+    return lith_apply(L, argv[0], argv[1]);
+}
+
+/* the list functions are pipelines: the values of a list, or the numbers
+ * of a range, go through stages which map or filter them, and are
+ * collected in a new list or folded into a value; the compiler fuses
+ * chains of calls of these into one pipeline, without the lists between:
+ * a fused pipeline takes each value through all of its stages before
+ * the next one, so in (map g (filter p xs)) p and g take turns where
+ * unfused p is called on all of xs first; only the stages whose
+ * functions are known to be without effects are fused, which cannot
+ * tell the difference
+ */
+enum lith_stage { STAGE_LIST, STAGE_RANGE, STAGE_MAP, STAGE_FILTER, STAGE_FOLDL };
+
+#define LITH_MAX_STAGES 8
+
+static char *stage_names[] = { NULL, "range", "map", "filter", "foldl" };
+
+/* the arguments of each stage, without the list it takes */
+static size_t stage_nargs[] = { 1, 2, 1, 1, 2 };
+
+static lith_value *call(lith_st *, lith_value *, size_t, lith_value **);
+
+static lith_value *call_stage(lith_st *L, lith_value *f, size_t argc,
+                              lith_value *a, lith_value *b)
+{
+    size_t sp;
+    lith_value *val;
+    sp = L->gc.sp;
+    val = (push_root(L, a) && ((argc < 2) || push_root(L, b)))
+        ? call(L, f, argc, L->gc.stack + sp) : NULL;
+    L->gc.sp = sp;
+    return val;
+}
+
+/* the stages from the outermost to the source, with their arguments in
+ * the same order: all that is in use is kept on the eval stack,
+ * after the arguments, which are copied there first
+ */
+static lith_value *run_pipeline(lith_st *L, size_t nstages, enum lith_stage *stages,
+                                size_t argc, lith_value **argv)
+{
+    lith_value *copy[2 * LITH_MAX_STAGES], *pair[2], *val, *last;
+    size_t sp, at[LITH_MAX_STAGES], i, next, cur, result, first;
+    int keep;
+    enum lith_stage source;
+    #define SLOT(i) (L->gc.stack[sp + (i)])
+    sp = L->gc.sp;
+    for (i = 0; i < argc; i++)
+        copy[i] = argv[i];
+    for (i = 0; i < argc; i++)
+        if (!push_root(L, copy[i])) goto fail;
+    for (i = 0; i < nstages; i++)
+        at[i] = i ? (at[i - 1] + stage_nargs[stages[i - 1]]) : 0;
+    next = argc;
+    cur = argc + 1;
+    result = argc + 2;
+    source = stages[nstages - 1];
+    first = stages[0] == STAGE_FOLDL;
+    if (!push_root(L, SLOT(at[nstages - 1])) || !push_root(L, L->nil)
+    || !push_root(L, first ? SLOT(at[0] + 1) : L->nil)) goto fail;
+    last = NULL;
+    for (;;) {
+        if (source == STAGE_RANGE) {
+            pair[0] = SLOT(next);
+            pair[1] = SLOT(at[nstages - 1] + 1);
+            if (!(val = compare(L, 2, pair, COMPARE_GT))) goto fail;
+            if (val == L->True) break;
+            SLOT(cur) = pair[0];
+            pair[1] = LITH_FIXNUM(1);
+            if (!(val = arith(L, 2, pair, ARITH_ADD))) goto fail;
+            SLOT(next) = val;
+        } else {
+            val = SLOT(next);
+            if (LITH_IS_NIL(val)) break;
+            if (!lith_expect_type(L, stage_names[stages[nstages - 2]],
+                    stage_nargs[stages[nstages - 2]] + 1, LITH_TYPE_PAIR, val))
+                goto fail;
+            SLOT(cur) = LITH_CAR(val);
+            SLOT(next) = LITH_CDR(val);
+        }
+        for (keep = 1, i = nstages - 1; keep && (i-- > first); ) {
+            if (!(val = call_stage(L, SLOT(at[i]), 1, SLOT(cur), NULL))) goto fail;
+            if (stages[i] == STAGE_MAP)
+                SLOT(cur) = val;
+            else
+                keep = LITH_TO_BOOL(val);
+        }
+        if (!keep) continue;
+        if (first) {
+            val = call_stage(L, SLOT(at[0]), 2, SLOT(result), SLOT(cur));
+            if (!val) goto fail;
+            SLOT(result) = val;
+            continue;
+        }
+        if (!(val = LITH_CONS(L, SLOT(cur), L->nil))) goto fail;
+        if (last)
+            LITH_CDR(last) = val;
+        else
+            SLOT(result) = val;
+        last = val;
+    }
+    val = SLOT(result);
+    L->gc.sp = sp;
+    return val;
+    #undef SLOT
+fail:
+    L->gc.sp = sp;
+    return NULL;
+}
+
+/* range[2] :: (range numeric numeric) -> (numeric...)
+ * from the first up to the second, by one */
+static lith_value *builtin__range(lith_st *L, size_t argc, lith_value **argv)
+{
+    static enum lith_stage stages[] = { STAGE_RANGE };
+    return run_pipeline(L, 1, stages, argc, argv);
+}
+
+/* map[2] :: (map (a -> b) (a...)) -> (b...) */
+static lith_value *builtin__map(lith_st *L, size_t argc, lith_value **argv)
+{
+    static enum lith_stage stages[] = { STAGE_MAP, STAGE_LIST };
+    return run_pipeline(L, 2, stages, argc, argv);
+}
+
+/* filter[2] :: (filter (a -> bool) (a...)) -> (a...)
+ * the predicate is called from the last item to the first, as it was
+ * by the filter of lib.lith: the list is reversed first, and the items
+ * kept are consed in front of those kept after them */
+static lith_value *builtin__filter(lith_st *L, size_t argc, lith_value **argv)
+{
+    lith_value *p, *val;
+    size_t sp;
+    #define SLOT(i) (L->gc.stack[sp + (i)])
+    sp = L->gc.sp;
+    if (!push_root(L, argv[0]) || !push_root(L, L->nil) || !push_root(L, L->nil))
+        goto fail;
+    for (p = argv[1]; !LITH_IS_NIL(p); p = LITH_CDR(p)) {
+        if (!lith_expect_type(L, "filter", 2, LITH_TYPE_PAIR, p)) goto fail;
+        if (!(val = LITH_CONS(L, LITH_CAR(p), SLOT(1)))) goto fail;
+        SLOT(1) = val;
+    }
+    for (; !LITH_IS_NIL(SLOT(1)); SLOT(1) = LITH_CDR(SLOT(1))) {
+        if (!(val = call_stage(L, SLOT(0), 1, LITH_CAR(SLOT(1)), NULL))) goto fail;
+        if (!LITH_TO_BOOL(val)) continue;
+        if (!(val = LITH_CONS(L, LITH_CAR(SLOT(1)), SLOT(2)))) goto fail;
+        SLOT(2) = val;
+    }
+    val = SLOT(2);
+    L->gc.sp = sp;
+    return val;
+    #undef SLOT
+fail:
+    L->gc.sp = sp;
+    return NULL;
+}
+
+/* foldl[3] :: (foldl (b a -> b) b (a...)) -> b */
+static lith_value *builtin__foldl(lith_st *L, size_t argc, lith_value **argv)
+{
+    static enum lith_stage stages[] = { STAGE_FOLDL, STAGE_LIST };
+    return run_pipeline(L, 2, stages, argc, argv);
+}
+
+/* the pipeline fused by the compiler: the stages, then their arguments */
+static lith_value *builtin__pipeline(lith_st *L, size_t argc, lith_value **argv)
+{
+    enum lith_stage stages[LITH_MAX_STAGES];
+    lith_value *plan;
+    size_t n;
+    for (n = 0, plan = argv[0]; LITH_IS(plan, LITH_TYPE_PAIR); n++, plan = LITH_CDR(plan))
+        stages[n] = (enum lith_stage) LITH_FIXNUM_VALUE(LITH_CAR(plan));
+    return run_pipeline(L, n, stages, argc - 1, argv + 1);
+}
+
+/* the optional arguments of a builtin, up to the most it takes */
+static int expect_at_most(lith_st *L, char *name, size_t most, size_t argc)
+{
+    if (argc <= most) return 1;
+    L->error = LITH_ERR_NARGS;
+    L->error_state.name = name;
+    L->error_state.nargs.expected = most;
+    L->error_state.nargs.exact = 1;
+    L->error_state.nargs.got = argc;
+    return 0;
+}
+
+/* the index given to a vector builtin, from 0 up to the last */
+static int vector_index(lith_st *L, char *name, size_t narg, lith_value *i,
+                        long last, size_t *index)
+{
+    if (!lith_expect_type(L, name, narg, LITH_TYPE_INTEGER, i)) return 0;
+    if ((LITH_INTEGER(i) < 0) || (LITH_INTEGER(i) > last)) {
+        lith_simple_error(L, LITH_ERR_CUSTOM, "index out of range");
+        L->error_state.name = name;
+        L->error_state.expr = i;
+        return 0;
+    }
+    *index = (size_t) LITH_INTEGER(i);
+    return 1;
+}
+
+/* make-vector[1+] :: (make-vector int [a]) -> vec
+ * of that many items, each the second argument or () */
+static lith_value *builtin__make_vector(lith_st *L, size_t argc, lith_value **argv)
+{
+    size_t n;
+    if (!expect_at_most(L, "make-vector", 2, argc)) return NULL;
+    if (!lith_expect_type(L, "make-vector", 1, LITH_TYPE_INTEGER, argv[0])) return NULL;
+    if (LITH_INTEGER(argv[0]) < 0) {
+        lith_simple_error(L, LITH_ERR_CUSTOM, "the length of a vector is not negative");
+        L->error_state.name = "make-vector";
+        L->error_state.expr = argv[0];
+        return NULL;
+    }
+    n = (size_t) LITH_INTEGER(argv[0]);
+    return lith_make_vector(L, n, (argc == 2) ? argv[1] : L->nil);
+}
+
+/* vector[0+] :: (vector a...) -> vec */
+static lith_value *builtin__vector(lith_st *L, size_t argc, lith_value **argv)
+{
+    lith_value *vec;
+    size_t i;
+    if (!(vec = lith_make_vector(L, argc, L->nil))) return NULL;
+    for (i = 0; i < argc; i++)
+        vec->value.vector.items[i] = argv[i];
+    return vec;
+}
+
+/* vector-ref[2] :: (vector-ref vec int) -> a */
+static lith_value *builtin__vector_ref(lith_st *L, size_t argc, lith_value **argv)
+{
+    lith_vector *v;
+    size_t i;
+    if (!lith_expect_type(L, "vector-ref", 1, LITH_TYPE_VECTOR, argv[0])) return NULL;
+    v = &argv[0]->value.vector;
+    if (!vector_index(L, "vector-ref", 2, argv[1], (long) v->len - 1, &i)) return NULL;
+    return v->items[i];
+}
+
+/* vector-set![3] :: (vector-set! vec int a) -> ()
+ * and the item at the index is replaced by a */
+static lith_value *builtin__vector_set(lith_st *L, size_t argc, lith_value **argv)
+{
+    lith_vector *v;
+    size_t i;
+    if (!lith_expect_type(L, "vector-set!", 1, LITH_TYPE_VECTOR, argv[0])) return NULL;
+    v = &argv[0]->value.vector;
+    if (!vector_index(L, "vector-set!", 2, argv[1], (long) v->len - 1, &i)) return NULL;
+    v->items[i] = argv[2];
+    return L->nil;
+}
+
+/* vector-length[1] :: (vector-length vec) -> int */
+static lith_value *builtin__vector_length(lith_st *L, size_t argc, lith_value **argv)
+{
+    if (!lith_expect_type(L, "vector-length", 1, LITH_TYPE_VECTOR, argv[0])) return NULL;
+    return lith_make_integer(L, (long) argv[0]->value.vector.len);
+}
+
+/* vector-fill![2] :: (vector-fill! vec a) -> ()
+ * and every item is replaced by a */
+static lith_value *builtin__vector_fill(lith_st *L, size_t argc, lith_value **argv)
+{
+    lith_vector *v;
+    size_t i;
+    if (!lith_expect_type(L, "vector-fill!", 1, LITH_TYPE_VECTOR, argv[0])) return NULL;
+    v = &argv[0]->value.vector;
+    for (i = 0; i < v->len; i++)
+        v->items[i] = argv[1];
+    return L->nil;
+}
+
+static lith_value *slice_vector(lith_st *L, lith_vector *v, size_t from, size_t to)
+{
+    lith_value *vec;
+    if (!(vec = lith_make_vector(L, to - from, L->nil))) return NULL;
+    if (to > from)
+        memcpy(vec->value.vector.items, v->items + from, (to - from) * sizeof(*v->items));
+    return vec;
+}
+
+/* vector-copy[1] :: (vector-copy vec) -> vec
+ * a new vector with the same items */
+static lith_value *builtin__vector_copy(lith_st *L, size_t argc, lith_value **argv)
+{
+    if (!lith_expect_type(L, "vector-copy", 1, LITH_TYPE_VECTOR, argv[0])) return NULL;
+    return slice_vector(L, &argv[0]->value.vector, 0, argv[0]->value.vector.len);
+}
+
+/* vector-slice[3] :: (vector-slice vec int int) -> vec
+ * a new vector with the items from the first index up to the second */
+static lith_value *builtin__vector_slice(lith_st *L, size_t argc, lith_value **argv)
+{
+    lith_vector *v;
+    size_t from, to;
+    if (!lith_expect_type(L, "vector-slice", 1, LITH_TYPE_VECTOR, argv[0])) return NULL;
+    v = &argv[0]->value.vector;
+    if (!vector_index(L, "vector-slice", 3, argv[2], (long) v->len, &to)
+    || !vector_index(L, "vector-slice", 2, argv[1], (long) to, &from)) return NULL;
+    return slice_vector(L, v, from, to);
+}
+
+/* list->vector[1] :: (list->vector (a...)) -> vec */
+static lith_value *builtin__list_to_vector(lith_st *L, size_t argc, lith_value **argv)
+{
+    lith_value *vec, *p;
+    size_t i;
+    if (!LITH_IS_NIL(argv[0])
+    && !lith_expect_type(L, "list->vector", 1, LITH_TYPE_PAIR, argv[0])) return NULL;
+    if (!is_proper_list(argv[0])) {
+        lith_simple_error(L, LITH_ERR_TYPE, "expecting a proper list");
+        L->error_state.name = "list->vector";
+        L->error_state.expr = argv[0];
+        return NULL;
+    }
+    if (!(vec = lith_make_vector(L, list_length(argv[0]), L->nil))) return NULL;
+    for (i = 0, p = argv[0]; !LITH_IS_NIL(p); p = LITH_CDR(p))
+        vec->value.vector.items[i++] = LITH_CAR(p);
+    return vec;
+}
+
+/* vector->list[1] :: (vector->list vec) -> (a...) */
+static lith_value *builtin__vector_to_list(lith_st *L, size_t argc, lith_value **argv)
+{
+    lith_value *list;
+    lith_vector *v;
+    size_t i;
+    if (!lith_expect_type(L, "vector->list", 1, LITH_TYPE_VECTOR, argv[0])) return NULL;
+    v = &argv[0]->value.vector;
+    for (list = L->nil, i = v->len; i > 0; i--)
+        if (!(list = LITH_CONS(L, v->items[i - 1], list))) return NULL;
+    return list;
+}
+
+/* the arrays of numbers, f64, or of integers, i64: the items are
+ * unboxed and together, and the builtins on them are loops with nothing
+ * called and nothing checked inside; where the compiler targets SSE2,
+ * the kernels of the arithmetic and of the sums take two items at a
+ * time, the others are scalar; the integers wrap around as in +
+ */
+
+static int expect_array(lith_st *L, char *name, size_t narg, lith_value *v)
+{
+    return LITH_IS(v, LITH_TYPE_I64ARRAY)
+        || lith_expect_type(L, name, narg, LITH_TYPE_F64ARRAY, v);
+}
+
+/* the second array like the first one, of the same type and length */
+static int expect_same_arrays(lith_st *L, char *name, lith_value *a, lith_value *b)
+{
+    if (!expect_array(L, name, 1, a)
+    || !lith_expect_type(L, name, 2, LITH_TYPE_OF(a), b)) return 0;
+    if (a->value.array.len != b->value.array.len) {
+        lith_simple_error(L, LITH_ERR_CUSTOM, "the arrays are not of the same length");
+        L->error_state.name = name;
+        L->error_state.expr = b;
+        return 0;
+    }
+    return 1;
+}
+
+static lith_value *make_array(lith_st *L, lith_valtype type, size_t len)
+{
+    lith_value *val;
+    void *items;
+    size_t size;
+    size = (type == LITH_TYPE_F64ARRAY) ? sizeof(double) : sizeof(long);
+    items = NULL;
+    if (len) {
+        if (len > ((size_t) -1) / size) {
+            L->error = LITH_ERR_NOMEM;
+            return NULL;
+        }
+        if (!(items = emalloc(L, len * size))) return NULL;
+    }
+    val = lith_new_value(L);
+    if (!val) {
+        free(items);
+        return NULL;
+    }
+    val->type = type;
+    val->value.array.len = len;
+    if (type == LITH_TYPE_F64ARRAY)
+        val->value.array.items.f64 = items;
+    else
+        val->value.array.items.i64 = items;
+    return val;
+}
+
+static double numeric_value(lith_value *v)
+{
+    return LITH_IS(v, LITH_TYPE_NUMBER) ? LITH_NUMBER(v) : (double) LITH_INTEGER(v);
+}
+
+/* the item of the array at the index as a value */
+static lith_value *array_item(lith_st *L, lith_value *a, size_t i)
+{
+    if (LITH_IS(a, LITH_TYPE_F64ARRAY))
+        return lith_make_number(L, a->value.array.items.f64[i]);
+    return lith_make_integer(L, a->value.array.items.i64[i]);
+}
+
+/* the item of an array put in at the index, when it is of its type */
+static int put_array_item(lith_st *L, char *name, size_t narg,
+                          lith_value *a, size_t i, lith_value *v)
+{
+    if (LITH_IS(a, LITH_TYPE_F64ARRAY)) {
+        if (!expect_numeric(L, v)) return 0;
+        a->value.array.items.f64[i] = numeric_value(v);
+    } else {
+        if (!lith_expect_type(L, name, narg, LITH_TYPE_INTEGER, v)) return 0;
+        a->value.array.items.i64[i] = LITH_INTEGER(v);
+    }
+    return 1;
+}
+
+static lith_value *make_filled_array(lith_st *L, char *name, lith_valtype type,
+                                     size_t argc, lith_value **argv)
+{
+    lith_value *a;
+    size_t i;
+    if (!expect_at_most(L, name, 2, argc)) return NULL;
+    if (!lith_expect_type(L, name, 1, LITH_TYPE_INTEGER, argv[0])) return NULL;
+    if (LITH_INTEGER(argv[0]) < 0) {
+        lith_simple_error(L, LITH_ERR_CUSTOM, "the length of an array is not negative");
+        L->error_state.name = name;
+        L->error_state.expr = argv[0];
+        return NULL;
+    }
+    if (!(a = make_array(L, type, (size_t) LITH_INTEGER(argv[0])))) return NULL;
+    if (a->value.array.len == 0) return a;
+    if (!put_array_item(L, name, 2, a, 0, (argc == 2) ? argv[1] : LITH_FIXNUM(0)))
+        return NULL;
+    if (type == LITH_TYPE_F64ARRAY) {
+        double x, *r;
+        r = a->value.array.items.f64;
+        for (x = r[0], i = 1; i < a->value.array.len; i++) r[i] = x;
+    } else {
+        long n, *r;
+        r = a->value.array.items.i64;
+        for (n = r[0], i = 1; i < a->value.array.len; i++) r[i] = n;
+    }
+    return a;
+}
+
+/* make-f64array[1+], make-i64array[1+] ::
+ * (make-f64array int [numeric]) -> f64array
+ * (make-i64array int [int]) -> i64array
+ * of that many items, each the second argument or 0 */
+static lith_value *builtin__make_f64array(lith_st *L, size_t argc, lith_value **argv)
+{
+    return make_filled_array(L, "make-f64array", LITH_TYPE_F64ARRAY, argc, argv);
+}
+
+static lith_value *builtin__make_i64array(lith_st *L, size_t argc, lith_value **argv)
+{
+    return make_filled_array(L, "make-i64array", LITH_TYPE_I64ARRAY, argc, argv);
+}
+
+static lith_value *list_to_array(lith_st *L, char *name, lith_valtype type, lith_value *list)
+{
+    lith_value *a;
+    size_t i;
+    if (!LITH_IS_NIL(list) && !lith_expect_type(L, name, 1, LITH_TYPE_PAIR, list)) return NULL;
+    if (!is_proper_list(list)) {
+        lith_simple_error(L, LITH_ERR_TYPE, "expecting a proper list");
+        L->error_state.name = name;
+        L->error_state.expr = list;
+        return NULL;
+    }
+    if (!(a = make_array(L, type, list_length(list)))) return NULL;
+    for (i = 0; !LITH_IS_NIL(list); i++, list = LITH_CDR(list))
+        if (!put_array_item(L, name, 1, a, i, LITH_CAR(list))) return NULL;
+    return a;
+}
+
+/* list->f64array[1], list->i64array[1] ::
+ * (list->f64array (numeric...)) -> f64array
+ * (list->i64array (int...)) -> i64array */
+static lith_value *builtin__list_to_f64array(lith_st *L, size_t argc, lith_value **argv)
+{
+    return list_to_array(L, "list->f64array", LITH_TYPE_F64ARRAY, argv[0]);
+}
+
+static lith_value *builtin__list_to_i64array(lith_st *L, size_t argc, lith_value **argv)
+{
+    return list_to_array(L, "list->i64array", LITH_TYPE_I64ARRAY, argv[0]);
+}
+
+/* array->list[1] :: (array->list arr) -> (numeric...) */
+static lith_value *builtin__array_to_list(lith_st *L, size_t argc, lith_value **argv)
+{
+    lith_value *list, *v;
+    size_t i;
+    if (!expect_array(L, "array->list", 1, argv[0])) return NULL;
+    for (list = L->nil, i = argv[0]->value.array.len; i > 0; i--) {
+        if (!(v = array_item(L, argv[0], i - 1))
+        || !(list = LITH_CONS(L, v, list))) return NULL;
+    }
+    return list;
+}
+
+/* array-length[1] :: (array-length arr) -> int */
+static lith_value *builtin__array_length(lith_st *L, size_t argc, lith_value **argv)
+{
+    if (!expect_array(L, "array-length", 1, argv[0])) return NULL;
+    return lith_make_integer(L, (long) argv[0]->value.array.len);
+}
+
+/* array-ref[2] :: (array-ref arr int) -> numeric */
+static lith_value *builtin__array_ref(lith_st *L, size_t argc, lith_value **argv)
+{
+    size_t i;
+    if (!expect_array(L, "array-ref", 1, argv[0])
+    || !vector_index(L, "array-ref", 2, argv[1],
+            (long) argv[0]->value.array.len - 1, &i)) return NULL;
+    return array_item(L, argv[0], i);
+}
+
+/* array-set![3] :: (array-set! arr int numeric) -> ()
+ * and the item at the index is replaced */
+static lith_value *builtin__array_set(lith_st *L, size_t argc, lith_value **argv)
+{
+    size_t i;
+    if (!expect_array(L, "array-set!", 1, argv[0])
+    || !vector_index(L, "array-set!", 2, argv[1],
+            (long) argv[0]->value.array.len - 1, &i)
+    || !put_array_item(L, "array-set!", 3, argv[0], i, argv[2])) return NULL;
+    return L->nil;
+}
+
+/* the kernels: z = x + y, x * y, or x * k with y NULL;
+ * the vector loops leave the odd item to the scalar ones */
+static void f64_arith(double *z, double *x, double *y, double k, size_t n, int op)
+{
+    size_t i;
+    i = 0;
+#ifdef __SSE2__
+    if (!y) {
+        __m128d K;
+        K = _mm_set1_pd(k);
+        for (; i + 2 <= n; i += 2)
+            _mm_storeu_pd(z + i, _mm_mul_pd(_mm_loadu_pd(x + i), K));
+    } else if (op == ARITH_ADD) {
+        for (; i + 2 <= n; i += 2)
+            _mm_storeu_pd(z + i, _mm_add_pd(_mm_loadu_pd(x + i), _mm_loadu_pd(y + i)));
+    } else {
+        for (; i + 2 <= n; i += 2)
+            _mm_storeu_pd(z + i, _mm_mul_pd(_mm_loadu_pd(x + i), _mm_loadu_pd(y + i)));
+    }
+#endif
+    if (!y)
+        for (; i < n; i++) z[i] = x[i] * k;
+    else if (op == ARITH_ADD)
+        for (; i < n; i++) z[i] = x[i] + y[i];
+    else
+        for (; i < n; i++) z[i] = x[i] * y[i];
+}
+
+static void i64_arith(unsigned long *z, unsigned long *x, unsigned long *y,
+                      unsigned long k, size_t n, int op)
+{
+    size_t i;
+    i = 0;
+#ifdef __SSE2__
+    /* there is no multiplication of 64 bit integers in SSE2 */
+    if (y && (op == ARITH_ADD) && (sizeof(long) == 8))
+        for (; i + 2 <= n; i += 2)
+            _mm_storeu_si128((__m128i *) (z + i), _mm_add_epi64(
+                _mm_loadu_si128((__m128i *) (x + i)), _mm_loadu_si128((__m128i *) (y + i))));
+#endif
+    if (!y)
+        for (; i < n; i++) z[i] = x[i] * k;
+    else if (op == ARITH_ADD)
+        for (; i < n; i++) z[i] = x[i] + y[i];
+    else
+        for (; i < n; i++) z[i] = x[i] * y[i];
+}
+
+/* each item of the first array with the one of the second, or with
+ * the number given instead of the second array when scaling */
+static lith_value *array_arith(lith_st *L, char *name, lith_value **argv, int op, int scale)
+{
+    lith_value *a, *r;
+    size_t n;
+    a = argv[0];
+    if (scale) {
+        if (!expect_array(L, name, 1, a)) return NULL;
+        if (LITH_IS(a, LITH_TYPE_F64ARRAY) ? !expect_numeric(L, argv[1])
+        : !lith_expect_type(L, name, 2, LITH_TYPE_INTEGER, argv[1])) return NULL;
+    } else if (!expect_same_arrays(L, name, a, argv[1])) {
+        return NULL;
+    }
+    n = a->value.array.len;
+    if (!(r = make_array(L, LITH_TYPE_OF(a), n))) return NULL;
+    if (LITH_IS(a, LITH_TYPE_F64ARRAY))
+        f64_arith(r->value.array.items.f64, a->value.array.items.f64,
+            scale ? NULL : argv[1]->value.array.items.f64,
+            scale ? numeric_value(argv[1]) : 0, n, op);
+    else
+        i64_arith((unsigned long *) r->value.array.items.i64,
+            (unsigned long *) a->value.array.items.i64,
+            scale ? NULL : (unsigned long *) argv[1]->value.array.items.i64,
+            scale ? (unsigned long) LITH_INTEGER(argv[1]) : 0, n, op);
+    return r;
+}
+
+/* array-add[2], array-mul[2] :: (array-add arr arr) -> arr
+ * item by item */
+static lith_value *builtin__array_add(lith_st *L, size_t argc, lith_value **argv)
+{
+    return array_arith(L, "array-add", argv, ARITH_ADD, 0);
+}
+
+static lith_value *builtin__array_mul(lith_st *L, size_t argc, lith_value **argv)
+{
+    return array_arith(L, "array-mul", argv, ARITH_MULTIPLY, 0);
+}
+
+/* array-scale[2] :: (array-scale arr numeric) -> arr
+ * each item multiplied by the number, an integer for an i64array */
+static lith_value *builtin__array_scale(lith_st *L, size_t argc, lith_value **argv)
+{
+    return array_arith(L, "array-scale", argv, ARITH_MULTIPLY, 1);
+}
+
+/* the sum of the items, or of the products of the items of two arrays:
+ * the numbers are added up in four sums, of every fourth item, so that
+ * the additions of the consecutive items do not wait for each other;
+ * with SSE2 these are the lanes of two registers, which add up the
+ * same items in the same order, so the sum is the same
+ */
+static double f64_sum(double *x, double *y, size_t n)
+{
+    double s[4];
+    size_t i;
+    i = 0;
+    s[0] = s[1] = s[2] = s[3] = 0;
+#ifdef __SSE2__
+    {
+        __m128d s01, s23;
+        s01 = s23 = _mm_setzero_pd();
+        if (!y) {
+            for (; i + 4 <= n; i += 4) {
+                s01 = _mm_add_pd(s01, _mm_loadu_pd(x + i));
+                s23 = _mm_add_pd(s23, _mm_loadu_pd(x + i + 2));
+            }
+        } else {
+            for (; i + 4 <= n; i += 4) {
+                s01 = _mm_add_pd(s01, _mm_mul_pd(_mm_loadu_pd(x + i), _mm_loadu_pd(y + i)));
+                s23 = _mm_add_pd(s23, _mm_mul_pd(_mm_loadu_pd(x + i + 2), _mm_loadu_pd(y + i + 2)));
+            }
+        }
+        _mm_storeu_pd(s, s01);
+        _mm_storeu_pd(s + 2, s23);
+    }
+#endif
+    if (!y) {
+        for (; i + 4 <= n; i += 4) {
+            s[0] += x[i]; s[1] += x[i + 1]; s[2] += x[i + 2]; s[3] += x[i + 3];
+        }
+        for (; i < n; i++) s[0] += x[i];
+    } else {
+        for (; i + 4 <= n; i += 4) {
+            s[0] += x[i] * y[i]; s[1] += x[i + 1] * y[i + 1];
+            s[2] += x[i + 2] * y[i + 2]; s[3] += x[i + 3] * y[i + 3];
+        }
+        for (; i < n; i++) s[0] += x[i] * y[i];
+    }
+    return (s[0] + s[1]) + (s[2] + s[3]);
+}
+
+static unsigned long i64_sum(unsigned long *x, unsigned long *y, size_t n)
+{
+    unsigned long s;
+    size_t i;
+    i = 0;
+    s = 0;
+#ifdef __SSE2__
+    if (!y && (sizeof(long) == 8)) {
+        unsigned long t[2];
+        __m128i s01;
+        s01 = _mm_setzero_si128();
+        for (; i + 2 <= n; i += 2)
+            s01 = _mm_add_epi64(s01, _mm_loadu_si128((__m128i *) (x + i)));
+        _mm_storeu_si128((__m128i *) t, s01);
+        s = t[0] + t[1];
+    }
+#endif
+    if (!y)
+        for (; i < n; i++) s += x[i];
+    else
+        for (; i < n; i++) s += x[i] * y[i];
+    return s;
+}
+
+static lith_value *array_sum(lith_st *L, lith_value *a, lith_value *b)
+{
+    size_t n;
+    n = a->value.array.len;
+    if (LITH_IS(a, LITH_TYPE_F64ARRAY))
+        return lith_make_number(L, f64_sum(a->value.array.items.f64,
+            b ? b->value.array.items.f64 : NULL, n));
+    return lith_make_integer(L, (long) i64_sum((unsigned long *) a->value.array.items.i64,
+        b ? (unsigned long *) b->value.array.items.i64 : NULL, n));
+}
+
+/* array-sum[1] :: (array-sum arr) -> numeric */
+static lith_value *builtin__array_sum(lith_st *L, size_t argc, lith_value **argv)
+{
+    if (!expect_array(L, "array-sum", 1, argv[0])) return NULL;
+    return array_sum(L, argv[0], NULL);
+}
+
+/* array-dot[2] :: (array-dot arr arr) -> numeric */
+static lith_value *builtin__array_dot(lith_st *L, size_t argc, lith_value **argv)
+{
+    if (!expect_same_arrays(L, "array-dot", argv[0], argv[1])) return NULL;
+    return array_sum(L, argv[0], argv[1]);
+}
+
+static lith_value *array_extreme(lith_st *L, char *name, lith_value *a, int max)
+{
+    size_t i, n;
+    if (!expect_array(L, name, 1, a)) return NULL;
+    n = a->value.array.len;
+    if (n == 0) {
+        lith_simple_error(L, LITH_ERR_CUSTOM, "the array is empty");
+        L->error_state.name = name;
+        L->error_state.expr = a;
+        return NULL;
+    }
+    if (LITH_IS(a, LITH_TYPE_F64ARRAY)) {
+        double *x, m;
+        x = a->value.array.items.f64;
+        m = x[0];
+        if (max)
+            for (i = 1; i < n; i++) m = (x[i] > m) ? x[i] : m;
+        else
+            for (i = 1; i < n; i++) m = (x[i] < m) ? x[i] : m;
+        return lith_make_number(L, m);
+    } else {
+        long *x, m;
+        x = a->value.array.items.i64;
+        m = x[0];
+        if (max)
+            for (i = 1; i < n; i++) m = (x[i] > m) ? x[i] : m;
+        else
+            for (i = 1; i < n; i++) m = (x[i] < m) ? x[i] : m;
+        return lith_make_integer(L, m);
+    }
+}
+
+/* array-min[1], array-max[1] :: (array-min arr) -> numeric */
+static lith_value *builtin__array_min(lith_st *L, size_t argc, lith_value **argv)
+{
+    return array_extreme(L, "array-min", argv[0], 0);
+}
+
+static lith_value *builtin__array_max(lith_st *L, size_t argc, lith_value **argv)
+{
+    return array_extreme(L, "array-max", argv[0], 1);
+}
+
+/* array-prefix-sum[1] :: (array-prefix-sum arr) -> arr
+ * each item the sum of the items up to it */
+static lith_value *builtin__array_prefix_sum(lith_st *L, size_t argc, lith_value **argv)
+{
+    lith_value *a, *r;
+    size_t i, n;
+    a = argv[0];
+    if (!expect_array(L, "array-prefix-sum", 1, a)) return NULL;
+    n = a->value.array.len;
+    if (!(r = make_array(L, LITH_TYPE_OF(a), n))) return NULL;
+    if (LITH_IS(a, LITH_TYPE_F64ARRAY)) {
+        double *x, *z, s;
+        x = a->value.array.items.f64;
+        z = r->value.array.items.f64;
+        for (s = 0, i = 0; i < n; i++) z[i] = s += x[i];
+    } else {
+        unsigned long *x, *z, s;
+        x = (unsigned long *) a->value.array.items.i64;
+        z = (unsigned long *) r->value.array.items.i64;
+        for (s = 0, i = 0; i < n; i++) z[i] = s += x[i];
+    }
+    return r;
+}
+
+/* the mask of the comparisons of the items of an array with the items
+ * of another one, or with a number: an i64array of 1 and 0 */
+static lith_value *array_compare(lith_st *L, char *name, lith_value **argv, int op)
+{
+    lith_value *a, *b, *r;
+    size_t i, n;
+    long *z;
+    a = argv[0];
+    b = argv[1];
+    if (!expect_array(L, name, 1, a)) return NULL;
+    if (LITH_IS(b, LITH_TYPE_F64ARRAY) || LITH_IS(b, LITH_TYPE_I64ARRAY)) {
+        if (!expect_same_arrays(L, name, a, b)) return NULL;
+    } else if (LITH_IS(a, LITH_TYPE_F64ARRAY) ? !expect_numeric(L, b)
+    : !lith_expect_type(L, name, 2, LITH_TYPE_INTEGER, b)) {
+        return NULL;
+    }
+    n = a->value.array.len;
+    if (!(r = make_array(L, LITH_TYPE_I64ARRAY, n))) return NULL;
+    z = r->value.array.items.i64;
+    if (LITH_IS(a, LITH_TYPE_F64ARRAY)) {
+        double *x, *y, k;
+        x = a->value.array.items.f64;
+        if (LITH_IS(b, LITH_TYPE_F64ARRAY)) {
+            y = b->value.array.items.f64;
+            switch (op) {
+            case COMPARE_LT: for (i = 0; i < n; i++) z[i] = x[i] < y[i]; break;
+            case COMPARE_GT: for (i = 0; i < n; i++) z[i] = x[i] > y[i]; break;
+            default: for (i = 0; i < n; i++) z[i] = x[i] == y[i]; break;
+            }
+        } else {
+            k = numeric_value(b);
+            switch (op) {
+            case COMPARE_LT: for (i = 0; i < n; i++) z[i] = x[i] < k; break;
+            case COMPARE_GT: for (i = 0; i < n; i++) z[i] = x[i] > k; break;
+            default: for (i = 0; i < n; i++) z[i] = x[i] == k; break;
+            }
+        }
+    } else {
+        long *x, *y, k;
+        x = a->value.array.items.i64;
+        if (LITH_IS(b, LITH_TYPE_I64ARRAY)) {
+            y = b->value.array.items.i64;
+            switch (op) {
+            case COMPARE_LT: for (i = 0; i < n; i++) z[i] = x[i] < y[i]; break;
+            case COMPARE_GT: for (i = 0; i < n; i++) z[i] = x[i] > y[i]; break;
+            default: for (i = 0; i < n; i++) z[i] = x[i] == y[i]; break;
+            }
+        } else {
+            k = LITH_INTEGER(b);
+            switch (op) {
+            case COMPARE_LT: for (i = 0; i < n; i++) z[i] = x[i] < k; break;
+            case COMPARE_GT: for (i = 0; i < n; i++) z[i] = x[i] > k; break;
+            default: for (i = 0; i < n; i++) z[i] = x[i] == k; break;
+            }
+        }
+    }
+    return r;
+}
+
+/* array-less[2], array-greater[2], array-equal[2] ::
+ * (array-less arr arr) -> i64array
+ * (array-less arr numeric) -> i64array */
+static lith_value *builtin__array_less(lith_st *L, size_t argc, lith_value **argv)
+{
+    return array_compare(L, "array-less", argv, COMPARE_LT);
+}
+
+static lith_value *builtin__array_greater(lith_st *L, size_t argc, lith_value **argv)
+{
+    return array_compare(L, "array-greater", argv, COMPARE_GT);
+}
+
+static lith_value *builtin__array_equal(lith_st *L, size_t argc, lith_value **argv)
+{
+    return array_compare(L, "array-equal", argv, COMPARE_EQ);
+}
+
+/* the hash tables: the keys are hashed by what they are made of, so the
+ * ones equal? to each other are the same key; a key changed while in a
+ * table is lost in it
+ */
+
+#define LITH_TABLE_STEP 16
+#define LITH_HASH_NODES 32
+
+struct lith_table_slot {
+    unsigned long hash;
+    lith_value *key, *val;
+};
+
+/* open addressing: a slot without a key is empty, or deleted when it
+ * still has a value; when the table grows, its entries are moved to
+ * the new slots a few at each operation, and are looked for in the
+ * old ones until they all are
+ */
+struct lith_table {
+    size_t count, used, cap;
+    struct lith_table_slot *slots;
+    size_t oldcap, moved;
+    struct lith_table_slot *old;
+};
+
+static unsigned long mix_hash(unsigned long h)
+{
+    h ^= h >> 16;
+    h *= 0x45D9F3BUL;
+    h ^= h >> 16;
+    return h;
+}
+
+/* 0.0 and -0.0 are equal */
+static unsigned long hash_number(double number)
+{
+    if (number == 0) number = 0;
+    return hash_name((char *) &number, sizeof(number));
+}
+
+/* the first nodes of the structure go into the hash: the equal values
+ * have the same ones; an item of an array counts as a node */
+static unsigned long hash_value(lith_value *v, int *nodes)
+{
+    unsigned long h;
+    size_t i;
+    h = (unsigned long) LITH_TYPE_OF(v);
+    for (;;) {
+        if (--*nodes < 0) return h;
+        switch (LITH_TYPE_OF(v)) {
+        case LITH_TYPE_INTEGER:
+            return mix_hash(h * 31UL + (unsigned long) LITH_INTEGER(v));
+        case LITH_TYPE_NUMBER:
+            return h * 31UL + hash_number(LITH_NUMBER(v));
+        case LITH_TYPE_STRING:
+            return h * 31UL + hash_name(v->value.string.buf, v->value.string.len);
+        case LITH_TYPE_PAIR:
+            h = h * 31UL + hash_value(LITH_CAR(v), nodes);
+            v = LITH_CDR(v);
+            break;
+        case LITH_TYPE_VECTOR:
+            for (i = 0; (i < v->value.vector.len) && (*nodes > 0); i++)
+                h = h * 31UL + hash_value(v->value.vector.items[i], nodes);
+            return mix_hash(h);
+        case LITH_TYPE_F64ARRAY:
+            h = h * 31UL + v->value.array.len;
+            for (i = 0; (i < v->value.array.len) && ((*nodes)-- > 0); i++)
+                h = h * 31UL + hash_number(v->value.array.items.f64[i]);
+            return mix_hash(h);
+        case LITH_TYPE_I64ARRAY:
+            h = h * 31UL + v->value.array.len;
+            for (i = 0; (i < v->value.array.len) && ((*nodes)-- > 0); i++)
+                h = mix_hash(h * 31UL + (unsigned long) v->value.array.items.i64[i]);
+            return mix_hash(h);
+        case LITH_TYPE_PMAP:
+        case LITH_TYPE_PVECTOR:
+            return mix_hash(h * 31UL + v->value.tree.len);
+        default:
+            return mix_hash(h * 31UL + (unsigned long) (LITH_WORD(v) >> 3));
+        }
+    }
+}
+
+static unsigned long hash_key(lith_value *key)
+{
+    int nodes;
+    nodes = LITH_HASH_NODES;
+    return hash_value(key, &nodes);
+}
+
+static struct lith_table_slot *find_in_slots(lith_st *L, struct lith_table_slot *slots,
+                                             size_t cap, unsigned long hash, lith_value *key)
+{
+    size_t i;
+    if (!slots) return NULL;
+    for (i = hash & (cap - 1); slots[i].key || slots[i].val; i = (i + 1) & (cap - 1)) {
+        if (!slots[i].key || (slots[i].hash != hash)) continue;
+        if ((slots[i].key == key) || same_key(L, slots[i].key, key)) return &slots[i];
+        if (LITH_IS_ERR(L)) return NULL;
+    }
+    return NULL;
+}
+
+/* the first free slot for the hash, which is known not to be there */
+static struct lith_table_slot *free_slot(struct lith_table *T, unsigned long hash)
+{
+    size_t i;
+    for (i = hash & (T->cap - 1); T->slots[i].key; i = (i + 1) & (T->cap - 1))
+        ;
+    if (!T->slots[i].val) T->used++;
+    return &T->slots[i];
+}
+
+static void move_entries(struct lith_table *T, size_t n)
+{
+    struct lith_table_slot *s;
+    for (; T->old && n; n--) {
+        s = &T->old[T->moved++];
+        if (s->key) {
+            *free_slot(T, s->hash) = *s;
+            s->key = NULL;
+        }
+        if (T->moved == T->oldcap) {
+            free(T->old);
+            T->old = NULL;
+        }
+    }
+}
+
+/* the slot of the key, NULL when it is not there or on an error */
+static struct lith_table_slot *find_entry(lith_st *L, struct lith_table *T, lith_value *key)
+{
+    struct lith_table_slot *s;
+    unsigned long hash;
+    move_entries(T, LITH_TABLE_STEP);
+    hash = hash_key(key);
+    if ((s = find_in_slots(L, T->slots, T->cap, hash, key)) || LITH_IS_ERR(L)) return s;
+    return find_in_slots(L, T->old, T->oldcap, hash, key);
+}
+
+/* new slots for the entries, twice as many unless most of the used ones
+ * are deleted: the old ones still being moved are moved all first */
+static int grow_table(lith_st *L, struct lith_table *T)
+{
+    struct lith_table_slot *slots;
+    size_t cap;
+    move_entries(T, T->oldcap);
+    cap = !T->cap ? 8 : ((2 * T->count >= T->cap) ? (2 * T->cap) : T->cap);
+    if (!(slots = calloc(cap, sizeof(*slots)))) {
+        L->error = LITH_ERR_NOMEM;
+        return 0;
+    }
+    if (T->count) {
+        T->old = T->slots;
+        T->oldcap = T->cap;
+        T->moved = 0;
+    } else {
+        free(T->slots);
+    }
+    T->slots = slots;
+    T->cap = cap;
+    T->used = 0;
+    return 1;
+}
+
+static int table_put(lith_st *L, struct lith_table *T, lith_value *key, lith_value *val)
+{
+    struct lith_table_slot *s;
+    unsigned long hash;
+    if ((s = find_entry(L, T, key))) {
+        s->val = val;
+        return 1;
+    }
+    if (LITH_IS_ERR(L)) return 0;
+    if ((4 * (T->used + 1) > 3 * T->cap) && !grow_table(L, T)) return 0;
+    hash = hash_key(key);
+    s = free_slot(T, hash);
+    s->hash = hash;
+    s->key = key;
+    s->val = val;
+    T->count++;
+    return 1;
+}
+
+static lith_value *make_table(lith_st *L)
+{
+    lith_value *val;
+    struct lith_table *T;
+    if (!(T = emalloc(L, sizeof(*T)))) return NULL;
+    T->count = T->used = T->cap = T->oldcap = T->moved = 0;
+    T->slots = T->old = NULL;
+    if (!(val = lith_new_value(L))) {
+        free(T);
+        return NULL;
+    }
+    val->type = LITH_TYPE_TABLE;
+    val->value.table = T;
+    return val;
+}
+
+/* make-table[0] :: (make-table) -> table */
+static lith_value *builtin__make_table(lith_st *L, size_t argc, lith_value **argv)
+{
+    return make_table(L);
+}
+
+/* table-get[2+] :: (table-get table key [a]) -> a
+ * the value of the key, or the third argument, or () */
+static lith_value *builtin__table_get(lith_st *L, size_t argc, lith_value **argv)
+{
+    struct lith_table_slot *s;
+    if (!expect_at_most(L, "table-get", 3, argc)
+    || !lith_expect_type(L, "table-get", 1, LITH_TYPE_TABLE, argv[0])) return NULL;
+    if ((s = find_entry(L, argv[0]->value.table, argv[1]))) return s->val;
+    if (LITH_IS_ERR(L)) return NULL;
+    return (argc == 3) ? argv[2] : L->nil;
+}
+
+/* table-put![3] :: (table-put! table key a) -> ()
+ * and the key has the value a */
+static lith_value *builtin__table_put(lith_st *L, size_t argc, lith_value **argv)
+{
+    if (!lith_expect_type(L, "table-put!", 1, LITH_TYPE_TABLE, argv[0])
+    || !table_put(L, argv[0]->value.table, argv[1], argv[2])) return NULL;
+    return L->nil;
+}
+
+/* table-delete![2] :: (table-delete! table key) -> bool
+ * whether the key was there, and it is not anymore */
+static lith_value *builtin__table_delete(lith_st *L, size_t argc, lith_value **argv)
+{
+    struct lith_table_slot *s;
+    if (!lith_expect_type(L, "table-delete!", 1, LITH_TYPE_TABLE, argv[0])) return NULL;
+    if (!(s = find_entry(L, argv[0]->value.table, argv[1])))
+        return LITH_IS_ERR(L) ? NULL : LITH_FALSE;
+    s->key = NULL;
+    s->val = LITH_TRUE;
+    argv[0]->value.table->count--;
+    return LITH_TRUE;
+}
+
+/* table-contains?[2] :: (table-contains? table key) -> bool */
+static lith_value *builtin__table_contains(lith_st *L, size_t argc, lith_value **argv)
+{
+    struct lith_table_slot *s;
+    if (!lith_expect_type(L, "table-contains?", 1, LITH_TYPE_TABLE, argv[0])) return NULL;
+    s = find_entry(L, argv[0]->value.table, argv[1]);
+    return LITH_IS_ERR(L) ? NULL : LITH_IN_BOOL(s);
+}
+
+/* table-size[1] :: (table-size table) -> int */
+static lith_value *builtin__table_size(lith_st *L, size_t argc, lith_value **argv)
+{
+    if (!lith_expect_type(L, "table-size", 1, LITH_TYPE_TABLE, argv[0])) return NULL;
+    return lith_make_integer(L, (long) argv[0]->value.table->count);
+}
+
+/* the keys of the table, or its entries as (key . value),
+ * in the new slots and in the old ones */
+static lith_value *table_list(lith_st *L, struct lith_table *T, int entries)
+{
+    struct lith_table_slot *s, *end;
+    lith_value *list, *item;
+    int old;
+    list = L->nil;
+    for (old = 0; old < 2; old++) {
+        s = old ? T->old : T->slots;
+        end = s ? (s + (old ? T->oldcap : T->cap)) : s;
+        for (; s < end; s++) {
+            if (!s->key) continue;
+            item = entries ? LITH_CONS(L, s->key, s->val) : s->key;
+            if (!item || !(list = LITH_CONS(L, item, list))) return NULL;
+        }
+    }
+    return list;
+}
+
+/* table-keys[1] :: (table-keys table) -> (key...) */
+static lith_value *builtin__table_keys(lith_st *L, size_t argc, lith_value **argv)
+{
+    if (!lith_expect_type(L, "table-keys", 1, LITH_TYPE_TABLE, argv[0])) return NULL;
+    return table_list(L, argv[0]->value.table, 0);
+}
+
+/* table-for-each[2] :: (table-for-each (key a -> b) table) -> ()
+ * called with each entry there was when it started */
+static lith_value *builtin__table_for_each(lith_st *L, size_t argc, lith_value **argv)
+{
+    lith_value *entries, *f;
+    size_t sp;
+    f = argv[0];
+    if (!lith_expect_type(L, "table-for-each", 2, LITH_TYPE_TABLE, argv[1])) return NULL;
+    if (!(entries = table_list(L, argv[1]->value.table, 1))) return NULL;
+    sp = L->gc.sp;
+    if (!push_root(L, f) || !push_root(L, entries)) {
+        L->gc.sp = sp;
+        return NULL;
+    }
+    for (; !LITH_IS_NIL(entries); entries = LITH_CDR(entries)) {
+        L->gc.stack[sp + 1] = entries;
+        if (!call_stage(L, f, 2, LITH_CAR(LITH_CAR(entries)), LITH_CDR(LITH_CAR(entries)))) {
+            L->gc.sp = sp;
+            return NULL;
+        }
+    }
+    L->gc.sp = sp;
+    return L->nil;
+}
+
+/* error[1] :: (error str) -> _|_ */
+static lith_value *builtin__error(lith_st *L, size_t argc, lith_value **argv)
+{
+    lith_value *arg;
+    arg = argv[0];
+    if (!lith_expect_type(L, "error", 1, LITH_TYPE_STRING, arg)) return NULL;
+    L->error = LITH_ERR_CUSTOM;
+    L->error_state.msg = arg->value.string.buf;
+    return NULL;
+}
+
+/* load[1] :: (load str) -> ()
+ * the contents of the file given by
+ * the string containing the path of that file is executed
+ */
+
+static lith_value *builtin__load(lith_st *L, size_t argc, lith_value **argv)
+{
+    lith_value *filename;
+    filename = argv[0];
+    if (!lith_expect_type(L, "load", 1, LITH_TYPE_STRING, filename)) return NULL;
+    lith_run_file(L, L->global, filename->value.string.buf);
+    if (LITH_IS_ERR(L))
+        return NULL;
+    else
+        return L->nil;
+}
+
+/* some more utilities */
+
+static char *slurp(lith_st *L, char *filename)
+{
+    FILE *file;
+    char *buffer;
+    long length;
+    
+    file = fopen(filename, "r");
+    if (!file) {
+        lith_simple_error(L, LITH_ERR_CUSTOM, "could not open the file to be read");
+        return NULL;
+    }
+    
+    fseek(file, 0, SEEK_END);
+    length = ftell(file);
+    fseek(file, 0, SEEK_SET);
+    
+    buffer = emalloc(L, length + 1);
+    if (!buffer) return NULL;
+    
+    fread(buffer, 1, length, file);
+    buffer[length] = '\0';
+    fclose(file);
+    
+    return buffer;
+}
+
+/* the heap:
+ * pages are carved out of chunks allocated in bulk,
+ * each page holds cells of one size class from one pool,
+ * free cells of a pool are kept in a free list
+ */
+
+#define LITH_PAGE_SIZE 16384
+#define LITH_PAGES_PER_CHUNK 16
+#define LITH_MIN_CELL 16
+#define LITH_WORD_BITS (8 * sizeof(unsigned long))
+#define LITH_MARK_WORDS \
+    ((LITH_PAGE_SIZE / LITH_MIN_CELL + LITH_WORD_BITS - 1) / LITH_WORD_BITS)
+
+static size_t cell_sizes[LITH_NCLASSES] = {
+    16, 24, 32, 48, 64, 96, 128, 192, 256
+};
+
+/* kinds of heap cells which are not values of lith */
+#define LITH__FREE ((lith_valtype) LITH_NTYPES)
+#define LITH__FRAME ((lith_valtype) (LITH_NTYPES + 1))
+/* not a heap cell: the type of the local references */
+#define LITH__LOCAL ((lith_valtype) (LITH_NTYPES + 2))
+#define LITH__NAMESPACE ((lith_valtype) (LITH_NTYPES + 3))
+#define LITH__CODE ((lith_valtype) (LITH_NTYPES + 4))
+#define LITH__LAMBDA ((lith_valtype) (LITH_NTYPES + 5))
+#define LITH__NODE ((lith_valtype) (LITH_NTYPES + 6))
+
+/* the environment of a call of a closure:
+ * the slots hold the values of the names of the closure in order,
+ * the names defined at run time which are not among these are extras
+ */
+struct lith_frame {
+    lith_valtype type;
+    size_t nslots;
+    lith_env *parent;
+    lith_value *names, *extras;
+    lith_value **slots;
+    lith_value *inline_slots[1];
+};
+
+#define FRAME(V) ((struct lith_frame *) (V))
+#define IS_FRAME(V) ((LITH_TAG(V) == LITH_TAG_HEAP) && ((V)->type == LITH__FRAME))
+
+/* an environment made by lith_new_env, like the global one:
+ * the bindings are pairs of the name and the value, kept in a hash table
+ * by the address of the symbol, a binding stays the same pair for good
+ */
+struct lith_namespace {
+    lith_valtype type;
+    lith_env *parent;
+    lith_value **cells;
+    size_t count, cap;
+};
+
+#define NAMESPACE(V) ((struct lith_namespace *) (V))
+
+/* the bytecode of the body of a closure, with the constants it uses,
+ * and for each constant naming a global the binding found for it
+ */
+struct lith_code {
+    lith_valtype type;
+    unsigned int *insns;
+    lith_value **consts;
+    size_t ninsns, cap, nconsts, constcap, maxstack;
+    struct lith_global_cache {
+        lith_value **cell;
+        unsigned long bindings;
+    } *caches;
+};
+
+#define CODE(v) ((struct lith_code *) (v))
+
+/* a lambda expression inside a closure, made ready once:
+ * the closures it makes share the names of the slots of their frames,
+ * the analyzed body and its bytecode
+ */
+struct lith_lambda {
+    lith_valtype type;
+    lith_value *params, *names, *body, *code;
+    size_t nslots, expect;
+    int exact;
+};
+
+#define LAMBDA(v) ((struct lith_lambda *) (v))
+#define IS_LAMBDA(v) ((LITH_TAG(v) == LITH_TAG_HEAP) && ((v)->type == LITH__LAMBDA))
+
+struct lith_page {
+    struct lith_page *next;
+    struct lith_pool *pool;
+    size_t size, ncells;
+    char *cells;
+    unsigned long marks[LITH_MARK_WORDS];
+};
+
+/* the link is after the type, so that the type of freed values is kept */
+struct lith_free_cell {
+    lith_valtype type;
+    struct lith_free_cell *next;
+};
+
+#define PAGE_OF(p) \
+    ((struct lith_page *) ((size_t) (p) & ~((size_t) LITH_PAGE_SIZE - 1)))
+
+#define PAIR_CELL(p) ((struct lith_pair *) (LITH_WORD(p) - LITH_TAG_PAIR))
+
+static void init_pool(struct lith_pool *P, size_t size, int raw)
+{
+    P->size = size;
+    P->raw = raw;
+    P->free = NULL;
+    P->pages = NULL;
+    P->npages = P->nfree = 0;
+}
+
+static void init_heap(lith_st *L)
+{
+    int raw, i;
+    for (raw = 0; raw < 2; raw++)
+        for (i = 0; i < LITH_NCLASSES; i++)
+            init_pool(&L->gc.pools[raw][i], cell_sizes[i], raw);
+    /* pairs have no header: nothing to finalize, like the raw blocks */
+    init_pool(&L->gc.pairs, sizeof(struct lith_pair), 1);
+    L->gc.free_pages = NULL;
+    L->gc.nfree_pages = 0;
+    L->gc.chunks = NULL;
+    L->gc.nchunks = 0;
+}
+
+static struct lith_pool *pool_for(lith_st *L, size_t size, int raw)
+{
+    int i;
+    for (i = 0; i < LITH_NCLASSES; i++)
+        if (size <= cell_sizes[i])
+            return &L->gc.pools[raw][i];
+    return NULL;
+}
+
+static int new_chunk(lith_st *L)
+{
+    char *chunk, *p;
+    void **chunks;
+    size_t i;
+    struct lith_page *page;
+    chunks = realloc(L->gc.chunks, (L->gc.nchunks + 1) * sizeof(*chunks));
+    if (!chunks) {
+        L->error = LITH_ERR_NOMEM;
+        return 0;
+    }
+    L->gc.chunks = chunks;
+    /* one page more to be able to align the pages */
+    chunk = emalloc(L, (LITH_PAGES_PER_CHUNK + 1) * LITH_PAGE_SIZE);
+    if (!chunk) return 0;
+    L->gc.chunks[L->gc.nchunks++] = chunk;
+    p = (char *) PAGE_OF(chunk + LITH_PAGE_SIZE - 1);
+    for (i = 0; i < LITH_PAGES_PER_CHUNK; i++, p += LITH_PAGE_SIZE) {
+        page = (struct lith_page *) p;
+        page->next = L->gc.free_pages;
+        L->gc.free_pages = page;
+        L->gc.nfree_pages++;
+    }
+    return 1;
+}
+
+static int add_page(lith_st *L, struct lith_pool *P)
+{
+    struct lith_page *page;
+    struct lith_free_cell *cell, **tail;
+    size_t i;
+    if (!L->gc.free_pages && !new_chunk(L)) return 0;
+    page = L->gc.free_pages;
+    L->gc.free_pages = page->next;
+    L->gc.nfree_pages--;
+    page->pool = P;
+    page->size = P->size;
+    /* the cells start at an address aligned as the pointers are */
+    page->cells = (char *) page
+        + ((sizeof(*page) + sizeof(void *) - 1) / sizeof(void *)) * sizeof(void *);
+    page->ncells = ((char *) page + LITH_PAGE_SIZE - page->cells) / P->size;
+    memset(page->marks, 0, sizeof(page->marks));
+    tail = (struct lith_free_cell **) &P->free;
+    for (i = 0; i < page->ncells; i++) {
+        cell = (struct lith_free_cell *) (page->cells + i * P->size);
+        cell->type = LITH__FREE;
+        *tail = cell;
+        tail = &cell->next;
+    }
+    *tail = NULL;
+    P->nfree += page->ncells;
+    page->next = P->pages;
+    P->pages = page;
+    P->npages++;
+    return 1;
+}
+
+/* O(1) unless the pool needs a new page */
+static void *alloc_cell(lith_st *L, struct lith_pool *P)
+{
+    struct lith_free_cell *cell;
+    if (!P->free && !add_page(L, P)) return NULL;
+    cell = P->free;
+    P->free = cell->next;
+    P->nfree--;
+    L->gc.count++;
+    return cell;
+}
+
+/* the slots are inside the frame unless they are too many */
+static lith_env *new_frame(lith_st *L, lith_env *parent, lith_value *names, size_t nslots)
+{
+    struct lith_frame *F;
+    struct lith_pool *P;
+    size_t i;
+    P = pool_for(L, offsetof(struct lith_frame, inline_slots)
+        + nslots * sizeof(lith_value *), 0);
+    F = alloc_cell(L, P ? P : pool_for(L, sizeof(*F), 0));
+    if (!F) return NULL;
+    F->type = LITH__FRAME;
+    F->parent = parent;
+    F->names = names;
+    F->extras = L->nil;
+    F->slots = F->inline_slots;
+    F->nslots = 0;
+    if (!P) {
+        F->slots = emalloc(L, nslots * sizeof(lith_value *));
+        if (!F->slots) {
+            F->slots = F->inline_slots;
+            return NULL;
+        }
+    }
+    for (i = 0; i < nslots; i++)
+        F->slots[i] = NULL;
+    F->nslots = nslots;
+    return (lith_env *) F;
+}
+
+/* a raw block is not a value and is marked by the value owning it */
+static void *alloc_raw(lith_st *L, size_t size)
+{
+    return alloc_cell(L, pool_for(L, size, 1));
+}
+
+/* returns whether the cell was not marked before */
+static int mark_cell(void *p)
+{
+    struct lith_page *page;
+    size_t i;
+    unsigned long bit;
+    page = PAGE_OF(p);
+    i = ((char *) p - page->cells) / page->size;
+    bit = 1UL << (i % LITH_WORD_BITS);
+    if (page->marks[i / LITH_WORD_BITS] & bit) return 0;
+    page->marks[i / LITH_WORD_BITS] |= bit;
+    return 1;
+}
+
+static int is_marked(void *p)
+{
+    struct lith_page *page;
+    size_t i;
+    page = PAGE_OF(p);
+    i = ((char *) p - page->cells) / page->size;
+    return (page->marks[i / LITH_WORD_BITS] >> (i % LITH_WORD_BITS)) & 1;
+}
+
+/* the persistent maps and vectors: trees of nodes which are not changed
+ * once made, so that a new version shares all of the nodes of the old
+ * one but those on the path to what is different
+ */
+
+#define LITH_NODE_BITS 5
+#define LITH_NODE_SIZE (1 << LITH_NODE_BITS)
+/* the bits of the hashes of the keys the maps use */
+#define LITH_MAP_HASH_BITS 32
+
+/* a node of a map has an entry for each part of the hashes, at its
+ * depth, in the bitmap: a key and its value, or a node below when the
+ * key is NULL; a node without keys is a bucket, whose one item is the
+ * list of the entries (key . value) with the same hash
+ * a node of a vector has the values, or the nodes below of the height,
+ * and how many values there are up to each of these when they are not
+ * all full but the last one
+ */
+struct lith_node {
+    lith_valtype type;
+    unsigned int height;
+    size_t n;
+    unsigned long bitmap;
+    lith_value **keys, **items;
+    size_t *sizes;
+};
+
+#define NODE(v) ((struct lith_node *) (v))
+
+/* the items, and the keys or the sizes, are raw blocks of the node */
+static struct lith_node *new_node(lith_st *L, size_t n, int keys)
+{
+    struct lith_node *N;
+    N = alloc_cell(L, pool_for(L, sizeof(*N), 0));
+    if (!N) return NULL;
+    N->type = LITH__NODE;
+    N->height = 0;
+    N->n = n;
+    N->bitmap = 0;
+    N->keys = N->items = NULL;
+    N->sizes = NULL;
+    if (n && (!(N->items = alloc_raw(L, n * sizeof(lith_value *)))
+    || (keys && !(N->keys = alloc_raw(L, n * sizeof(lith_value *))))))
+        return NULL;
+    return N;
+}
+
+/* a node like this one with n items, the first ones copied */
+static struct lith_node *copy_node(lith_st *L, struct lith_node *N, size_t n)
+{
+    struct lith_node *M;
+    size_t m;
+    if (!(M = new_node(L, n, N->keys != NULL))) return NULL;
+    M->height = N->height;
+    M->bitmap = N->bitmap;
+    m = (n < N->n) ? n : N->n;
+    if (m) {
+        memcpy(M->items, N->items, m * sizeof(lith_value *));
+        if (N->keys) memcpy(M->keys, N->keys, m * sizeof(lith_value *));
+    }
+    return M;
+}
+
+static lith_value *make_tree(lith_st *L, lith_valtype type, size_t len, struct lith_node *root)
+{
+    lith_value *val;
+    if (!(val = lith_new_value(L))) return NULL;
+    val->type = type;
+    val->value.tree.len = len;
+    val->value.tree.root = (lith_value *) root;
+    return val;
+}
+
+static unsigned int count_bits(unsigned long x)
+{
+    unsigned int n;
+    for (n = 0; x; n++) x &= x - 1;
+    return n;
+}
+
+static unsigned long map_hash(lith_value *key)
+{
+    return hash_key(key) & 0xFFFFFFFFUL;
+}
+
+#define MAP_BIT(hash, shift) (1UL << (((hash) >> (shift)) & (LITH_NODE_SIZE - 1)))
+#define MAP_INDEX(N, bit) count_bits((N)->bitmap & ((bit) - 1))
+
+/* the list of the entries of a bucket from the one of the key,
+ * () when it is not there, anything on an error */
+static lith_value *bucket_find(lith_st *L, struct lith_node *N, lith_value *key)
+{
+    lith_value *p;
+    for (p = N->items[0]; !LITH_IS_NIL(p); p = LITH_CDR(p))
+        if (same_key(L, LITH_CAR(LITH_CAR(p)), key) || LITH_IS_ERR(L)) break;
+    return p;
+}
+
+/* the value of the key in the map, NULL when it is not there or on an error */
+static lith_value *map_get(lith_st *L, lith_value *node, unsigned long hash, lith_value *key)
+{
+    struct lith_node *N;
+    unsigned long bit;
+    lith_value *p;
+    size_t i;
+    int shift;
+    for (shift = 0; node; shift += LITH_NODE_BITS) {
+        N = NODE(node);
+        if (!N->keys) {
+            p = bucket_find(L, N, key);
+            return (LITH_IS_NIL(p) || LITH_IS_ERR(L)) ? NULL : LITH_CDR(LITH_CAR(p));
+        }
+        bit = MAP_BIT(hash, shift);
+        if (!(N->bitmap & bit)) return NULL;
+        i = MAP_INDEX(N, bit);
+        if (N->keys[i]) return same_key(L, N->keys[i], key) ? N->items[i] : NULL;
+        node = N->items[i];
+    }
+    return NULL;
+}
+
+/* the entries of a bucket with the key set to the value */
+static struct lith_node *bucket_put(lith_st *L, struct lith_node *N, lith_value *key,
+                                    lith_value *val, int *added)
+{
+    struct lith_node *M;
+    lith_value *p, *found, *list, *last, *pair, *entry;
+    if (!(M = new_node(L, 1, 0)) || !(entry = LITH_CONS(L, key, val))) return NULL;
+    found = bucket_find(L, N, key);
+    if (LITH_IS_ERR(L)) return NULL;
+    if (LITH_IS_NIL(found)) {
+        *added = 1;
+        M->items[0] = LITH_CONS(L, entry, N->items[0]);
+        return M->items[0] ? M : NULL;
+    }
+    /* the entries before the one of the key are copied */
+    list = last = NULL;
+    for (p = N->items[0]; p != found; p = LITH_CDR(p)) {
+        if (!(pair = LITH_CONS(L, LITH_CAR(p), L->nil))) return NULL;
+        if (last) LITH_CDR(last) = pair; else list = pair;
+        last = pair;
+    }
+    if (!(pair = LITH_CONS(L, entry, LITH_CDR(found)))) return NULL;
+    if (last) LITH_CDR(last) = pair; else list = pair;
+    M->items[0] = list;
+    return M;
+}
+
+/* a node of the two entries, whose hashes are the same up to the shift */
+static struct lith_node *map_pair(lith_st *L, int shift,
+                                  lith_value *k1, lith_value *v1, unsigned long h1,
+                                  lith_value *k2, lith_value *v2, unsigned long h2)
+{
+    struct lith_node *N, *child;
+    lith_value *e1, *e2;
+    unsigned long b1, b2;
+    if (shift >= LITH_MAP_HASH_BITS) {
+        if (!(N = new_node(L, 1, 0)) || !(e1 = LITH_CONS(L, k1, v1))
+        || !(e2 = LITH_CONS(L, k2, v2)) || !(e2 = LITH_CONS(L, e2, L->nil))
+        || !(N->items[0] = LITH_CONS(L, e1, e2))) return NULL;
+        return N;
+    }
+    b1 = MAP_BIT(h1, shift);
+    b2 = MAP_BIT(h2, shift);
+    if (b1 == b2) {
+        if (!(child = map_pair(L, shift + LITH_NODE_BITS, k1, v1, h1, k2, v2, h2))
+        || !(N = new_node(L, 1, 1))) return NULL;
+        N->keys[0] = NULL;
+        N->items[0] = (lith_value *) child;
+    } else {
+        if (!(N = new_node(L, 2, 1))) return NULL;
+        N->keys[b1 > b2] = k1;
+        N->items[b1 > b2] = v1;
+        N->keys[b1 < b2] = k2;
+        N->items[b1 < b2] = v2;
+    }
+    N->bitmap = b1 | b2;
+    return N;
+}
+
+/* the node with the key set to the value */
+static struct lith_node *map_put(lith_st *L, lith_value *node, int shift, unsigned long hash,
+                                 lith_value *key, lith_value *val, int *added)
+{
+    struct lith_node *N, *M, *child;
+    unsigned long bit;
+    size_t i;
+    bit = MAP_BIT(hash, shift);
+    if (!node) {
+        if (!(M = new_node(L, 1, 1))) return NULL;
+        M->bitmap = bit;
+        M->keys[0] = key;
+        M->items[0] = val;
+        *added = 1;
+        return M;
+    }
+    N = NODE(node);
+    if (!N->keys) return bucket_put(L, N, key, val, added);
+    i = MAP_INDEX(N, bit);
+    if (!(N->bitmap & bit)) {
+        if (!(M = copy_node(L, N, N->n + 1))) return NULL;
+        memmove(M->keys + i + 1, M->keys + i, (N->n - i) * sizeof(lith_value *));
+        memmove(M->items + i + 1, M->items + i, (N->n - i) * sizeof(lith_value *));
+        M->bitmap |= bit;
+        M->keys[i] = key;
+        M->items[i] = val;
+        *added = 1;
+        return M;
+    }
+    if (!N->keys[i]) {
+        child = map_put(L, N->items[i], shift + LITH_NODE_BITS, hash, key, val, added);
+        if (!child) return NULL;
+        if (child == NODE(N->items[i])) return N;
+    } else if (same_key(L, N->keys[i], key)) {
+        if (N->items[i] == val) return N;
+        if (!(M = copy_node(L, N, N->n))) return NULL;
+        M->items[i] = val;
+        return M;
+    } else {
+        child = map_pair(L, shift + LITH_NODE_BITS, N->keys[i], N->items[i],
+            map_hash(N->keys[i]), key, val, hash);
+        if (!child) return NULL;
+        *added = 1;
+    }
+    if (!(M = copy_node(L, N, N->n))) return NULL;
+    M->keys[i] = NULL;
+    M->items[i] = (lith_value *) child;
+    return M;
+}
+
+/* the node without the key in *result, NULL when it is left empty */
+static int map_delete(lith_st *L, lith_value *node, int shift, unsigned long hash,
+                      lith_value *key, lith_value **result)
+{
+    struct lith_node *N, *M, *C;
+    lith_value *child, *p, *found, *list, *last, *entry;
+    unsigned long bit;
+    size_t i;
+    *result = node;
+    N = NODE(node);
+    if (!N->keys) {
+        found = bucket_find(L, N, key);
+        if (LITH_IS_ERR(L)) return 0;
+        if (LITH_IS_NIL(found)) return 1;
+        list = last = NULL;
+        for (p = N->items[0]; p != found; p = LITH_CDR(p)) {
+            if (!(entry = LITH_CONS(L, LITH_CAR(p), L->nil))) return 0;
+            if (last) LITH_CDR(last) = entry; else list = entry;
+            last = entry;
+        }
+        if (last) LITH_CDR(last) = LITH_CDR(found); else list = LITH_CDR(found);
+        if (LITH_IS_NIL(list)) {
+            *result = NULL;
+            return 1;
+        }
+        if (!(M = new_node(L, 1, 0))) return 0;
+        M->items[0] = list;
+        *result = (lith_value *) M;
+        return 1;
+    }
+    bit = MAP_BIT(hash, shift);
+    if (!(N->bitmap & bit)) return 1;
+    i = MAP_INDEX(N, bit);
+    if (N->keys[i]) {
+        if (!same_key(L, N->keys[i], key)) return !LITH_IS_ERR(L);
+    } else {
+        if (!map_delete(L, N->items[i], shift + LITH_NODE_BITS, hash, key, &child))
+            return 0;
+        if (child == N->items[i]) return 1;
+        if (child) {
+            if (!(M = copy_node(L, N, N->n))) return 0;
+            C = NODE(child);
+            /* a lone entry below goes up in place of its node */
+            if (C->keys && (C->n == 1) && C->keys[0]) {
+                M->keys[i] = C->keys[0];
+                M->items[i] = C->items[0];
+            } else if (!C->keys && LITH_IS_NIL(LITH_CDR(C->items[0]))) {
+                M->keys[i] = LITH_CAR(LITH_CAR(C->items[0]));
+                M->items[i] = LITH_CDR(LITH_CAR(C->items[0]));
+            } else {
+                M->items[i] = child;
+            }
+            *result = (lith_value *) M;
+            return 1;
+        }
+    }
+    if (N->n == 1) {
+        *result = NULL;
+        return 1;
+    }
+    if (!(M = copy_node(L, N, N->n - 1))) return 0;
+    memcpy(M->keys + i, N->keys + i + 1, (N->n - i - 1) * sizeof(lith_value *));
+    memcpy(M->items + i, N->items + i + 1, (N->n - i - 1) * sizeof(lith_value *));
+    M->bitmap &= ~bit;
+    *result = (lith_value *) M;
+    return 1;
+}
+
+/* the keys of the map, or its entries as (key . value), put before the list */
+static lith_value *map_list(lith_st *L, lith_value *node, int entries, lith_value *list)
+{
+    struct lith_node *N;
+    lith_value *p, *item;
+    size_t i;
+    if (!node) return list;
+    N = NODE(node);
+    if (!N->keys) {
+        for (p = N->items[0]; list && !LITH_IS_NIL(p); p = LITH_CDR(p))
+            list = LITH_CONS(L, entries ? LITH_CAR(p) : LITH_CAR(LITH_CAR(p)), list);
+        return list;
+    }
+    for (i = N->n; list && (i-- > 0); ) {
+        if (!N->keys[i]) {
+            list = map_list(L, N->items[i], entries, list);
+        } else {
+            item = entries ? LITH_CONS(L, N->keys[i], N->items[i]) : N->keys[i];
+            list = item ? LITH_CONS(L, item, list) : NULL;
+        }
+    }
+    return list;
+}
+
+/* whether each entry under the node has an equal value in the map */
+static int map_within(lith_st *L, lith_value *node, lith_value *map)
+{
+    struct lith_node *N;
+    lith_value *p, *v;
+    size_t i;
+    if (!node) return 1;
+    N = NODE(node);
+    if (!N->keys) {
+        for (p = N->items[0]; !LITH_IS_NIL(p); p = LITH_CDR(p)) {
+            v = map_get(L, map, map_hash(LITH_CAR(LITH_CAR(p))), LITH_CAR(LITH_CAR(p)));
+            if (!v || !is_equal(L, v, LITH_CDR(LITH_CAR(p)))) return 0;
+        }
+        return 1;
+    }
+    for (i = 0; i < N->n; i++) {
+        if (!N->keys[i]) {
+            if (!map_within(L, N->items[i], map)) return 0;
+        } else {
+            v = map_get(L, map, map_hash(N->keys[i]), N->keys[i]);
+            if (!v || !is_equal(L, v, N->items[i])) return 0;
+        }
+    }
+    return 1;
+}
+
+/* the values a node of a vector has below it */
+static size_t node_size(struct lith_node *N)
+{
+    size_t total;
+    for (total = 0; N->height; N = NODE(N->items[N->n - 1])) {
+        if (N->sizes) return total + N->sizes[N->n - 1];
+        total += (N->n - 1) << (LITH_NODE_BITS * N->height);
+    }
+    return total + N->n;
+}
+
+/* the child with the value at the index, which becomes the one in it */
+static size_t child_index(struct lith_node *N, size_t *i)
+{
+    size_t j;
+    j = *i >> (LITH_NODE_BITS * N->height);
+    if (!N->sizes) {
+        *i -= j << (LITH_NODE_BITS * N->height);
+        return j;
+    }
+    while (N->sizes[j] <= *i) j++;
+    if (j) *i -= N->sizes[j - 1];
+    return j;
+}
+
+/* the sizes are kept unless the children are full but the last one */
+static int set_sizes(lith_st *L, struct lith_node *N)
+{
+    size_t sizes[LITH_NODE_SIZE], i, total, size, full;
+    int relaxed;
+    full = (size_t) 1 << (LITH_NODE_BITS * N->height);
+    relaxed = 0;
+    for (total = 0, i = 0; i < N->n; i++) {
+        size = node_size(NODE(N->items[i]));
+        if ((i + 1 < N->n) && (size != full)) relaxed = 1;
+        sizes[i] = total += size;
+    }
+    N->sizes = NULL;
+    if (!relaxed) return 1;
+    if (!(N->sizes = alloc_raw(L, N->n * sizeof(size_t)))) return 0;
+    memcpy(N->sizes, sizes, N->n * sizeof(size_t));
+    return 1;
+}
+
+static lith_value *vec_ref(lith_value *root, size_t i)
+{
+    struct lith_node *N;
+    for (N = NODE(root); N->height; N = NODE(N->items[child_index(N, &i)]))
+        ;
+    return N->items[i];
+}
+
+static struct lith_node *vec_set(lith_st *L, struct lith_node *N, size_t i, lith_value *val)
+{
+    struct lith_node *M, *child;
+    size_t j;
+    if (!(M = copy_node(L, N, N->n))) return NULL;
+    M->sizes = N->sizes;
+    if (!N->height) {
+        M->items[i] = val;
+        return M;
+    }
+    j = child_index(N, &i);
+    if (!(child = vec_set(L, NODE(N->items[j]), i, val))) return NULL;
+    M->items[j] = (lith_value *) child;
+    return M;
+}
+
+/* a leaf of the value, under single nodes up to the height */
+static struct lith_node *vec_path(lith_st *L, unsigned int height, lith_value *val)
+{
+    struct lith_node *N, *M;
+    unsigned int h;
+    if (!(N = new_node(L, 1, 0))) return NULL;
+    N->items[0] = val;
+    for (h = 1; h <= height; h++, N = M) {
+        if (!(M = new_node(L, 1, 0))) return NULL;
+        M->height = h;
+        M->items[0] = (lith_value *) N;
+    }
+    return N;
+}
+
+/* the node with the value after its last one, NULL with *full set when
+ * there is no room for it below the node */
+static struct lith_node *vec_push(lith_st *L, struct lith_node *N, lith_value *val, int *full)
+{
+    struct lith_node *M, *child;
+    if (!N->height) {
+        if (N->n == LITH_NODE_SIZE) {
+            *full = 1;
+            return NULL;
+        }
+        if (!(M = copy_node(L, N, N->n + 1))) return NULL;
+        M->items[N->n] = val;
+        return M;
+    }
+    child = vec_push(L, NODE(N->items[N->n - 1]), val, full);
+    if (child) {
+        if (!(M = copy_node(L, N, N->n))) return NULL;
+        M->items[N->n - 1] = (lith_value *) child;
+    } else {
+        if (!*full || (N->n == LITH_NODE_SIZE)) return NULL;
+        *full = 0;
+        if (!(child = vec_path(L, N->height - 1, val))
+        || !(M = copy_node(L, N, N->n + 1))) return NULL;
+        M->items[N->n] = (lith_value *) child;
+    }
+    if ((N->sizes || (N->n != M->n)) && !set_sizes(L, M)) return NULL;
+    return M;
+}
+
+/* a tree of the values from its leaves up, full but the last nodes */
+static struct lith_node *vec_build(lith_st *L, lith_value **values, size_t n)
+{
+    struct lith_node *N, **level;
+    lith_value **items;
+    unsigned int height;
+    size_t k, m;
+    if (!(level = emalloc(L, ((n + LITH_NODE_SIZE - 1) / LITH_NODE_SIZE) * sizeof(*level))))
+        return NULL;
+    items = values;
+    for (height = 0;; height++) {
+        /* the nodes made take the place of the ones already gone through */
+        for (m = 0, k = 0; k < n; k += LITH_NODE_SIZE, m++) {
+            if (!(N = new_node(L, (n - k < LITH_NODE_SIZE) ? (n - k) : LITH_NODE_SIZE, 0))) {
+                free(level);
+                return NULL;
+            }
+            N->height = height;
+            memcpy(N->items, items + k, N->n * sizeof(lith_value *));
+            level[m] = N;
+        }
+        if (m == 1) break;
+        items = (lith_value **) level;
+        n = m;
+    }
+    free(level);
+    return N;
+}
+
+/* how many slots more than the fewest which could hold the items a
+ * level of the seam may take, before its nodes are merged */
+#define LITH_NODE_EXTRA 2
+
+/* the nodes of the height the n given are made into, with at most
+ * LITH_NODE_EXTRA more of them than the fewest which could hold their
+ * items: the nodes with all of their slots but one used are kept, the
+ * items of the others go into the nodes after them */
+static size_t vec_rebalance(lith_st *L, struct lith_node **all, size_t n, lith_value **out)
+{
+    size_t sizes[2 * LITH_NODE_SIZE], total, fewest, m, i, j, k, r, off;
+    struct lith_node *N;
+    for (total = 0, i = 0; i < n; i++) total += sizes[i] = all[i]->n;
+    fewest = (total + LITH_NODE_SIZE - 1) / LITH_NODE_SIZE;
+    for (m = n, i = 0; m > fewest + LITH_NODE_EXTRA; m--, i--) {
+        while ((i + 1 < m) && (sizes[i] >= LITH_NODE_SIZE - LITH_NODE_EXTRA / 2)) i++;
+        if (i + 1 == m) break;
+        for (r = sizes[i]; r; i++) {
+            k = (r + sizes[i + 1] < LITH_NODE_SIZE) ? (r + sizes[i + 1]) : LITH_NODE_SIZE;
+            r += sizes[i + 1] - k;
+            sizes[i] = k;
+        }
+        for (j = i; j + 1 < m; j++) sizes[j] = sizes[j + 1];
+    }
+    /* the nodes whose items stay as they were are kept as they are */
+    for (i = 0, off = 0, k = 0; k < m; k++) {
+        if (!off && (all[i]->n == sizes[k])) {
+            out[k] = (lith_value *) all[i++];
+            continue;
+        }
+        if (!(N = new_node(L, sizes[k], 0))) return 0;
+        N->height = all[i]->height;
+        for (j = 0; j < N->n; j += r) {
+            r = all[i]->n - off;
+            if (r > N->n - j) r = N->n - j;
+            memcpy(N->items + j, all[i]->items + off, r * sizeof(lith_value *));
+            if ((off += r) == all[i]->n) i++, off = 0;
+        }
+        if (N->height && !set_sizes(L, N)) return 0;
+        out[k] = (lith_value *) N;
+    }
+    return m;
+}
+
+/* the one or two nodes the trees make together, at the height of the
+ * higher one: along the seam, the children are redistributed so that
+ * the tree stays as high as one of its values would make it */
+static int vec_merge(lith_st *L, struct lith_node *a, struct lith_node *b,
+                     struct lith_node **out, size_t *nout)
+{
+    lith_value *all[2 * LITH_NODE_SIZE];
+    struct lith_node *mid[2], *nodes[2 * LITH_NODE_SIZE], *N;
+    size_t n, nmid, i, k;
+    unsigned int height;
+    n = 0;
+    height = (a->height > b->height) ? a->height : b->height;
+    if (!height) {
+        for (i = 0; i < a->n; i++) all[n++] = a->items[i];
+        for (i = 0; i < b->n; i++) all[n++] = b->items[i];
+    } else {
+        if (!vec_merge(L,
+                (a->height == height) ? NODE(a->items[a->n - 1]) : a,
+                (b->height == height) ? NODE(b->items[0]) : b, mid, &nmid))
+            return 0;
+        if (a->height == height)
+            for (i = 0; i + 1 < a->n; i++) nodes[n++] = NODE(a->items[i]);
+        for (i = 0; i < nmid; i++) nodes[n++] = mid[i];
+        if (b->height == height)
+            for (i = 1; i < b->n; i++) nodes[n++] = NODE(b->items[i]);
+        if (!(n = vec_rebalance(L, nodes, n, all))) return 0;
+    }
+    for (*nout = 0, k = 0; k < n; k += LITH_NODE_SIZE) {
+        if (!(N = new_node(L, (n - k < LITH_NODE_SIZE) ? (n - k) : LITH_NODE_SIZE, 0)))
+            return 0;
+        N->height = height;
+        memcpy(N->items, all + k, N->n * sizeof(lith_value *));
+        if (height && !set_sizes(L, N)) return 0;
+        out[(*nout)++] = N;
+    }
+    return 1;
+}
+
+/* the first n values, n > 0 */
+static struct lith_node *vec_take(lith_st *L, struct lith_node *N, size_t n)
+{
+    struct lith_node *M, *child;
+    size_t i, j;
+    if (!N->height) return copy_node(L, N, n);
+    i = n - 1;
+    j = child_index(N, &i);
+    if (!(child = vec_take(L, NODE(N->items[j]), i + 1))
+    || !(M = copy_node(L, N, j + 1))) return NULL;
+    M->items[j] = (lith_value *) child;
+    if (N->sizes && !set_sizes(L, M)) return NULL;
+    return M;
+}
+
+/* the values from the nth on, n less than how many there are */
+static struct lith_node *vec_drop(lith_st *L, struct lith_node *N, size_t n)
+{
+    struct lith_node *M, *child;
+    size_t i, j;
+    if (!N->height) {
+        if (!(M = new_node(L, N->n - n, 0))) return NULL;
+        memcpy(M->items, N->items + n, M->n * sizeof(lith_value *));
+        return M;
+    }
+    i = n;
+    j = child_index(N, &i);
+    if (!(child = vec_drop(L, NODE(N->items[j]), i))
+    || !(M = new_node(L, N->n - j, 0))) return NULL;
+    M->height = N->height;
+    M->items[0] = (lith_value *) child;
+    memcpy(M->items + 1, N->items + j + 1, (M->n - 1) * sizeof(lith_value *));
+    if (!set_sizes(L, M)) return NULL;
+    return M;
+}
+
+/* the values of a vector put before the list */
+static lith_value *vec_list(lith_st *L, struct lith_node *N, lith_value *list)
+{
+    size_t i;
+    for (i = N->n; list && (i-- > 0); )
+        list = N->height ? vec_list(L, NODE(N->items[i]), list)
+            : LITH_CONS(L, N->items[i], list);
+    return list;
+}
+
+/* errors as is_equal */
+static int equal_trees(lith_st *L, lith_value *a, lith_value *b)
+{
+    size_t i;
+    if (a->value.tree.len != b->value.tree.len) return 0;
+    if (LITH_IS(a, LITH_TYPE_PMAP))
+        return map_within(L, a->value.tree.root, b->value.tree.root);
+    for (i = 0; i < a->value.tree.len; i++)
+        if (!is_equal(L, vec_ref(a->value.tree.root, i), vec_ref(b->value.tree.root, i)))
+            return 0;
+    return 1;
+}
+
+/* the vectors and the tables being printed or copied, from the innermost:
+ * one found again inside itself is not followed, as vector-set! and
+ * table-put! can make one hold itself */
+struct lith_path {
+    lith_value *val, *copy;
+    struct lith_path *up;
+};
+
+static void print_value(lith_st *, lith_value *, FILE *, struct lith_path *);
+
+static void print_map(lith_st *L, lith_value *node, FILE *file, int *first,
+                      struct lith_path *P)
+{
+    struct lith_node *N;
+    lith_value *p;
+    size_t i;
+    if (!node) return;
+    N = NODE(node);
+    for (i = 0, p = N->keys ? NULL : N->items[0]; i < N->n; i++) {
+        if (N->keys && !N->keys[i]) {
+            print_map(L, N->items[i], file, first, P);
+            continue;
+        }
+        do {
+            if (!*first) fputc(' ', file);
+            *first = 0;
+            fputc('(', file);
+            print_value(L, p ? LITH_CAR(LITH_CAR(p)) : N->keys[i], file, P);
+            fprintf(file, " . ");
+            print_value(L, p ? LITH_CDR(LITH_CAR(p)) : N->items[i], file, P);
+            fputc(')', file);
+        } while (p && !LITH_IS_NIL(p = LITH_CDR(p)));
+    }
+}
+
+/* make-pmap[0] :: (make-pmap) -> pmap */
+static lith_value *builtin__make_pmap(lith_st *L, size_t argc, lith_value **argv)
+{
+    return make_tree(L, LITH_TYPE_PMAP, 0, NULL);
+}
+
+/* pmap-put[3] :: (pmap-put pmap key a) -> pmap
+ * a new map, in which the key has the value a */
+static lith_value *builtin__pmap_put(lith_st *L, size_t argc, lith_value **argv)
+{
+    struct lith_node *root;
+    int added;
+    if (!lith_expect_type(L, "pmap-put", 1, LITH_TYPE_PMAP, argv[0])) return NULL;
+    added = 0;
+    root = map_put(L, argv[0]->value.tree.root, 0, map_hash(argv[1]), argv[1], argv[2], &added);
+    if (!root || LITH_IS_ERR(L)) return NULL;
+    if (root == NODE(argv[0]->value.tree.root)) return argv[0];
+    return make_tree(L, LITH_TYPE_PMAP, argv[0]->value.tree.len + added, root);
+}
+
+/* pmap-get[2+] :: (pmap-get pmap key [a]) -> a
+ * the value of the key, or the third argument, or () */
+static lith_value *builtin__pmap_get(lith_st *L, size_t argc, lith_value **argv)
+{
+    lith_value *val;
+    if (!expect_at_most(L, "pmap-get", 3, argc)
+    || !lith_expect_type(L, "pmap-get", 1, LITH_TYPE_PMAP, argv[0])) return NULL;
+    if ((val = map_get(L, argv[0]->value.tree.root, map_hash(argv[1]), argv[1]))) return val;
+    if (LITH_IS_ERR(L)) return NULL;
+    return (argc == 3) ? argv[2] : L->nil;
+}
+
+/* pmap-delete[2] :: (pmap-delete pmap key) -> pmap
+ * a new map, without the key */
+static lith_value *builtin__pmap_delete(lith_st *L, size_t argc, lith_value **argv)
+{
+    lith_value *root;
+    if (!lith_expect_type(L, "pmap-delete", 1, LITH_TYPE_PMAP, argv[0])) return NULL;
+    if (!argv[0]->value.tree.root) return argv[0];
+    if (!map_delete(L, argv[0]->value.tree.root, 0, map_hash(argv[1]), argv[1], &root))
+        return NULL;
+    if (root == argv[0]->value.tree.root) return argv[0];
+    return make_tree(L, LITH_TYPE_PMAP, argv[0]->value.tree.len - 1, NODE(root));
+}
+
+/* pmap-contains?[2] :: (pmap-contains? pmap key) -> bool */
+static lith_value *builtin__pmap_contains(lith_st *L, size_t argc, lith_value **argv)
+{
+    lith_value *val;
+    if (!lith_expect_type(L, "pmap-contains?", 1, LITH_TYPE_PMAP, argv[0])) return NULL;
+    val = map_get(L, argv[0]->value.tree.root, map_hash(argv[1]), argv[1]);
+    return LITH_IS_ERR(L) ? NULL : LITH_IN_BOOL(val);
+}
+
+/* pmap-size[1] :: (pmap-size pmap) -> int */
+static lith_value *builtin__pmap_size(lith_st *L, size_t argc, lith_value **argv)
+{
+    if (!lith_expect_type(L, "pmap-size", 1, LITH_TYPE_PMAP, argv[0])) return NULL;
+    return lith_make_integer(L, (long) argv[0]->value.tree.len);
+}
+
+/* pmap-keys[1] :: (pmap-keys pmap) -> (key...) */
+static lith_value *builtin__pmap_keys(lith_st *L, size_t argc, lith_value **argv)
+{
+    if (!lith_expect_type(L, "pmap-keys", 1, LITH_TYPE_PMAP, argv[0])) return NULL;
+    return map_list(L, argv[0]->value.tree.root, 0, L->nil);
+}
+
+/* pmap->list[1] :: (pmap->list pmap) -> ((key . a)...) */
+static lith_value *builtin__pmap_to_list(lith_st *L, size_t argc, lith_value **argv)
+{
+    if (!lith_expect_type(L, "pmap->list", 1, LITH_TYPE_PMAP, argv[0])) return NULL;
+    return map_list(L, argv[0]->value.tree.root, 1, L->nil);
+}
+
+/* pvector[0+] :: (pvector a...) -> pvector */
+static lith_value *builtin__pvector(lith_st *L, size_t argc, lith_value **argv)
+{
+    struct lith_node *root;
+    root = NULL;
+    if (argc && !(root = vec_build(L, argv, argc))) return NULL;
+    return make_tree(L, LITH_TYPE_PVECTOR, argc, root);
+}
+
+/* list->pvector[1] :: (list->pvector (a...)) -> pvector */
+static lith_value *builtin__list_to_pvector(lith_st *L, size_t argc, lith_value **argv)
+{
+    struct lith_node *root;
+    lith_value **values, *p;
+    size_t i, n;
+    if (!LITH_IS_NIL(argv[0])
+    && !lith_expect_type(L, "list->pvector", 1, LITH_TYPE_PAIR, argv[0])) return NULL;
+    if (!is_proper_list(argv[0])) {
+        lith_simple_error(L, LITH_ERR_TYPE, "expecting a proper list");
+        L->error_state.name = "list->pvector";
+        L->error_state.expr = argv[0];
+        return NULL;
+    }
+    if (!(n = list_length(argv[0]))) return make_tree(L, LITH_TYPE_PVECTOR, 0, NULL);
+    if (!(values = emalloc(L, n * sizeof(*values)))) return NULL;
+    for (i = 0, p = argv[0]; i < n; i++, p = LITH_CDR(p))
+        values[i] = LITH_CAR(p);
+    root = vec_build(L, values, n);
+    free(values);
+    return root ? make_tree(L, LITH_TYPE_PVECTOR, n, root) : NULL;
+}
+
+/* pvector->list[1] :: (pvector->list pvector) -> (a...) */
+static lith_value *builtin__pvector_to_list(lith_st *L, size_t argc, lith_value **argv)
+{
+    if (!lith_expect_type(L, "pvector->list", 1, LITH_TYPE_PVECTOR, argv[0])) return NULL;
+    if (!argv[0]->value.tree.root) return L->nil;
+    return vec_list(L, NODE(argv[0]->value.tree.root), L->nil);
+}
+
+/* pvector-length[1] :: (pvector-length pvector) -> int */
+static lith_value *builtin__pvector_length(lith_st *L, size_t argc, lith_value **argv)
+{
+    if (!lith_expect_type(L, "pvector-length", 1, LITH_TYPE_PVECTOR, argv[0])) return NULL;
+    return lith_make_integer(L, (long) argv[0]->value.tree.len);
+}
+
+/* pvector-ref[2] :: (pvector-ref pvector int) -> a */
+static lith_value *builtin__pvector_ref(lith_st *L, size_t argc, lith_value **argv)
+{
+    size_t i;
+    if (!lith_expect_type(L, "pvector-ref", 1, LITH_TYPE_PVECTOR, argv[0])
+    || !vector_index(L, "pvector-ref", 2, argv[1],
+            (long) argv[0]->value.tree.len - 1, &i)) return NULL;
+    return vec_ref(argv[0]->value.tree.root, i);
+}
+
+/* pvector-set[3] :: (pvector-set pvector int a) -> pvector
+ * a new vector, with a at the index */
+static lith_value *builtin__pvector_set(lith_st *L, size_t argc, lith_value **argv)
+{
+    struct lith_node *root;
+    size_t i;
+    if (!lith_expect_type(L, "pvector-set", 1, LITH_TYPE_PVECTOR, argv[0])
+    || !vector_index(L, "pvector-set", 2, argv[1],
+            (long) argv[0]->value.tree.len - 1, &i)
+    || !(root = vec_set(L, NODE(argv[0]->value.tree.root), i, argv[2]))) return NULL;
+    return make_tree(L, LITH_TYPE_PVECTOR, argv[0]->value.tree.len, root);
+}
+
+/* pvector-push[2] :: (pvector-push pvector a) -> pvector
+ * a new vector, with a after the last value */
+static lith_value *builtin__pvector_push(lith_st *L, size_t argc, lith_value **argv)
+{
+    struct lith_node *root, *N, *path;
+    int full;
+    if (!lith_expect_type(L, "pvector-push", 1, LITH_TYPE_PVECTOR, argv[0])) return NULL;
+    N = NODE(argv[0]->value.tree.root);
+    full = 0;
+    if (!N) {
+        root = vec_path(L, 0, argv[1]);
+    } else if (!(root = vec_push(L, N, argv[1], &full)) && full) {
+        /* a new root over the full one */
+        if (!(path = vec_path(L, N->height, argv[1]))
+        || !(root = new_node(L, 2, 0))) return NULL;
+        root->height = N->height + 1;
+        root->items[0] = (lith_value *) N;
+        root->items[1] = (lith_value *) path;
+        if (!set_sizes(L, root)) return NULL;
+    }
+    if (!root) return NULL;
+    return make_tree(L, LITH_TYPE_PVECTOR, argv[0]->value.tree.len + 1, root);
+}
+
+/* pvector-concat[2] :: (pvector-concat pvector pvector) -> pvector
+ * a new vector, of the values of the first then of the second,
+ * made in logarithmic time */
+static lith_value *builtin__pvector_concat(lith_st *L, size_t argc, lith_value **argv)
+{
+    struct lith_node *out[2], *root;
+    size_t n;
+    if (!lith_expect_type(L, "pvector-concat", 1, LITH_TYPE_PVECTOR, argv[0])
+    || !lith_expect_type(L, "pvector-concat", 2, LITH_TYPE_PVECTOR, argv[1])) return NULL;
+    if (!argv[0]->value.tree.len) return argv[1];
+    if (!argv[1]->value.tree.len) return argv[0];
+    if (!vec_merge(L, NODE(argv[0]->value.tree.root), NODE(argv[1]->value.tree.root), out, &n))
+        return NULL;
+    root = out[0];
+    if (n == 2) {
+        if (!(root = new_node(L, 2, 0))) return NULL;
+        root->height = out[0]->height + 1;
+        root->items[0] = (lith_value *) out[0];
+        root->items[1] = (lith_value *) out[1];
+        if (!set_sizes(L, root)) return NULL;
+    }
+    while (root->height && (root->n == 1)) root = NODE(root->items[0]);
+    return make_tree(L, LITH_TYPE_PVECTOR,
+        argv[0]->value.tree.len + argv[1]->value.tree.len, root);
+}
+
+/* pvector-slice[3] :: (pvector-slice pvector int int) -> pvector
+ * a new vector, of the values from the first index up to the second */
+static lith_value *builtin__pvector_slice(lith_st *L, size_t argc, lith_value **argv)
+{
+    struct lith_node *root;
+    size_t from, to;
+    if (!lith_expect_type(L, "pvector-slice", 1, LITH_TYPE_PVECTOR, argv[0])
+    || !vector_index(L, "pvector-slice", 3, argv[2], (long) argv[0]->value.tree.len, &to)
+    || !vector_index(L, "pvector-slice", 2, argv[1], (long) to, &from)) return NULL;
+    if (from == to) return make_tree(L, LITH_TYPE_PVECTOR, 0, NULL);
+    root = NODE(argv[0]->value.tree.root);
+    if ((to < argv[0]->value.tree.len) && !(root = vec_take(L, root, to))) return NULL;
+    if (from && !(root = vec_drop(L, root, from))) return NULL;
+    while (root->height && (root->n == 1))
+        root = NODE(root->items[0]);
+    return make_tree(L, LITH_TYPE_PVECTOR, to - from, root);
+}
+
+/* the garbage collector:
+ * precise mark and sweep, rooted at the lith_st:
+ * the global environment, the error state and the eval stack,
+ * the symbol table is weak: it only keeps the symbols marked from these
+ */
+
+#define LITH_GC_MIN_THRESHOLD 16384
+
+/* the most values on the eval stack: the calls of compiled closures
+ * are kept there, this bounds how deep they go */
+#define LITH_STACK_MAX (1UL << 24)
+
+/* the bytes of the C stack the evaluator uses at most, by default */
+#define LITH_CSTACK_LIMIT (4UL << 20)
+
+/* keep a value alive while the evaluator works with it,
+ * the value is forgotten when the eval stack is unwound
+ */
+static int reserve_stack(lith_st *L, size_t n)
+{
+    lith_value **stack;
+    size_t cap;
+    if (L->gc.sp + n <= L->gc.cap) return 1;
+    if (L->gc.sp + n > LITH_STACK_MAX) {
+        lith_simple_error(L, LITH_ERR_NOMEM, "eval stack exhausted");
+        return 0;
+    }
+    cap = L->gc.cap ? L->gc.cap : 256;
+    while (cap < L->gc.sp + n) cap *= 2;
+    stack = realloc(L->gc.stack, cap * sizeof(*stack));
+    if (!stack) {
+        L->error = LITH_ERR_NOMEM;
+        return 0;
+    }
+    L->gc.stack = stack;
+    L->gc.cap = cap;
+    return 1;
+}
+
+static int push_root(lith_st *L, lith_value *val)
+{
+    if (!reserve_stack(L, 1)) return 0;
+    L->gc.stack[L->gc.sp++] = val;
+    return 1;
+}
+
+static void trace_value(lith_st *, lith_value *);
+
+static void mark_value(lith_st *L, lith_value *val)
+{
+    lith_value **gray;
+    size_t cap;
+    switch (LITH_TAG(val)) {
+    case LITH_TAG_HEAP:
+        if (!val || !mark_cell(val)) return;
+        break;
+    case LITH_TAG_PAIR:
+        if (!mark_cell(PAIR_CELL(val))) return;
+        break;
+    default: return;
+    }
+    if (L->gc.ngray == L->gc.graycap) {
+        cap = L->gc.graycap ? (2 * L->gc.graycap) : 256;
+        gray = realloc(L->gc.gray, cap * sizeof(*gray));
+        if (!gray) {
+            /* no memory to defer it: mark the children right now */
+            trace_value(L, val);
+            return;
+        }
+        L->gc.gray = gray;
+        L->gc.graycap = cap;
+    }
+    L->gc.gray[L->gc.ngray++] = val;
+}
+
+static void trace_value(lith_st *L, lith_value *val)
+{
+    lith_callable *f;
+    struct lith_table *T;
+    struct lith_node *N;
+    struct lith_frame *F;
+    size_t i;
+    if (LITH_TAG(val) == LITH_TAG_PAIR) {
+        mark_value(L, LITH_CAR(val));
+        mark_value(L, LITH_CDR(val));
+        return;
+    }
+    if (val->type == LITH__FRAME) {
+        F = FRAME(val);
+        mark_value(L, F->parent);
+        mark_value(L, F->names);
+        mark_value(L, F->extras);
+        for (i = 0; i < F->nslots; i++)
+            mark_value(L, F->slots[i]);
+        return;
+    }
+    if (val->type == LITH__NAMESPACE) {
+        mark_value(L, NAMESPACE(val)->parent);
+        for (i = 0; i < NAMESPACE(val)->cap; i++)
+            mark_value(L, NAMESPACE(val)->cells[i]);
+        return;
+    }
+    if (val->type == LITH__CODE) {
+        for (i = 0; i < CODE(val)->nconsts; i++)
+            mark_value(L, CODE(val)->consts[i]);
+        return;
+    }
+    if (val->type == LITH__NODE) {
+        N = NODE(val);
+        if (N->keys) mark_cell(N->keys);
+        if (N->items) mark_cell(N->items);
+        if (N->sizes) mark_cell(N->sizes);
+        for (i = 0; i < N->n; i++) {
+            if (N->keys) mark_value(L, N->keys[i]);
+            mark_value(L, N->items[i]);
+        }
+        return;
+    }
+    if (val->type == LITH__LAMBDA) {
+        mark_value(L, LAMBDA(val)->params);
+        mark_value(L, LAMBDA(val)->names);
+        mark_value(L, LAMBDA(val)->body);
+        mark_value(L, LAMBDA(val)->code);
+        return;
+    }
+    switch (val->type) {
+    case LITH_TYPE_BUILTIN:
+        mark_cell(val->value.callable);
+        mark_value(L, val->value.callable->name);
+        break;
+    case LITH_TYPE_CLOSURE:
+    case LITH_TYPE_MACRO:
+        f = val->value.callable;
+        mark_cell(f);
+        mark_value(L, f->name);
+        mark_value(L, f->parent);
+        mark_value(L, f->args);
+        mark_value(L, f->body);
+        mark_value(L, f->code);
+        break;
+    case LITH_TYPE_VECTOR:
+        for (i = 0; i < val->value.vector.len; i++)
+            mark_value(L, val->value.vector.items[i]);
+        break;
+    case LITH_TYPE_PMAP:
+    case LITH_TYPE_PVECTOR:
+        mark_value(L, val->value.tree.root);
+        break;
+    case LITH_TYPE_TABLE:
+        T = val->value.table;
+        for (i = 0; i < T->cap; i++) {
+            mark_value(L, T->slots[i].key);
+            mark_value(L, T->slots[i].val);
+        }
+        for (i = 0; T->old && (i < T->oldcap); i++) {
+            mark_value(L, T->old[i].key);
+            mark_value(L, T->old[i].val);
+        }
+        break;
+    default: break;
+    }
+}
+
+/* release what a dead value holds outside of the heap */
+static void finalize_value(lith_value *val)
+{
+    if (val->type == LITH__FRAME) {
+        if (FRAME(val)->slots != FRAME(val)->inline_slots)
+            free(FRAME(val)->slots);
+        return;
+    }
+    if (val->type == LITH__NAMESPACE) {
+        free(NAMESPACE(val)->cells);
+        return;
+    }
+    if (val->type == LITH__CODE) {
+        free(CODE(val)->insns);
+        free(CODE(val)->consts);
+        free(CODE(val)->caches);
+        return;
+    }
+    switch (val->type) {
+    case LITH_TYPE_STRING:
+        free(val->value.string.buf);
+        break;
+    case LITH_TYPE_SYMBOL:
+        free(val->value.symbol.name);
+        break;
+    case LITH_TYPE_VECTOR:
+        free(val->value.vector.items);
+        break;
+    case LITH_TYPE_F64ARRAY:
+        free(val->value.array.items.f64);
+        break;
+    case LITH_TYPE_I64ARRAY:
+        free(val->value.array.items.i64);
+        break;
+    case LITH_TYPE_TABLE:
+        free(val->value.table->slots);
+        free(val->value.table->old);
+        free(val->value.table);
+        break;
+    default: break;
+    }
+}
+
+static void mark_roots(lith_st *L)
+{
+    size_t i;
+    for (i = 0; i < LITH_NFORMS; i++)
+        mark_value(L, L->forms[i]);
+    mark_value(L, L->sym_else);
+    mark_value(L, L->sym_unquote);
+    mark_value(L, L->sym_unquote_splicing);
+    mark_value(L, L->pipeline);
+    mark_value(L, L->global);
+    mark_value(L, L->error_state.expr);
+    for (i = 0; i < L->gc.sp; i++)
+        mark_value(L, L->gc.stack[i]);
+    while (L->gc.ngray > 0)
+        trace_value(L, L->gc.gray[--L->gc.ngray]);
+}
+
+/* forget the unmarked symbols, then put back the others in place:
+ * going around from an empty slot, each one moves at most back to
+ * its first empty slot, and no probe sequence is cut by a new hole
+ */
+static void sweep_symbols(lith_st *L)
+{
+    struct lith_symbol_table *T;
+    struct lith_symbol_slot slot;
+    size_t i, n, start;
+    T = &L->symbols;
+    start = 0;
+    for (i = 0; i < T->cap; i++) {
+        if (!T->slots[i].sym) {
+            start = i;
+        } else if (!is_marked(T->slots[i].sym)) {
+            T->slots[i].sym = NULL;
+            T->count--;
+            start = i;
+        }
+    }
+    for (n = 1; n < T->cap; n++) {
+        i = (start + n) & (T->cap - 1);
+        if (!T->slots[i].sym) continue;
+        slot = T->slots[i];
+        T->slots[i].sym = NULL;
+        *find_slot(T, slot.hash) = slot;
+    }
+}
+
+/* rebuild the free list of the pool in address order,
+ * pages left without live cells go back to the heap
+ */
+static size_t sweep_pool(lith_st *L, struct lith_pool *P)
+{
+    struct lith_page *page, **pp;
+    struct lith_free_cell *cell, **tail, **page_tail;
+    size_t i, live, total, nfree;
+    total = 0;
+    P->nfree = 0;
+    tail = (struct lith_free_cell **) &P->free;
+    pp = &P->pages;
+    while ((page = *pp)) {
+        page_tail = tail;
+        nfree = P->nfree;
+        live = 0;
+        for (i = 0; i < page->ncells; i++) {
+            cell = (struct lith_free_cell *) (page->cells + i * page->size);
+            if (page->marks[i / LITH_WORD_BITS] & (1UL << (i % LITH_WORD_BITS))) {
+                live++;
+                continue;
+            }
+            if (!P->raw && (cell->type != LITH__FREE))
+                finalize_value((lith_value *) cell);
+            cell->type = LITH__FREE;
+            *tail = cell;
+            tail = &cell->next;
+            P->nfree++;
+        }
+        memset(page->marks, 0, sizeof(page->marks));
+        if (live == 0) {
+            tail = page_tail;
+            P->nfree = nfree;
+            *pp = page->next;
+            P->npages--;
+            page->next = L->gc.free_pages;
+            L->gc.free_pages = page;
+            L->gc.nfree_pages++;
+        } else {
+            pp = &page->next;
+        }
+        total += live;
+    }
+    *tail = NULL;
+    return total;
+}
+
+static void sweep(lith_st *L)
+{
+    int raw, i;
+    L->gc.count = sweep_pool(L, &L->gc.pairs);
+    for (raw = 0; raw < 2; raw++)
+        for (i = 0; i < LITH_NCLASSES; i++)
+            L->gc.count += sweep_pool(L, &L->gc.pools[raw][i]);
+}
+
+/* collect only when enough cells were allocated since the last time,
+ * called where every value in use is reachable from the roots
+ */
+static void gc_safepoint(lith_st *L)
+{
+    if (L->gc.count >= L->gc.threshold)
+        lith_collect_garbage(L);
+}
+
+/* the environments:
+ * the namespaces made by lith_new_env, and a frame for each call of a closure
+ */
+
+static void redefine_error(lith_st *L, lith_value *name)
+{
+    L->error = LITH_ERR_REDEFINE;
+    L->error_state.sym = name->value.symbol.name;
+}
+
+static int find_name(lith_value *names, lith_value *name, size_t *slot)
+{
+    size_t i;
+    for (i = 0; !LITH_IS_NIL(names); i++, names = LITH_CDR(names)) {
+        if (LITH_CAR(names) == name) {
+            *slot = i;
+            return 1;
+        }
+    }
+    return 0;
+}
+
+static lith_value *assq(lith_value *alist, lith_value *name)
+{
+    for (; !LITH_IS_NIL(alist); alist = LITH_CDR(alist))
+        if (LITH_CAR(LITH_CAR(alist)) == name)
+            return LITH_CAR(alist);
+    return NULL;
+}
+
+static size_t hash_symbol(lith_value *sym)
+{
+    unsigned long h;
+    h = (unsigned long) (LITH_WORD(sym) >> 3);
+    h ^= h >> 16;
+    h *= 0x45D9F3BUL;
+    h ^= h >> 16;
+    return h;
+}
+
+/* the binding of the name, or the empty place where it would be */
+static lith_value **ns_cell(struct lith_namespace *N, lith_value *name)
+{
+    size_t i;
+    for (i = hash_symbol(name) & (N->cap - 1); N->cells[i];
+         i = (i + 1) & (N->cap - 1))
+        if (LITH_CAR(N->cells[i]) == name) break;
+    return &N->cells[i];
+}
+
+static int grow_namespace(lith_st *L, struct lith_namespace *N)
+{
+    lith_value **cells, **old;
+    size_t i, cap;
+    old = N->cells;
+    cap = N->cap;
+    cells = calloc(2 * cap, sizeof(*cells));
+    if (!cells) {
+        L->error = LITH_ERR_NOMEM;
+        return 0;
+    }
+    N->cells = cells;
+    N->cap = 2 * cap;
+    for (i = 0; i < cap; i++)
+        if (old[i])
+            *ns_cell(N, LITH_CAR(old[i])) = old[i];
+    free(old);
+    return 1;
+}
+
+static void ns_define(lith_st *L, struct lith_namespace *N,
+                      lith_value *name, lith_value *value)
+{
+    lith_value **p, *cell;
+    if ((4 * (N->count + 1) > 3 * N->cap) && !grow_namespace(L, N))
+        return;
+    p = ns_cell(N, name);
+    if (*p) {
+        redefine_error(L, name);
+        return;
+    }
+    cell = LITH_CONS(L, name, value);
+    if (!cell) return;
+    *p = cell;
+    N->count++;
+    L->bindings++;
+}
+
+/* where the name is bound in the environment, NULL if it is not:
+ * a slot not yet defined does not hide the names outside
+ */
+static lith_value **env_find(lith_env *V, lith_value *name)
+{
+    struct lith_frame *F;
+    lith_value *kv;
+    size_t i;
+    while (!LITH_IS_NIL(V)) {
+        if (IS_FRAME(V)) {
+            F = FRAME(V);
+            if (find_name(F->names, name, &i) && F->slots[i])
+                return &F->slots[i];
+            if ((kv = assq(F->extras, name)))
+                return &LITH_CDR(kv);
+            V = F->parent;
+        } else {
+            if ((kv = *ns_cell(NAMESPACE(V), name)))
+                return &LITH_CDR(kv);
+            V = NAMESPACE(V)->parent;
+        }
+    }
+    return NULL;
+}
+
+/* the expansions of the macro calls:
+ * a call is expanded once for each macro it is called with,
+ * the table is weak on the calls: open addressing like the symbol table
+ */
+
+static struct lith_expansion *expansion_slot(struct lith_expansion_table *T,
+                                             lith_value *form)
+{
+    size_t i;
+    for (i = hash_symbol(form) & (T->cap - 1);
+         T->slots[i].form && (T->slots[i].form != form);
+         i = (i + 1) & (T->cap - 1))
+        ;
+    return &T->slots[i];
+}
+
+static lith_value *find_expansion(lith_st *L, lith_value *form, lith_value *macro)
+{
+    struct lith_expansion *slot;
+    if (!L->expansions.cap) return NULL;
+    slot = expansion_slot(&L->expansions, form);
+    return (slot->form && (slot->macro == macro)) ? slot->expansion : NULL;
+}
+
+static int grow_expansions(struct lith_expansion_table *T)
+{
+    struct lith_expansion_table old;
+    size_t i;
+    old = *T;
+    T->cap = old.cap ? (2 * old.cap) : 64;
+    T->slots = calloc(T->cap, sizeof(*T->slots));
+    if (!T->slots) {
+        *T = old;
+        return 0;
+    }
+    for (i = 0; i < old.cap; i++)
+        if (old.slots[i].form)
+            *expansion_slot(T, old.slots[i].form) = old.slots[i];
+    free(old.slots);
+    return 1;
+}
+
+/* without the memory for it, the expansion is not kept */
+static void cache_expansion(lith_st *L, lith_value *form,
+                            lith_value *macro, lith_value *expansion)
+{
+    struct lith_expansion_table *T;
+    struct lith_expansion *slot;
+    T = &L->expansions;
+    if ((4 * (T->count + 1) > 3 * T->cap) && !grow_expansions(T))
+        return;
+    slot = expansion_slot(T, form);
+    if (!slot->form) T->count++;
+    slot->form = form;
+    slot->macro = macro;
+    slot->expansion = expansion;
+}
+
+/* the expansions of the marked calls are marked,
+ * which may mark more calls: until nothing more is marked
+ */
+static void mark_expansions(lith_st *L)
+{
+    struct lith_expansion_table *T;
+    size_t i;
+    int again;
+    T = &L->expansions;
+    do {
+        again = 0;
+        for (i = 0; i < T->cap; i++) {
+            if (!T->slots[i].form || !is_marked(PAIR_CELL(T->slots[i].form)))
+                continue;
+            mark_value(L, T->slots[i].macro);
+            mark_value(L, T->slots[i].expansion);
+            if (L->gc.ngray > 0) again = 1;
+            while (L->gc.ngray > 0)
+                trace_value(L, L->gc.gray[--L->gc.ngray]);
+        }
+    } while (again);
+}
+
+/* forget the unmarked constants, as with the symbols */
+static void sweep_constants(lith_st *L)
+{
+    struct lith_constant_table *T;
+    struct lith_constant_slot slot;
+    size_t i, n, start;
+    lith_value *val;
+    T = &L->constants;
+    start = 0;
+    for (i = 0; i < T->cap; i++) {
+        val = T->slots[i].val;
+        if (!val) {
+            start = i;
+        } else if (!is_marked(LITH_IS(val, LITH_TYPE_PAIR) ? (void *) PAIR_CELL(val) : val)) {
+            T->slots[i].val = NULL;
+            T->count--;
+            start = i;
+        }
+    }
+    for (n = 1; n < T->cap; n++) {
+        i = (start + n) & (T->cap - 1);
+        if (!T->slots[i].val) continue;
+        slot = T->slots[i];
+        T->slots[i].val = NULL;
+        *constant_slot(T, slot.hash, slot.val) = slot;
+    }
+}
+
+/* forget the expansions of the unmarked calls, as with the symbols */
+static void sweep_expansions(lith_st *L)
+{
+    struct lith_expansion_table *T;
+    struct lith_expansion slot;
+    size_t i, n, start;
+    T = &L->expansions;
+    start = 0;
+    for (i = 0; i < T->cap; i++) {
+        if (!T->slots[i].form) {
+            start = i;
+        } else if (!is_marked(PAIR_CELL(T->slots[i].form))) {
+            T->slots[i].form = NULL;
+            T->count--;
+            start = i;
+        }
+    }
+    for (n = 1; n < T->cap; n++) {
+        i = (start + n) & (T->cap - 1);
+        if (!T->slots[i].form) continue;
+        slot = T->slots[i];
+        T->slots[i].form = NULL;
+        *expansion_slot(T, slot.form) = slot;
+    }
+}
+
+/* lexical addressing:
+ * the body of a closure is analyzed when the closure is made,
+ * the references to its arguments, to the variables defined in its body
+ * and to those of the enclosing frames become local references,
+ * the depth of the frame and the slot in it, in the place of the symbols
+ */
+
+#define LOCAL_SLOT_BITS 16
+#define MAKE_LOCAL(depth, slot) \
+    LITH_IMMEDIATE(((size_t) (depth) << LOCAL_SLOT_BITS) | (slot), LITH_TAG_LOCAL)
+#define LOCAL_DEPTH(r) (LITH_WORD(r) >> (LITH_TAG_BITS + LOCAL_SLOT_BITS))
+#define LOCAL_SLOT(r) \
+    ((LITH_WORD(r) >> LITH_TAG_BITS) & (((size_t) 1 << LOCAL_SLOT_BITS) - 1))
+
+static struct lith_frame *local_frame(lith_env *V, lith_value *ref)
+{
+    size_t depth;
+    for (depth = LOCAL_DEPTH(ref); depth; depth--)
+        V = FRAME(V)->parent;
+    return FRAME(V);
+}
+
+static lith_value *slot_name(struct lith_frame *F, size_t slot)
+{
+    lith_value *names;
+    for (names = F->names; slot; slot--)
+        names = LITH_CDR(names);
+    return LITH_CAR(names);
+}
+
+static lith_value *local_name(lith_env *V, lith_value *ref)
+{
+    return slot_name(local_frame(V, ref), LOCAL_SLOT(ref));
+}
+
+/* a variable of a body not yet defined is looked up outside, by name */
+static lith_value *local_get(lith_st *L, lith_env *V, lith_value *ref)
+{
+    struct lith_frame *F;
+    lith_value *val;
+    F = local_frame(V, ref);
+    val = F->slots[LOCAL_SLOT(ref)];
+    if (val) return val;
+    return lith_env_get(L, F->parent, slot_name(F, LOCAL_SLOT(ref)));
+}
+
+static void local_set(lith_st *L, lith_env *V, lith_value *ref, lith_value *val)
+{
+    struct lith_frame *F;
+    F = local_frame(V, ref);
+    if (F->slots[LOCAL_SLOT(ref)])
+        F->slots[LOCAL_SLOT(ref)] = val;
+    else
+        lith_env_set(L, F->parent, slot_name(F, LOCAL_SLOT(ref)), val);
+}
+
+static void local_def(lith_st *L, lith_env *V, lith_value *ref, lith_value *val)
+{
+    struct lith_frame *F;
+    F = local_frame(V, ref);
+    if (F->slots[LOCAL_SLOT(ref)])
+        redefine_error(L, slot_name(F, LOCAL_SLOT(ref)));
+    else
+        F->slots[LOCAL_SLOT(ref)] = val;
+}
+
+/* the code given to a macro which was not known as one
+ * when the body was analyzed gets back its names
+ */
+static lith_value *unresolve(lith_st *L, lith_env *V, lith_value *expr)
+{
+    lith_value *car, *cdr;
+    if (LITH_TAG(expr) == LITH_TAG_LOCAL)
+        return local_name(V, expr);
+    if (!LITH_IS(expr, LITH_TYPE_PAIR))
+        return expr;
+    car = unresolve(L, V, LITH_CAR(expr));
+    if (!car) return NULL;
+    cdr = unresolve(L, V, LITH_CDR(expr));
+    if (!cdr) return NULL;
+    if ((car == LITH_CAR(expr)) && (cdr == LITH_CDR(expr)))
+        return expr;
+    return LITH_CONS(L, car, cdr);
+}
+
+/* the scope of a closure, or of a let inside it, which is up from here */
+struct lith_scope {
+    lith_value *names, **tail;
+    lith_env *parent;
+    struct lith_scope *up;
+    int collect; /* only collect the names defined in the body */
+};
+
+static lith_value *resolve(struct lith_scope *S, lith_value *sym)
+{
+    size_t depth, slot;
+    lith_env *V;
+    for (depth = 0; S->up; depth++, S = S->up)
+        if (find_name(S->names, sym, &slot))
+            return MAKE_LOCAL(depth, slot);
+    if (find_name(S->names, sym, &slot))
+        return MAKE_LOCAL(depth, slot);
+    for (depth++, V = S->parent; IS_FRAME(V); depth++, V = FRAME(V)->parent) {
+        if (assq(FRAME(V)->extras, sym))
+            break;
+        if (find_name(FRAME(V)->names, sym, &slot))
+            return MAKE_LOCAL(depth, slot);
+    }
+    return sym;
+}
+
+static int add_name(lith_st *L, struct lith_scope *S, lith_value *name)
+{
+    lith_value *p;
+    p = LITH_CONS(L, name, L->nil);
+    if (!p) return 0;
+    *S->tail = p;
+    S->tail = &LITH_CDR(p);
+    return 1;
+}
+
+static lith_value *analyze(lith_st *, struct lith_scope *, lith_value *);
+static lith_value *make_proto(lith_st *, struct lith_scope *, lith_value *);
+
+/* whether evaluating the expression may define a variable in its frame:
+ * by a def, a macro or an eval! expression, or by a call of a macro
+ */
+static int may_define(struct lith_scope *S, lith_value *expr)
+{
+    lith_value *f, **p;
+    if (!LITH_IS(expr, LITH_TYPE_PAIR)) return 0;
+    f = LITH_CAR(expr);
+    if (LITH_IS(f, LITH_TYPE_SYMBOL)) {
+        switch (f->value.symbol.form) {
+        case LITH_FORM_QUOTE:
+        case LITH_FORM_LAMBDA:
+            return 0;
+        case LITH_FORM_DEF:
+        case LITH_FORM_MACRO:
+        case LITH_FORM_EVAL:
+            return 1;
+        case LITH_FORM_NONE:
+            if ((resolve(S, f) == f) && (p = env_find(S->parent, f))
+            && LITH_IS(*p, LITH_TYPE_MACRO)) return 1;
+            break;
+        default: break;
+        }
+    }
+    for (; LITH_IS(expr, LITH_TYPE_PAIR); expr = LITH_CDR(expr))
+        if (may_define(S, LITH_CAR(expr))) return 1;
+    return 0;
+}
+
+/* the pairs which do not change are shared with the original */
+static lith_value *analyze_list(lith_st *L, struct lith_scope *S, lith_value *list)
+{
+    lith_value *car, *cdr;
+    if (!LITH_IS(list, LITH_TYPE_PAIR))
+        return list;
+    car = analyze(L, S, LITH_CAR(list));
+    if (!car) return NULL;
+    cdr = analyze_list(L, S, LITH_CDR(list));
+    if (!cdr) return NULL;
+    if (S->collect || ((car == LITH_CAR(list)) && (cdr == LITH_CDR(list))))
+        return list;
+    return LITH_CONS(L, car, cdr);
+}
+
+static lith_value *list2(lith_st *L, lith_value *a, lith_value *b)
+{
+    lith_value *p;
+    p = LITH_CONS(L, b, L->nil);
+    return p ? LITH_CONS(L, a, p) : NULL;
+}
+
+static lith_value *list4(lith_st *L, lith_value *a, lith_value *b,
+                         lith_value *c, lith_value *d)
+{
+    lith_value *p;
+    p = list2(L, c, d);
+    if (p) p = LITH_CONS(L, b, p);
+    return p ? LITH_CONS(L, a, p) : NULL;
+}
+
+/* the let and begin expressions become (let 'names values . body):
+ * a frame with the names, those of the let then those defined in the body,
+ * with the values in its first slots, or no frame when the names are #f
+ */
+static lith_value *analyze_block(lith_st *L, struct lith_scope *S,
+                                 lith_value *expr)
+{
+    struct lith_scope T;
+    lith_value *bindings, *body, *vals, *p, *q, **tail;
+    size_t slot;
+    if (LITH_CAR(expr) == L->forms[LITH_FORM_BEGIN]) {
+        bindings = L->nil;
+        body = LITH_CDR(expr);
+    } else {
+        if (list_length(LITH_CDR(expr)) < 2) return expr;
+        bindings = LITH_CAR(LITH_CDR(expr));
+        body = LITH_CDR(LITH_CDR(expr));
+        if (!is_list(bindings)) return expr;
+    }
+    if (LITH_IS_NIL(body)) return expr;
+    T.names = L->nil;
+    T.tail = &T.names;
+    T.parent = S->parent;
+    T.up = S;
+    T.collect = 1;
+    for (p = bindings; !LITH_IS_NIL(p); p = LITH_CDR(p)) {
+        q = LITH_CAR(p);
+        if (!LITH_IS(q, LITH_TYPE_PAIR) || !is_proper_list(q)
+        || (list_length(q) != 2) || !LITH_IS(LITH_CAR(q), LITH_TYPE_SYMBOL)
+        || find_name(T.names, LITH_CAR(q), &slot)) return expr;
+        if (!add_name(L, &T, LITH_CAR(q))) return NULL;
+        if (!analyze(L, S, LITH_CAR(LITH_CDR(q)))) return NULL;
+    }
+    if (S->collect) return expr;
+    if (!analyze_list(L, &T, body)) return NULL;
+    if (LITH_IS_NIL(T.names) && !may_define(S, body)) {
+        body = analyze_list(L, S, body);
+        T.names = L->False;
+    } else {
+        T.collect = 0;
+        body = analyze_list(L, &T, body);
+    }
+    if (!body) return NULL;
+    vals = L->nil;
+    tail = &vals;
+    for (p = bindings; !LITH_IS_NIL(p); p = LITH_CDR(p)) {
+        q = analyze(L, S, LITH_CAR(LITH_CDR(LITH_CAR(p))));
+        if (!q || !(*tail = LITH_CONS(L, q, L->nil))) return NULL;
+        tail = &LITH_CDR(*tail);
+    }
+    p = list2(L, L->forms[LITH_FORM_QUOTE], T.names);
+    if (!p || !(body = LITH_CONS(L, vals, body))
+    || !(p = LITH_CONS(L, p, body))) return NULL;
+    return LITH_CONS(L, L->forms[LITH_FORM_LET], p);
+}
+
+/* (cond (test . body) ...) becomes (if test (begin . body) (cond ...)),
+ * (and a . rest) (if a (and . rest) #f) and (or a . rest) (if a #t (or . rest))
+ */
+static lith_value *analyze_test(lith_st *L, struct lith_scope *S,
+                                lith_value *expr)
+{
+    lith_value *f, *rest, *test, *then, *other;
+    f = LITH_CAR(expr);
+    rest = LITH_CDR(expr);
+    if (LITH_IS_NIL(rest)) {
+        if (f == L->forms[LITH_FORM_COND]) return expr;
+        return LITH_IN_BOOL(f == L->forms[LITH_FORM_AND]);
+    }
+    test = LITH_CAR(rest);
+    if (f == L->forms[LITH_FORM_COND]) {
+        if (!LITH_IS(test, LITH_TYPE_PAIR) || !is_proper_list(test))
+            return expr;
+        then = LITH_CONS(L, L->forms[LITH_FORM_BEGIN], LITH_CDR(test));
+        if (!then) return NULL;
+        if (LITH_CAR(test) == L->sym_else)
+            return analyze(L, S, then);
+        test = LITH_CAR(test);
+    } else {
+        then = f == L->forms[LITH_FORM_AND]
+            ? LITH_CONS(L, f, LITH_CDR(rest)) : L->True;
+    }
+    other = (f == L->forms[LITH_FORM_AND])
+        ? L->False : LITH_CONS(L, f, LITH_CDR(rest));
+    if (!then || !other) return NULL;
+    if (!(test = analyze(L, S, test)) || !(then = analyze(L, S, then))
+    || !(other = analyze(L, S, other))) return NULL;
+    return list4(L, L->forms[LITH_FORM_IF], test, then, other);
+}
+
+/* the unquoted expressions of a quasiquote template */
+static lith_value *analyze_template(lith_st *L, struct lith_scope *S,
+                                    lith_value *x)
+{
+    lith_value *a, *d;
+    if (!LITH_IS(x, LITH_TYPE_PAIR))
+        return x;
+    a = LITH_CAR(x);
+    if ((a == L->sym_unquote) && is_proper_list(x) && (list_length(x) == 2)) {
+        d = analyze(L, S, LITH_CAR(LITH_CDR(x)));
+        if (!d) return NULL;
+        return (d == LITH_CAR(LITH_CDR(x))) ? x : list2(L, a, d);
+    }
+    if (LITH_IS(a, LITH_TYPE_PAIR) && (LITH_CAR(a) == L->sym_unquote_splicing)
+    && is_proper_list(a) && (list_length(a) == 2)) {
+        d = analyze(L, S, LITH_CAR(LITH_CDR(a)));
+        if (d && (d != LITH_CAR(LITH_CDR(a))))
+            d = list2(L, LITH_CAR(a), d);
+        else if (d)
+            d = a;
+        a = d;
+    } else {
+        a = analyze_template(L, S, a);
+    }
+    if (!a) return NULL;
+    d = analyze_template(L, S, LITH_CDR(x));
+    if (!d) return NULL;
+    if ((a == LITH_CAR(x)) && (d == LITH_CDR(x)))
+        return x;
+    return LITH_CONS(L, a, d);
+}
+
+/* the quoted data, the bodies of lambda and macro expressions
+ * and the arguments of macros are left as they are
+ */
+static lith_value *analyze(lith_st *L, struct lith_scope *S, lith_value *expr)
+{
+    size_t slot;
+    lith_value *f, *rest, *sym, *val, **p;
+    if (LITH_IS(expr, LITH_TYPE_SYMBOL))
+        return S->collect ? expr : resolve(S, expr);
+    if (!LITH_IS(expr, LITH_TYPE_PAIR) || !is_proper_list(expr))
+        return expr;
+    f = LITH_CAR(expr);
+    rest = LITH_CDR(expr);
+    if (!LITH_IS(f, LITH_TYPE_SYMBOL))
+        return analyze_list(L, S, expr);
+    switch (f->value.symbol.form) {
+    case LITH_FORM_QUOTE:
+    case LITH_FORM_MACRO:
+        return expr;
+    case LITH_FORM_LAMBDA:
+        /* compiled closures make it ready when they are compiled */
+        if (!L->walk || S->collect) return expr;
+        val = make_proto(L, S, expr);
+        if (!val || (val == expr)) return val;
+        return list2(L, f, val);
+    case LITH_FORM_DEF:
+    case LITH_FORM_SET:
+        sym = LITH_CAR(rest);
+        if ((list_length(rest) != 2) || !LITH_IS(sym, LITH_TYPE_SYMBOL))
+            return expr;
+        if (S->collect) {
+            if ((f->value.symbol.form == LITH_FORM_DEF)
+            && !find_name(S->names, sym, &slot) && !add_name(L, S, sym))
+                return NULL;
+            return analyze_list(L, S, LITH_CDR(rest)) ? expr : NULL;
+        }
+        val = analyze_list(L, S, LITH_CDR(rest));
+        if (!val) return NULL;
+        if (f->value.symbol.form == LITH_FORM_DEF)
+            sym = find_name(S->names, sym, &slot) ? MAKE_LOCAL(0, slot) : sym;
+        else
+            sym = resolve(S, sym);
+        rest = LITH_CONS(L, sym, val);
+        break;
+    case LITH_FORM_LET:
+    case LITH_FORM_BEGIN:
+        return analyze_block(L, S, expr);
+    case LITH_FORM_COND:
+    case LITH_FORM_AND:
+    case LITH_FORM_OR:
+        return analyze_test(L, S, expr);
+    case LITH_FORM_QUASIQUOTE:
+        if (list_length(rest) != 1) return expr;
+        val = analyze_template(L, S, LITH_CAR(rest));
+        if (!val || (val == LITH_CAR(rest))) return val ? expr : NULL;
+        return list2(L, f, val);
+    case LITH_FORM_IF:
+    case LITH_FORM_EVAL:
+        if (list_length(rest) != ((f->value.symbol.form == LITH_FORM_IF) ? 3 : 1))
+            return expr;
+        val = analyze_list(L, S, rest);
+        if (!val || S->collect || (val == rest)) return val ? expr : NULL;
+        rest = val;
+        break;
+    default:
+        if ((resolve(S, f) == f) && (p = env_find(S->parent, f))
+        && LITH_IS(*p, LITH_TYPE_MACRO))
+            return expr;
+        return analyze_list(L, S, expr);
+    }
+    if (!rest) return NULL;
+    return LITH_CONS(L, f, rest);
+}
+
+static lith_value *apply(lith_st *, lith_value *, lith_value *);
+static lith_value *call(lith_st *, lith_value *, size_t, lith_value **);
+static lith_callable *check_call(lith_st *, lith_value *, size_t, lith_value **);
+
+/* the compiler:
+ * the analyzed body of a closure becomes the bytecode of a stack machine,
+ * the calls of the macros known at this time are expanded,
+ * what is not compiled is left to the evaluator with OP_EVAL
+ */
+
+enum lith_op {
+    OP_CONST,       /* k: push the constant k */
+    OP_LOCAL0,      /* s: push the slot s of the frame */
+    OP_LOCAL,       /* d s: push the slot s of the frame d levels up */
+    OP_GLOBAL,      /* k: push the value of the symbol k, found by name */
+    OP_DEFLOCAL,    /* s: define the slot s as the value on top */
+    OP_DEFGLOBAL,   /* k: define the symbol k as the value on top */
+    OP_SETLOCAL,    /* d s: set the slot s of the frame d levels up */
+    OP_SETGLOBAL,   /* k: set the symbol k */
+    OP_POP,
+    OP_JUMP,        /* a: go to a */
+    OP_JUMPF,       /* a: pop, go to a if it is false */
+    OP_GUARD,       /* k a: pop, go to a unless it is the constant k */
+    OP_MACRO,       /* k a: if the callee on top is a macro, expand the
+                     * call k with it, evaluate the expansion, go to a */
+    OP_CALL,        /* n: call the callee under the n arguments on top */
+    OP_TAILCALL,    /* n: call it in place of the running closure */
+    OP_CLOSURE,     /* k: make a closure of the lambda expression k */
+    OP_EVAL,        /* k: evaluate the expression k */
+    OP_ENTER,       /* k n: a frame with the names k, and the n values on top
+                     * in its first slots, becomes the running frame */
+    OP_LEAVE,       /* the parent of the running frame becomes the running one */
+    OP_CONS,        /* a pair of the two values on top */
+    OP_APPEND,      /* a copy of the list under the value on top, ending with it */
+    OP_CELL,        /* k: push the value of the binding k */
+    OP_TEMP,        /* i: push the value i places above the bottom of the stack */
+    OP_SLIDE,       /* n: drop the n values under the value on top */
+    /* made of calls as they run, never by the compiler */
+    OP_CALLX,       /* n: a call which is not made faster */
+    OP_TAILCALLX,   /* n: the same in tail position */
+    OP_FIXNUM2,     /* k: the numeric builtin k called on two fixnums */
+    OP_FLONUM2,     /* k: the same on two floats */
+    OP_RETURN,
+
+    OP_NOPS
+};
+
+static char *op_names[OP_NOPS] = {
+    "const", "local0", "local", "global", "deflocal", "defglobal",
+    "setlocal", "setglobal", "pop", "jump", "jumpf", "guard", "macro", "call",
+    "tailcall", "closure", "eval", "enter", "leave", "cons", "append", "cell",
+    "temp", "slide", "callx", "tailcallx", "fixnum2", "flonum2", "return"
+};
+
+static int op_nargs[OP_NOPS] = {
+    1, 1, 2, 1, 1, 1, 2, 1, 0, 1, 1, 2, 2, 1, 1, 1, 1, 2, 0, 0, 0, 1, 1, 1,
+    1, 1, 1, 1, 0
+};
+
+/* whether the first operand of the op is a constant */
+#define OP_HAS_CONST(op) \
+    (((op) == OP_CONST) || ((op) == OP_GLOBAL) || ((op) == OP_DEFGLOBAL) \
+    || ((op) == OP_SETGLOBAL) || ((op) == OP_MACRO) || ((op) == OP_CLOSURE) \
+    || ((op) == OP_EVAL) || ((op) == OP_ENTER) || ((op) == OP_CELL) \
+    || ((op) == OP_GUARD))
+
+struct lith_inline;
+
+/* the body of an inlined closure is compiled with in set */
+struct lith_compiler {
+    struct lith_scope *S;
+    struct lith_code *code;
+    long depth;
+    int optimize;
+    struct lith_inline *in;
+};
+
+static int emit(lith_st *L, struct lith_compiler *C, unsigned int word)
+{
+    struct lith_code *code;
+    unsigned int *insns;
+    size_t cap;
+    code = C->code;
+    if (code->ninsns == code->cap) {
+        cap = code->cap ? (2 * code->cap) : 32;
+        insns = realloc(code->insns, cap * sizeof(*insns));
+        if (!insns) {
+            L->error = LITH_ERR_NOMEM;
+            return 0;
+        }
+        code->insns = insns;
+        code->cap = cap;
+    }
+    code->insns[code->ninsns++] = word;
+    return 1;
+}
+
+/* emit the op with its operands, which change the stack by the effect */
+static int emit_op(lith_st *L, struct lith_compiler *C, int op,
+                   unsigned int a, unsigned int b, int effect)
+{
+    if (!emit(L, C, op)) return 0;
+    if ((op_nargs[op] > 0) && !emit(L, C, a)) return 0;
+    if ((op_nargs[op] > 1) && !emit(L, C, b)) return 0;
+    C->depth += effect;
+    if (C->depth > (long) C->code->maxstack)
+        C->code->maxstack = C->depth;
+    return 1;
+}
+
+static long add_const(lith_st *L, struct lith_compiler *C, lith_value *val)
+{
+    struct lith_code *code;
+    lith_value **consts;
+    size_t i, cap;
+    code = C->code;
+    for (i = 0; i < code->nconsts; i++)
+        if (code->consts[i] == val) return i;
+    if (code->nconsts == code->constcap) {
+        cap = code->constcap ? (2 * code->constcap) : 8;
+        consts = realloc(code->consts, cap * sizeof(*consts));
+        if (!consts) {
+            L->error = LITH_ERR_NOMEM;
+            return -1;
+        }
+        code->consts = consts;
+        code->constcap = cap;
+    }
+    code->consts[code->nconsts] = val;
+    return code->nconsts++;
+}
+
+static int emit_const_op(lith_st *L, struct lith_compiler *C, int op,
+                         lith_value *val, unsigned int b, int effect)
+{
+    long k;
+    k = add_const(L, C, val);
+    if (k < 0) return 0;
+    return emit_op(L, C, op, k, b, effect);
+}
+
+static int has_locals(lith_value *expr)
+{
+    for (; LITH_IS(expr, LITH_TYPE_PAIR); expr = LITH_CDR(expr))
+        if (has_locals(LITH_CAR(expr))) return 1;
+    return LITH_TAG(expr) == LITH_TAG_LOCAL;
+}
+
+static int compile_expr(lith_st *, struct lith_compiler *, lith_value *, int);
+
+/* the expressions one after the other, the value is that of the last one */
+static int compile_body(lith_st *L, struct lith_compiler *C,
+                        lith_value *body, int tail)
+{
+    if (LITH_IS_NIL(body))
+        return emit_const_op(L, C, OP_CONST, L->nil, 0, 1);
+    for (; !LITH_IS_NIL(LITH_CDR(body)); body = LITH_CDR(body))
+        if (!compile_expr(L, C, LITH_CAR(body), 0)
+        || !emit_op(L, C, OP_POP, 0, 0, -1)) return 0;
+    return compile_expr(L, C, LITH_CAR(body), tail);
+}
+
+/* the rest of a let expression made by analyze_block:
+ * no more values than names, no values without a frame
+ */
+static int is_block(lith_st *L, lith_value *rest)
+{
+    lith_value *names, *vals;
+    if ((list_length(rest) < 3) || !LITH_IS(LITH_CAR(rest), LITH_TYPE_PAIR))
+        return 0;
+    names = LITH_CAR(rest);
+    if ((LITH_CAR(names) != L->forms[LITH_FORM_QUOTE])
+    || !is_proper_list(names) || (list_length(names) != 2)) return 0;
+    names = LITH_CAR(LITH_CDR(names));
+    vals = LITH_CAR(LITH_CDR(rest));
+    if (!is_list(vals)) return 0;
+    if (names == L->False) return LITH_IS_NIL(vals);
+    return is_list(names) && (list_length(vals) <= list_length(names));
+}
+
+static int has_unquote(lith_st *L, lith_value *x)
+{
+    for (; LITH_IS(x, LITH_TYPE_PAIR); x = LITH_CDR(x))
+        if (has_unquote(L, LITH_CAR(x))) return 1;
+    return (x == L->sym_unquote) || (x == L->sym_unquote_splicing);
+}
+
+/* the parts of a template without unquote are constants, shared by all
+ * the values made from it, a malformed unquote is left to the evaluator
+ */
+static int compile_template(lith_st *L, struct lith_compiler *C, lith_value *x)
+{
+    lith_value *a;
+    if (!LITH_IS(x, LITH_TYPE_PAIR) || !has_unquote(L, x))
+        return emit_const_op(L, C, OP_CONST, x, 0, 1);
+    a = LITH_CAR(x);
+    if (a == L->sym_unquote) {
+        if (is_proper_list(x) && (list_length(x) == 2))
+            return compile_expr(L, C, LITH_CAR(LITH_CDR(x)), 0);
+    } else if (LITH_IS(a, LITH_TYPE_PAIR) && (LITH_CAR(a) == L->sym_unquote_splicing)) {
+        if (is_proper_list(a) && (list_length(a) == 2))
+            return compile_expr(L, C, LITH_CAR(LITH_CDR(a)), 0)
+                && compile_template(L, C, LITH_CDR(x))
+                && emit_op(L, C, OP_APPEND, 0, 0, -1);
+    } else {
+        return compile_template(L, C, a)
+            && compile_template(L, C, LITH_CDR(x))
+            && emit_op(L, C, OP_CONS, 0, 0, -1);
+    }
+    a = list2(L, L->forms[LITH_FORM_QUASIQUOTE], x);
+    return a && emit_const_op(L, C, OP_EVAL, a, 0, 1);
+}
+
+/* a call of what the head is when it is run: a macro found then is
+ * expanded and evaluated in place of the call */
+static int compile_call(lith_st *L, struct lith_compiler *C,
+                        lith_value *expr, int tail)
+{
+    lith_value *rest;
+    size_t n, jump;
+    n = list_length(LITH_CDR(expr));
+    /* what an inlined body calls is known not to be a macro */
+    if (!compile_expr(L, C, LITH_CAR(expr), 0)
+    || (!C->in && !emit_const_op(L, C, OP_MACRO, expr, 0, 0))) return 0;
+    jump = C->code->ninsns - 1;
+    for (rest = LITH_CDR(expr); !LITH_IS_NIL(rest); rest = LITH_CDR(rest))
+        if (!compile_expr(L, C, LITH_CAR(rest), 0)) return 0;
+    if (!emit_op(L, C, tail ? OP_TAILCALL : OP_CALL, n, 0, -(long) n))
+        return 0;
+    if (!C->in)
+        C->code->insns[jump] = C->code->ninsns;
+    return 1;
+}
+
+/* a failed expansion is done again, and fails again, when it is evaluated */
+static int compile_expansion(lith_st *L, struct lith_compiler *C,
+                             lith_value *macro, lith_value *expr, int tail)
+{
+    size_t sp;
+    lith_value *val;
+    int ok;
+    sp = L->gc.sp;
+    if (!(val = find_expansion(L, expr, macro))) {
+        val = apply(L, macro, LITH_CDR(expr));
+        if (!val) {
+            lith_clear_error_state(L);
+            return emit_const_op(L, C, OP_EVAL, expr, 0, 1);
+        }
+        cache_expansion(L, expr, macro, val);
+    }
+    ok = push_root(L, val)
+        && (val = analyze(L, C->S, val)) && push_root(L, val)
+        && compile_expr(L, C, val, tail);
+    L->gc.sp = sp;
+    return ok;
+}
+
+/* the expansion of a call of the macro bound to its head while compiling,
+ * guarded by that binding: once the name is bound to something else,
+ * the call is made, or expanded again, as it is run
+ */
+static int compile_macro_call(lith_st *L, struct lith_compiler *C,
+                              lith_value *macro, lith_value *expr, int tail)
+{
+    size_t guard, next;
+    if (!compile_expr(L, C, LITH_CAR(expr), 0)
+    || !emit_const_op(L, C, OP_GUARD, macro, 0, -1)) return 0;
+    guard = C->code->ninsns - 1;
+    if (!compile_expansion(L, C, macro, expr, tail)
+    || !emit_op(L, C, OP_JUMP, 0, 0, -1)) return 0;
+    next = C->code->ninsns - 1;
+    C->code->insns[guard] = C->code->ninsns;
+    if (!compile_call(L, C, expr, tail)) return 0;
+    C->code->insns[next] = C->code->ninsns;
+    return 1;
+}
+
+/* the optimizer, when optimize is set:
+ * the calls of the pure builtins on constants are folded, so are the tests
+ * of if known while compiling, and the calls of small global closures are
+ * replaced by their bodies: what this assumes of the global bindings is
+ * checked by guards, which go to the code compiled without the assumptions
+ */
+
+#define LITH_MAX_GUARDS 8
+#define LITH_INLINE_ARGS 8
+#define LITH_INLINE_SIZE 24
+#define LITH_INLINE_DEPTH 4
+
+/* the builtins without effects, whose calls on constants are folded */
+static lith_builtin_argv_function pure_builtins[] = {
+    builtin__car, builtin__cdr, builtin__typeof,
+    builtin__add, builtin__subtract, builtin__multiply, builtin__divide,
+    builtin__modulus, builtin__is_less_than, builtin__is_num_equal,
+    builtin__is_greater_than, builtin__sum, builtin__difference,
+    builtin__product, builtin__quotient, builtin__less, builtin__greater,
+    builtin__num_equal, builtin__less_or_equal, builtin__greater_or_equal,
+    builtin__is_eq, builtin__is_equal, builtin__is_nil, builtin__is_list, NULL
+};
+
+/* an inlined call: the callee, the namespace its body is in,
+ * the arguments known while compiling, and where the others are
+ * on the stack */
+struct lith_inline {
+    struct lith_inline *outer;
+    lith_value *callee;
+    lith_env *env;
+    lith_value *consts[LITH_INLINE_ARGS];
+    long temps[LITH_INLINE_ARGS];
+};
+
+struct lith_guards {
+    size_t n;
+    lith_value *names[LITH_MAX_GUARDS], *vals[LITH_MAX_GUARDS];
+    size_t jumps[LITH_MAX_GUARDS];
+};
+
+static int is_pure(lith_value *f)
+{
+    lith_builtin_argv_function *p;
+    if (!LITH_IS(f, LITH_TYPE_BUILTIN) || !f->value.callable->argv_function)
+        return 0;
+    for (p = pure_builtins; *p; p++)
+        if (*p == f->value.callable->argv_function) return 1;
+    return 0;
+}
+
+/* the binding of the name in the first namespace of the environment:
+ * no other binding can come to hide it */
+static lith_value *ns_binding(lith_env *V, lith_value *name)
+{
+    if (LITH_IS_NIL(V) || IS_FRAME(V)) return NULL;
+    return *ns_cell(NAMESPACE(V), name);
+}
+
+/* the value of the global while compiling, NULL if it is not bound */
+static lith_value *global_value(struct lith_compiler *C, lith_value *name)
+{
+    lith_value **p, *kv;
+    if (C->in) {
+        kv = ns_binding(C->in->env, name);
+        return kv ? LITH_CDR(kv) : NULL;
+    }
+    p = env_find(C->S->parent, name);
+    return p ? *p : NULL;
+}
+
+static int add_guard(struct lith_guards *G, lith_value *name, lith_value *val)
+{
+    size_t i;
+    for (i = 0; i < G->n; i++)
+        if (G->names[i] == name) return 1;
+    if (G->n == LITH_MAX_GUARDS) return 0;
+    G->names[G->n] = name;
+    G->vals[G->n++] = val;
+    return 1;
+}
+
+/* the value of the expression when it is known while compiling:
+ * the guards of the builtins called to find it are added to G,
+ * an error of such a call is left to be raised when running
+ */
+static int fold(lith_st *L, struct lith_compiler *C, lith_value *expr,
+                lith_value **val, struct lith_guards *G)
+{
+    lith_value *name, *f, *rest, *args[LITH_INLINE_ARGS];
+    size_t n;
+    if (LITH_TAG(expr) == LITH_TAG_LOCAL) {
+        if (!C->in || !C->in->consts[LOCAL_SLOT(expr)]) return 0;
+        *val = C->in->consts[LOCAL_SLOT(expr)];
+        return 1;
+    }
+    if (LITH_IS(expr, LITH_TYPE_SYMBOL)) return 0;
+    if (!LITH_IS(expr, LITH_TYPE_PAIR)) {
+        *val = expr;
+        return 1;
+    }
+    if (!is_proper_list(expr)) return 0;
+    name = LITH_CAR(expr);
+    rest = LITH_CDR(expr);
+    if (name == L->forms[LITH_FORM_QUOTE]) {
+        if (list_length(rest) != 1) return 0;
+        *val = LITH_CAR(rest);
+        return 1;
+    }
+    if (!LITH_IS(name, LITH_TYPE_SYMBOL) || name->value.symbol.form
+    || !(f = global_value(C, name)) || !is_pure(f)) return 0;
+    for (n = 0; !LITH_IS_NIL(rest); n++, rest = LITH_CDR(rest))
+        if ((n == LITH_INLINE_ARGS) || !fold(L, C, LITH_CAR(rest), &args[n], G))
+            return 0;
+    if (!add_guard(G, name, f)) return 0;
+    if (check_call(L, f, n, args)
+    && (*val = (*f->value.callable->argv_function)(L, n, args)))
+        return 1;
+    if (L->error != LITH_ERR_NOMEM)
+        lith_clear_error_state(L);
+    return 0;
+}
+
+/* whether the body of a closure can be inlined: made of constants,
+ * the arguments, the globals of its namespace, calls and if
+ */
+static int inlinable(lith_env *V, lith_value *x, size_t *size)
+{
+    lith_value *f, *kv;
+    if (++*size > LITH_INLINE_SIZE) return 0;
+    if (LITH_TAG(x) == LITH_TAG_LOCAL) return LOCAL_DEPTH(x) == 0;
+    if (LITH_IS(x, LITH_TYPE_SYMBOL)) return ns_binding(V, x) != NULL;
+    if (!LITH_IS(x, LITH_TYPE_PAIR)) return 1;
+    if (!is_proper_list(x)) return 0;
+    f = LITH_CAR(x);
+    if (LITH_IS(f, LITH_TYPE_SYMBOL)) {
+        switch (f->value.symbol.form) {
+        case LITH_FORM_QUOTE:
+            return list_length(x) == 2;
+        case LITH_FORM_IF:
+            if (list_length(x) != 4) return 0;
+            x = LITH_CDR(x);
+            break;
+        case LITH_FORM_NONE:
+            if (!(kv = ns_binding(V, f)) || LITH_IS(LITH_CDR(kv), LITH_TYPE_MACRO))
+                return 0;
+            break;
+        default:
+            return 0;
+        }
+    }
+    for (; !LITH_IS_NIL(x); x = LITH_CDR(x))
+        if (!inlinable(V, LITH_CAR(x), size)) return 0;
+    return 1;
+}
+
+/* a closure made in a namespace, which takes exactly the n arguments,
+ * defines nothing and whose body is one small expression,
+ * and which is not already being inlined
+ */
+static int inlinable_closure(struct lith_compiler *C, lith_value *f, size_t n)
+{
+    lith_callable *fn;
+    struct lith_inline *in;
+    size_t depth, size;
+    if (!LITH_IS(f, LITH_TYPE_CLOSURE)) return 0;
+    fn = f->value.callable;
+    if (!fn->exact || (fn->expect != n) || (fn->nslots != n)
+    || (n > LITH_INLINE_ARGS) || !LITH_IS(fn->body, LITH_TYPE_PAIR)
+    || !LITH_IS_NIL(LITH_CDR(fn->body))) return 0;
+    for (depth = 0, in = C->in; in; depth++, in = in->outer)
+        if (in->callee == f) return 0;
+    size = 0;
+    return (depth < LITH_INLINE_DEPTH) && inlinable(fn->parent, LITH_CAR(fn->body), &size);
+}
+
+static int emit_guards(lith_st *L, struct lith_compiler *C, struct lith_guards *G)
+{
+    size_t i;
+    for (i = 0; i < G->n; i++) {
+        if (!compile_expr(L, C, G->names[i], 0)
+        || !emit_const_op(L, C, OP_GUARD, G->vals[i], 0, -1)) return 0;
+        G->jumps[i] = C->code->ninsns - 1;
+    }
+    return 1;
+}
+
+/* after the code made with the guards, the code made without them */
+static int compile_unguarded(lith_st *L, struct lith_compiler *C,
+                             struct lith_guards *G, lith_value *expr, int tail)
+{
+    size_t i, next;
+    int ok;
+    if (!emit_op(L, C, OP_JUMP, 0, 0, -1)) return 0;
+    next = C->code->ninsns - 1;
+    for (i = 0; i < G->n; i++)
+        C->code->insns[G->jumps[i]] = C->code->ninsns;
+    C->optimize = 0;
+    ok = compile_expr(L, C, expr, tail);
+    C->optimize = 1;
+    C->code->insns[next] = C->code->ninsns;
+    return ok;
+}
+
+/* the body of the callee in place of the call: the arguments not known
+ * while compiling are left on the stack, under the value of the body;
+ * those known are kept on the eval stack, since expanding a macro in
+ * the other arguments may collect garbage
+ */
+static int compile_inline(lith_st *L, struct lith_compiler *C,
+                          lith_value *expr, lith_value *f, int tail)
+{
+    struct lith_inline I;
+    struct lith_guards G, A;
+    lith_value *rest;
+    long start;
+    size_t i, sp;
+    int ok;
+    G.n = 0;
+    if (!add_guard(&G, LITH_CAR(expr), f) || !emit_guards(L, C, &G)) return 0;
+    I.outer = C->in;
+    I.callee = f;
+    I.env = f->value.callable->parent;
+    start = C->depth;
+    sp = L->gc.sp;
+    ok = 1;
+    for (i = 0, rest = LITH_CDR(expr); ok && !LITH_IS_NIL(rest); i++, rest = LITH_CDR(rest)) {
+        A.n = 0;
+        if (fold(L, C, LITH_CAR(rest), &I.consts[i], &A) && !A.n) {
+            ok = push_root(L, I.consts[i]);
+            continue;
+        }
+        I.consts[i] = NULL;
+        I.temps[i] = C->depth;
+        ok = !LITH_IS_ERR(L) && compile_expr(L, C, LITH_CAR(rest), 0);
+    }
+    if (ok) {
+        C->in = &I;
+        ok = compile_expr(L, C, LITH_CAR(f->value.callable->body), tail);
+        C->in = I.outer;
+    }
+    L->gc.sp = sp;
+    if (!ok) return 0;
+    if ((C->depth > start + 1)
+    && !emit_op(L, C, OP_SLIDE, C->depth - start - 1, 0, start + 1 - C->depth))
+        return 0;
+    return compile_unguarded(L, C, &G, expr, tail);
+}
+
+static int stage_of(lith_value *f)
+{
+    lith_builtin_argv_function fn;
+    if (!LITH_IS(f, LITH_TYPE_BUILTIN)) return -1;
+    fn = f->value.callable->argv_function;
+    if (fn == builtin__range) return STAGE_RANGE;
+    if (fn == builtin__map) return STAGE_MAP;
+    if (fn == builtin__filter) return STAGE_FILTER;
+    if (fn == builtin__foldl) return STAGE_FOLDL;
+    return -1;
+}
+
+static int is_param(lith_value *params, lith_value *name)
+{
+    for (; LITH_IS(params, LITH_TYPE_PAIR); params = LITH_CDR(params))
+        if (LITH_CAR(params) == name) return 1;
+    return params == name;
+}
+
+/* whether the body of a lambda expression calls only the pure builtins,
+ * through globals which the guards added to G check */
+static int pure_body(lith_st *L, struct lith_compiler *C, lith_value *params,
+                     lith_value *x, struct lith_guards *G)
+{
+    lith_value *f, *g;
+    if (!LITH_IS(x, LITH_TYPE_PAIR)) return 1;
+    if (!is_proper_list(x) || !LITH_IS(f = LITH_CAR(x), LITH_TYPE_SYMBOL)) return 0;
+    switch (f->value.symbol.form) {
+    case LITH_FORM_QUOTE:
+        return 1;
+    case LITH_FORM_IF:
+        if ((list_length(x) != 3) && (list_length(x) != 4)) return 0;
+        break;
+    case LITH_FORM_NONE:
+        if (is_param(params, f) || (resolve(C->S, f) != f)
+        || !(g = global_value(C, f)) || !is_pure(g) || !add_guard(G, f, g))
+            return 0;
+        break;
+    default:
+        return 0;
+    }
+    for (x = LITH_CDR(x); !LITH_IS_NIL(x); x = LITH_CDR(x))
+        if (!pure_body(L, C, params, LITH_CAR(x), G)) return 0;
+    return 1;
+}
+
+/* whether the function of a stage is without effects: a global bound to
+ * a pure builtin, or a lambda expression whose body calls only these */
+static int pure_stage(lith_st *L, struct lith_compiler *C, lith_value *f,
+                      struct lith_guards *G)
+{
+    lith_value *g, *body;
+    if (LITH_IS(f, LITH_TYPE_SYMBOL))
+        return (g = global_value(C, f)) && is_pure(g) && add_guard(G, f, g);
+    if (!LITH_IS(f, LITH_TYPE_PAIR) || !is_proper_list(f)
+    || (LITH_CAR(f) != L->forms[LITH_FORM_LAMBDA]) || (list_length(f) < 3))
+        return 0;
+    for (body = LITH_CDR(LITH_CDR(f)); !LITH_IS_NIL(body); body = LITH_CDR(body))
+        if (!pure_body(L, C, LITH_CAR(LITH_CDR(f)), LITH_CAR(body), G)) return 0;
+    return 1;
+}
+
+/* a chain of calls of the list functions, as in
+ * (foldl f init (map g (filter p (range a b)))), becomes a call of one
+ * pipeline, with the arguments in the same order: -1 when it is not
+ * such a chain of two calls or more
+ * the chain stops at a stage whose function may have effects, since the
+ * fused stages call their functions in another order
+ */
+static int compile_pipeline(lith_st *L, struct lith_compiler *C,
+                            lith_value *expr, int tail)
+{
+    struct lith_guards G;
+    lith_value *calls[LITH_MAX_STAGES], *x, *f, *plan, *rest;
+    int stages[LITH_MAX_STAGES], k, ranged;
+    size_t n, i, j, argc, guards;
+    G.n = 0;
+    ranged = 0;
+    for (n = 0, x = expr; !ranged && (n < LITH_MAX_STAGES - 1); n++) {
+        guards = G.n;
+        if (!LITH_IS(x, LITH_TYPE_PAIR) || !is_proper_list(x)
+        || !LITH_IS(LITH_CAR(x), LITH_TYPE_SYMBOL) || LITH_CAR(x)->value.symbol.form
+        || !(f = global_value(C, LITH_CAR(x))) || ((k = stage_of(f)) < 0)
+        || (list_length(LITH_CDR(x)) != stage_nargs[k] + (k != STAGE_RANGE))
+        || ((k == STAGE_FOLDL) && n) || !add_guard(&G, LITH_CAR(x), f)
+        || ((k != STAGE_RANGE) && !pure_stage(L, C, LITH_CAR(LITH_CDR(x)), &G))) {
+            G.n = guards;
+            break;
+        }
+        calls[n] = x;
+        stages[n] = k;
+        ranged = k == STAGE_RANGE;
+        for (rest = LITH_CDR(x); !LITH_IS_NIL(LITH_CDR(rest)); rest = LITH_CDR(rest))
+            ;
+        x = LITH_CAR(rest);
+    }
+    if (n < 2) return -1;
+    if (!ranged) {
+        calls[n] = x;
+        stages[n++] = STAGE_LIST;
+    }
+    if (!emit_guards(L, C, &G)) return 0;
+    if (!L->pipeline || !emit_const_op(L, C, OP_CONST, L->pipeline, 0, 1)) return 0;
+    for (plan = L->nil, i = n; i-- > 0; )
+        if (!(plan = LITH_CONS(L, LITH_FIXNUM(stages[i]), plan))) return 0;
+    if (!emit_const_op(L, C, OP_CONST, plan, 0, 1)) return 0;
+    for (argc = 1, i = 0; i < n; i++) {
+        if (stages[i] == STAGE_LIST) {
+            if (!compile_expr(L, C, calls[i], 0)) return 0;
+            argc++;
+            continue;
+        }
+        for (j = 0, rest = LITH_CDR(calls[i]); j < stage_nargs[stages[i]]; j++, rest = LITH_CDR(rest))
+            if (!compile_expr(L, C, LITH_CAR(rest), 0)) return 0;
+        argc += stage_nargs[stages[i]];
+    }
+    if (!emit_op(L, C, tail ? OP_TAILCALL : OP_CALL, argc, 0, -(long) argc))
+        return 0;
+    return compile_unguarded(L, C, &G, expr, tail);
+}
+
+/* the call folded or inlined, -1 when it is left as it is */
+static int optimize_call(lith_st *L, struct lith_compiler *C,
+                         lith_value *expr, int tail)
+{
+    struct lith_guards G;
+    lith_value *val, *f;
+    int ok;
+    if ((ok = compile_pipeline(L, C, expr, tail)) >= 0)
+        return ok;
+    G.n = 0;
+    if (fold(L, C, expr, &val, &G))
+        return emit_guards(L, C, &G) && emit_const_op(L, C, OP_CONST, val, 0, 1)
+            && compile_unguarded(L, C, &G, expr, tail);
+    if (LITH_IS_ERR(L)) return 0;
+    f = LITH_CAR(expr);
+    if (LITH_IS(f, LITH_TYPE_SYMBOL) && (val = global_value(C, f))
+    && inlinable_closure(C, val, list_length(LITH_CDR(expr))))
+        return compile_inline(L, C, expr, val, tail);
+    return -1;
+}
+
+/* the value of an expression in tail position is the value of the closure:
+ * a call there is made in place of the running closure */
+static int compile_expr(lith_st *L, struct lith_compiler *C,
+                        lith_value *expr, int tail)
+{
+    size_t n, jump, next;
+    lith_value *f, *rest, *sym, *q, **p;
+    enum lith_form form;
+    struct lith_scope T;
+    struct lith_guards G;
+    int ok;
+    if (C->in && (LITH_TAG(expr) == LITH_TAG_LOCAL)) {
+        if ((q = C->in->consts[LOCAL_SLOT(expr)]))
+            return emit_const_op(L, C, OP_CONST, q, 0, 1);
+        return emit_op(L, C, OP_TEMP, C->in->temps[LOCAL_SLOT(expr)], 0, 1);
+    }
+    if (C->in && LITH_IS(expr, LITH_TYPE_SYMBOL))
+        return emit_const_op(L, C, OP_CELL, ns_binding(C->in->env, expr), 0, 1);
+    if (LITH_TAG(expr) == LITH_TAG_LOCAL) {
+        if (LOCAL_DEPTH(expr) == 0)
+            return emit_op(L, C, OP_LOCAL0, LOCAL_SLOT(expr), 0, 1);
+        return emit_op(L, C, OP_LOCAL, LOCAL_DEPTH(expr), LOCAL_SLOT(expr), 1);
+    }
+    if (LITH_IS(expr, LITH_TYPE_SYMBOL))
+        return emit_const_op(L, C, OP_GLOBAL, expr, 0, 1);
+    if (!LITH_IS(expr, LITH_TYPE_PAIR))
+        return emit_const_op(L, C, OP_CONST, expr, 0, 1);
+    if (!is_proper_list(expr))
+        return emit_const_op(L, C, OP_EVAL, expr, 0, 1);
+    f = LITH_CAR(expr);
+    rest = LITH_CDR(expr);
+    n = list_length(rest);
+    form = LITH_IS(f, LITH_TYPE_SYMBOL) ? f->value.symbol.form : LITH_FORM_NONE;
+    switch (form) {
+    case LITH_FORM_QUOTE:
+        if (n != 1) break;
+        return emit_const_op(L, C, OP_CONST, LITH_CAR(rest), 0, 1);
+    case LITH_FORM_IF:
+        if (n != 3) break;
+        G.n = 0;
+        if (C->optimize && fold(L, C, LITH_CAR(rest), &q, &G) && !G.n)
+            return compile_expr(L, C, LITH_TO_BOOL(q) ? LITH_CAR(LITH_CDR(rest))
+                : LITH_CAR(LITH_CDR(LITH_CDR(rest))), tail);
+        if (LITH_IS_ERR(L)) return 0;
+        if (!compile_expr(L, C, LITH_CAR(rest), 0)
+        || !emit_op(L, C, OP_JUMPF, 0, 0, -1)) return 0;
+        jump = C->code->ninsns - 1;
+        rest = LITH_CDR(rest);
+        if (!compile_expr(L, C, LITH_CAR(rest), tail)
+        || !emit_op(L, C, OP_JUMP, 0, 0, -1)) return 0;
+        next = C->code->ninsns - 1;
+        C->code->insns[jump] = C->code->ninsns;
+        if (!compile_expr(L, C, LITH_CAR(LITH_CDR(rest)), tail)) return 0;
+        C->code->insns[next] = C->code->ninsns;
+        return 1;
+    case LITH_FORM_DEF:
+    case LITH_FORM_SET:
+        sym = LITH_CAR(rest);
+        if (n != 2) break;
+        if (LITH_TAG(sym) == LITH_TAG_LOCAL) {
+            if ((form == LITH_FORM_DEF) && (LOCAL_DEPTH(sym) != 0)) break;
+        } else if (!LITH_IS(sym, LITH_TYPE_SYMBOL)) {
+            break;
+        }
+        if (!compile_expr(L, C, LITH_CAR(LITH_CDR(rest)), 0)) return 0;
+        if (LITH_TAG(sym) != LITH_TAG_LOCAL)
+            return emit_const_op(L, C,
+                (form == LITH_FORM_DEF) ? OP_DEFGLOBAL : OP_SETGLOBAL, sym, 0, 0);
+        if (form == LITH_FORM_DEF)
+            return emit_op(L, C, OP_DEFLOCAL, LOCAL_SLOT(sym), 0, 0);
+        return emit_op(L, C, OP_SETLOCAL, LOCAL_DEPTH(sym), LOCAL_SLOT(sym), 0);
+    case LITH_FORM_LAMBDA:
+        if (!(q = make_proto(L, C->S, expr))) return 0;
+        if (q == expr) break;
+        return emit_const_op(L, C, OP_CLOSURE, q, 0, 1);
+    case LITH_FORM_LET:
+        if (!is_block(L, rest)) break;
+        sym = LITH_CAR(LITH_CDR(LITH_CAR(rest)));
+        if (sym == L->False)
+            return compile_body(L, C, LITH_CDR(LITH_CDR(rest)), tail);
+        for (n = 0, q = LITH_CAR(LITH_CDR(rest)); !LITH_IS_NIL(q); n++, q = LITH_CDR(q))
+            if (!compile_expr(L, C, LITH_CAR(q), 0)) return 0;
+        if (!emit_const_op(L, C, OP_ENTER, sym, n, -(long) n)) return 0;
+        T.names = sym;
+        T.tail = NULL;
+        T.parent = C->S->parent;
+        T.up = C->S;
+        T.collect = 0;
+        C->S = &T;
+        ok = compile_body(L, C, LITH_CDR(LITH_CDR(rest)), tail);
+        C->S = T.up;
+        return ok && emit_op(L, C, OP_LEAVE, 0, 0, 0);
+    case LITH_FORM_QUASIQUOTE:
+        if (n != 1) break;
+        return compile_template(L, C, LITH_CAR(rest));
+    case LITH_FORM_NONE:
+        if (!C->in && LITH_IS(f, LITH_TYPE_SYMBOL) && (p = env_find(C->S->parent, f))
+        && LITH_IS(*p, LITH_TYPE_MACRO) && !has_locals(rest))
+            return compile_macro_call(L, C, *p, expr, tail);
+        if (C->optimize && ((ok = optimize_call(L, C, expr, tail)) >= 0))
+            return ok;
+        return compile_call(L, C, expr, tail);
+    default: break;
+    }
+    return emit_const_op(L, C, OP_EVAL, expr, 0, 1);
+}
+
+/* the body and the code are kept on the eval stack while compiling,
+ * since expanding a macro may collect garbage
+ */
+static lith_value *compile(lith_st *L, struct lith_scope *S, lith_value *body)
+{
+    struct lith_compiler C;
+    struct lith_code *code;
+    size_t sp;
+    int ok;
+    code = alloc_cell(L, pool_for(L, sizeof(*code), 0));
+    if (!code) return NULL;
+    code->type = LITH__CODE;
+    code->insns = NULL;
+    code->consts = NULL;
+    code->caches = NULL;
+    code->ninsns = code->cap = code->nconsts = code->constcap = 0;
+    code->maxstack = 0;
+    sp = L->gc.sp;
+    C.S = S;
+    C.code = code;
+    C.depth = 0;
+    C.optimize = L->optimize;
+    C.in = NULL;
+    ok = push_root(L, (lith_value *) code)
+        && push_root(L, body) && push_root(L, S->names)
+        && compile_body(L, &C, body, 1)
+        && emit_op(L, &C, OP_RETURN, 0, 0, -1);
+    L->gc.sp = sp;
+    if (ok && code->nconsts
+    && !(code->caches = calloc(code->nconsts, sizeof(*code->caches)))) {
+        L->error = LITH_ERR_NOMEM;
+        return NULL;
+    }
+    return ok ? (lith_value *) code : NULL;
+}
+
+static void disassemble(lith_st *L, struct lith_code *code, FILE *file)
+{
+    size_t i;
+    unsigned int op;
+    int j;
+    for (i = 0; i < code->ninsns; i += 1 + op_nargs[op]) {
+        op = code->insns[i];
+        fprintf(file, "%4lu  %-10s", (unsigned long) i, op_names[op]);
+        for (j = 1; j <= op_nargs[op]; j++)
+            fprintf(file, " %u", code->insns[i + j]);
+        if (OP_HAS_CONST(op)) {
+            fprintf(file, "\t; ");
+            lith_print_value(L, code->consts[code->insns[i + 1]], file);
+        }
+        fputc('\n', file);
+    }
+}
+
+static void init_types(char **types)
+{
+    types[LITH_TYPE_NIL] = "nil";
+    types[LITH_TYPE_PAIR] = "pair";
+    types[LITH_TYPE_BOOLEAN] = "boolean";
+    types[LITH_TYPE_INTEGER] = "integer";
+    types[LITH_TYPE_NUMBER] = "number";
+    types[LITH_TYPE_SYMBOL] = "symbol";
+    types[LITH_TYPE_STRING] = "string";
+    types[LITH_TYPE_BUILTIN] = "builtin";
+    types[LITH_TYPE_CLOSURE] = "closure";
+    types[LITH_TYPE_MACRO] = "macro";
+    types[LITH_TYPE_VECTOR] = "vector";
+    types[LITH_TYPE_F64ARRAY] = "f64array";
+    types[LITH_TYPE_I64ARRAY] = "i64array";
+    types[LITH_TYPE_TABLE] = "table";
+    types[LITH_TYPE_PMAP] = "pmap";
+    types[LITH_TYPE_PVECTOR] = "pvector";
+}
+
+static char *form_names[LITH_NFORMS] = {
+    NULL, "quote", "eval!", "if", "def", "set!", "macro", "lambda",
+    "let", "begin", "cond", "and", "or", "quasiquote"
+};
+
+/* the symbols of the special forms are always kept alive:
+ * the form is found from the symbol without comparing names
+ */
+static void init_forms(lith_st *L)
+{
+    int i;
+    L->forms[LITH_FORM_NONE] = NULL;
+    L->sym_else = L->sym_unquote = L->sym_unquote_splicing = NULL;
+    for (i = 1; i < LITH_NFORMS; i++) {
+        L->forms[i] = lith_get_symbol(L, form_names[i]);
+        if (!L->forms[i]) return;
+        L->forms[i]->value.symbol.form = (enum lith_form) i;
+    }
+    L->sym_else = lith_get_symbol(L, "else");
+    L->sym_unquote = lith_get_symbol(L, "unquote");
+    L->sym_unquote_splicing = lith_get_symbol(L, "unquote-splicing");
+}
+
+lith_valtype lith_tag_types[LITH_TAG_MASK + 1] = {
+    LITH__FREE, /* heap values have the type in their header */
+    LITH_TYPE_INTEGER,
+    LITH_TYPE_PAIR,
+    LITH_TYPE_NUMBER,
+    LITH_TYPE_NIL,
+    LITH_TYPE_BOOLEAN,
+    LITH__FREE,
+    LITH__FREE
+};
+
+struct lith_lib_fn lith_builtins[] = {
+    {"car", 1, 1, builtin__car},
+    {"cdr", 1, 1, builtin__cdr},
+    {"cons", 2, 1, builtin__cons},
+    {"typeof", 1, 1, builtin__typeof},
+    {"print", 1, 0, builtin__print},
+    {":+", 2, 1, builtin__add},
+    {":-", 2, 1, builtin__subtract},
+    {":*", 2, 1, builtin__multiply},
+    {":/", 2, 1, builtin__divide},
+    {":%", 2, 1, builtin__modulus},
+    {":<", 2, 1, builtin__is_less_than},
+    {":==", 2, 1, builtin__is_num_equal},
+    {":>", 2, 1, builtin__is_greater_than},
+    {"+", 0, 0, builtin__sum},
+    {"-", 0, 0, builtin__difference},
+    {"*", 0, 0, builtin__product},
+    {"/", 0, 0, builtin__quotient},
+    {"<", 2, 0, builtin__less},
+    {">", 2, 0, builtin__greater},
+    {"=", 2, 0, builtin__num_equal},
+    {"<=", 2, 0, builtin__less_or_equal},
+    {">=", 2, 0, builtin__greater_or_equal},
+    {"eq?", 2, 1, builtin__is_eq},
+    {"equal?", 2, 1, builtin__is_equal},
+    {"nil?", 1, 1, builtin__is_nil},
+    {"list?", 1, 1, builtin__is_list},
+    {"apply", 2, 1, builtin__apply},
+    {"range", 2, 1, builtin__range},
+    {"map", 2, 1, builtin__map},
+    {"filter", 2, 1, builtin__filter},
+    {"foldl", 3, 1, builtin__foldl},
+    {"make-vector", 1, 0, builtin__make_vector},
+    {"vector", 0, 0, builtin__vector},
+    {"vector-ref", 2, 1, builtin__vector_ref},
+    {"vector-set!", 3, 1, builtin__vector_set},
+    {"vector-length", 1, 1, builtin__vector_length},
+    {"vector-fill!", 2, 1, builtin__vector_fill},
+    {"vector-copy", 1, 1, builtin__vector_copy},
+    {"vector-slice", 3, 1, builtin__vector_slice},
+    {"list->vector", 1, 1, builtin__list_to_vector},
+    {"vector->list", 1, 1, builtin__vector_to_list},
+    {"make-f64array", 1, 0, builtin__make_f64array},
+    {"make-i64array", 1, 0, builtin__make_i64array},
+    {"list->f64array", 1, 1, builtin__list_to_f64array},
+    {"list->i64array", 1, 1, builtin__list_to_i64array},
+    {"array->list", 1, 1, builtin__array_to_list},
+    {"array-length", 1, 1, builtin__array_length},
+    {"array-ref", 2, 1, builtin__array_ref},
+    {"array-set!", 3, 1, builtin__array_set},
+    {"array-add", 2, 1, builtin__array_add},
+    {"array-mul", 2, 1, builtin__array_mul},
+    {"array-scale", 2, 1, builtin__array_scale},
+    {"array-sum", 1, 1, builtin__array_sum},
+    {"array-dot", 2, 1, builtin__array_dot},
+    {"array-min", 1, 1, builtin__array_min},
+    {"array-max", 1, 1, builtin__array_max},
+    {"array-prefix-sum", 1, 1, builtin__array_prefix_sum},
+    {"array-less", 2, 1, builtin__array_less},
+    {"array-greater", 2, 1, builtin__array_greater},
+    {"array-equal", 2, 1, builtin__array_equal},
+    {"make-table", 0, 1, builtin__make_table},
+    {"table-get", 2, 0, builtin__table_get},
+    {"table-put!", 3, 1, builtin__table_put},
+    {"table-delete!", 2, 1, builtin__table_delete},
+    {"table-contains?", 2, 1, builtin__table_contains},
+    {"table-size", 1, 1, builtin__table_size},
+    {"table-keys", 1, 1, builtin__table_keys},
+    {"table-for-each", 2, 1, builtin__table_for_each},
+    {"make-pmap", 0, 1, builtin__make_pmap},
+    {"pmap-put", 3, 1, builtin__pmap_put},
+    {"pmap-get", 2, 0, builtin__pmap_get},
+    {"pmap-delete", 2, 1, builtin__pmap_delete},
+    {"pmap-contains?", 2, 1, builtin__pmap_contains},
+    {"pmap-size", 1, 1, builtin__pmap_size},
+    {"pmap-keys", 1, 1, builtin__pmap_keys},
+    {"pmap->list", 1, 1, builtin__pmap_to_list},
+    {"pvector", 0, 0, builtin__pvector},
+    {"list->pvector", 1, 1, builtin__list_to_pvector},
+    {"pvector->list", 1, 1, builtin__pvector_to_list},
+    {"pvector-length", 1, 1, builtin__pvector_length},
+    {"pvector-ref", 2, 1, builtin__pvector_ref},
+    {"pvector-set", 3, 1, builtin__pvector_set},
+    {"pvector-push", 2, 1, builtin__pvector_push},
+    {"pvector-concat", 2, 1, builtin__pvector_concat},
+    {"pvector-slice", 3, 1, builtin__pvector_slice},
+    {"error", 1, 1, builtin__error},
+    {"load", 1, 1, builtin__load},
+    {NULL, 0, 0, NULL}
+};
+
+/* Public functions */
+
+void lith_init(lith_st *L)
+{
+    L->error = LITH_ERR_OK;
+    L->error_state.manual = 0;
+    L->error_state.success = 1;
+    L->error_state.sym = L->error_state.msg = L->error_state.name = NULL;
+    L->error_state.expr = NULL;
+    init_heap(L);
+    L->gc.count = L->gc.collections = 0;
+    L->gc.threshold = LITH_GC_MIN_THRESHOLD;
+    L->gc.stack = L->gc.gray = NULL;
+    L->gc.sp = L->gc.cap = L->gc.ngray = L->gc.graycap = 0;
+    L->nil = LITH_NIL;
+    L->True = LITH_TRUE;
+    L->False = LITH_FALSE;
+    L->symbols.slots = NULL;
+    L->symbols.count = L->symbols.cap = 0;
+    L->expansions.slots = NULL;
+    L->expansions.count = L->expansions.cap = 0;
+    L->constants.slots = NULL;
+    L->constants.count = L->constants.cap = 0;
+    L->bindings = 0;
+    L->frame_extras = 0;
+    L->global = lith_new_env(L, L->nil);
+    L->global = lith_new_env(L, L->global);
+    L->filename = "<<unspecified>>";
+    L->walk = 0;
+    L->optimize = 1;
+    L->disasm = NULL;
+    L->cstack = NULL;
+    L->cstack_limit = LITH_CSTACK_LIMIT;
+    init_types(L->types);
+    init_forms(L);
+    L->pipeline = lith_make_builtin_argv(L, lith_get_symbol(L, "pipeline"),
+        builtin__pipeline, 1, 0);
+    lith_fill_env(L, lith_builtins);
+}
+
+void lith_free(lith_st *L)
+{
+    int i;
+    size_t j;
+    struct lith_page *page;
+    lith_value *val;
+    for (i = 0; i < LITH_NCLASSES; i++) {
+        for (page = L->gc.pools[0][i].pages; page; page = page->next) {
+            for (j = 0; j < page->ncells; j++) {
+                val = (lith_value *) (page->cells + j * page->size);
+                if (val->type != LITH__FREE)
+                    finalize_value(val);
+            }
+        }
+    }
+    for (j = 0; j < L->gc.nchunks; j++)
+        free(L->gc.chunks[j]);
+    free(L->gc.chunks);
+    free(L->symbols.slots);
+    L->symbols.slots = NULL;
+    L->symbols.count = L->symbols.cap = 0;
+    free(L->expansions.slots);
+    L->expansions.slots = NULL;
+    L->expansions.count = L->expansions.cap = 0;
+    free(L->constants.slots);
+    L->constants.slots = NULL;
+    L->constants.count = L->constants.cap = 0;
+    free(L->gc.stack);
+    free(L->gc.gray);
+    init_heap(L);
+    L->gc.count = 0;
+}
+
+void lith_collect_garbage(lith_st *L)
+{
+    mark_roots(L);
+    mark_expansions(L);
+    sweep_symbols(L);
+    sweep_expansions(L);
+    sweep_constants(L);
+    sweep(L);
+    L->gc.threshold = 2 * L->gc.count;
+    if (L->gc.threshold < LITH_GC_MIN_THRESHOLD)
+        L->gc.threshold = LITH_GC_MIN_THRESHOLD;
+    L->gc.collections++;
+}
+
+void lith_get_heap_stats(lith_st *L, struct lith_heap_stats *stats)
+{
+    int i;
+    struct lith_pool *P;
+    stats->pages = stats->cells = stats->free_cells = 0;
+    for (i = 0; i <= 2 * LITH_NCLASSES; i++) {
+        P = (i == 2 * LITH_NCLASSES)
+            ? &L->gc.pairs
+            : &L->gc.pools[i / LITH_NCLASSES][i % LITH_NCLASSES];
+        stats->pages += P->npages;
+        stats->free_cells += P->nfree;
+        if (P->pages)
+            stats->cells += P->npages * P->pages->ncells;
+    }
+    stats->free_pages = L->gc.nfree_pages;
+    stats->collections = L->gc.collections;
+}
+
+void lith_clear_error_state(lith_st *L)
+{
+    L->error = LITH_ERR_OK;
+    L->error_state.success = 1;
+    L->error_state.manual = 0;
+    L->error_state.msg = L->error_state.sym = L->error_state.name = NULL;
+    L->error_state.expr = NULL;
+}
+
+lith_value *lith_new_value(lith_st *L)
+{
+    lith_value *val;
+    val = alloc_cell(L, pool_for(L, sizeof(lith_value), 0));
+    if (!val) return NULL;
+    val->type = LITH_TYPE_NIL;
+    return val;
+}
+
+lith_value *lith_make_integer(lith_st *L, long integer)
 {
     lith_value *val;
+    if (LITH_FITS_FIXNUM(integer))
+        return LITH_FIXNUM(integer);
     val = lith_new_value(L);
     if (!val) return NULL;
     val->type = LITH_TYPE_INTEGER;
@@ -701,9 +5517,52 @@ lith_value *lith_make_integer(lith_st *L, long integer)
     return val;
 }
 
+#ifdef LITH_SMALL_FLOATS
+/* the doubles with the exponent in the middle of its range fit in a word:
+ * the bits are rotated left by one to have the sign as the lowest bit,
+ * and the exponent is offset to fit in the bits left after the tag,
+ * zero is the only other double which fits
+ */
+#define LITH_FLONUM_BIAS 896UL
+#define LITH_FLONUM_OFFSET (LITH_FLONUM_BIAS << 53)
+
+static lith_value *make_flonum(double number)
+{
+    unsigned long bits, exp;
+    memcpy(&bits, &number, sizeof(bits));
+    if (bits == 0) return LITH_IMMEDIATE(0, LITH_TAG_FLONUM);
+    exp = (bits >> 52) & 0x7FF;
+    if ((exp <= LITH_FLONUM_BIAS) || (exp >= LITH_FLONUM_BIAS + 255))
+        return NULL;
+    bits = ((bits << 1) | (bits >> 63)) - LITH_FLONUM_OFFSET;
+    return LITH_IMMEDIATE(bits, LITH_TAG_FLONUM);
+}
+#endif
+
+double lith_flonum_value(lith_value *val)
+{
+    double number;
+#ifdef LITH_SMALL_FLOATS
+    unsigned long bits;
+    bits = LITH_WORD(val) >> LITH_TAG_BITS;
+    if (bits) {
+        bits += LITH_FLONUM_OFFSET;
+        bits = (bits >> 1) | (bits << 63);
+    }
+    memcpy(&number, &bits, sizeof(number));
+#else
+    number = 0.0;
+#endif
+    return number;
+}
+
 lith_value *lith_make_number(lith_st *L, double number)
 {
     lith_value *val;
+#ifdef LITH_SMALL_FLOATS
+    if ((val = make_flonum(number)))
+        return val;
+#endif
     val = lith_new_value(L);
     if (!val) return NULL;
     val->type = LITH_TYPE_NUMBER;
@@ -713,15 +5572,7 @@ lith_value *lith_make_number(lith_st *L, double number)
 
 lith_value *lith_make_symbol(lith_st *L, char *symbol)
 {
-    lith_value *val;
-    char *sym;
-    val = lith_new_value(L);
-    if (!val) return NULL;
-    val->type = LITH_TYPE_SYMBOL;
-    sym = lith__strndup(L, symbol, strlen(symbol));
-    if (!sym) { free(val); return NULL; }
-    val->value.symbol = sym;
-    return val;
+    return make_symbol(L, symbol, strlen(symbol));
 }
 
 lith_value *lith_make_builtin(lith_st *L, lith_value *name, lith_builtin_function function,
@@ -731,10 +5582,11 @@ lith_value *lith_make_builtin(lith_st *L, lith_value *name, lith_builtin_functio
     lith_callable *f;
     val = lith_new_value(L);
     if (!val) return NULL;
-    f = emalloc(L, sizeof(*f));
-    if (!f) { free(val); return NULL; }
+    f = alloc_raw(L, sizeof(*f));
+    if (!f) return NULL;
     f->name = name;
     f->function = function;
+    f->argv_function = NULL;
     f->expect = expect;
     f->exact = exact;
     val->type = LITH_TYPE_BUILTIN;
@@ -742,25 +5594,34 @@ lith_value *lith_make_builtin(lith_st *L, lith_value *name, lith_builtin_functio
     return val;
 }
 
-lith_value *lith_make_closure(lith_st *L, lith_env *parent_env,
-                              lith_value *name, lith_value *arg_names, lith_value *body,
-                              size_t expect, int exact
-)
+lith_value *lith_make_builtin_argv(lith_st *L, lith_value *name,
+                                   lith_builtin_argv_function function,
+                                   size_t expect, int exact)
+{
+    lith_value *val;
+    val = lith_make_builtin(L, name, NULL, expect, exact);
+    if (!val) return NULL;
+    val->value.callable->argv_function = function;
+    return val;
+}
+
+static lith_value *new_closure(lith_st *L, lith_env *parent_env,
+                               lith_value *name, lith_value *names, size_t nslots,
+                               lith_value *body, lith_value *code,
+                               size_t expect, int exact)
 {
     lith_value *val;
     lith_callable *f;
     val = lith_new_value(L);
     if (!val) return NULL;
-    f = emalloc(L, sizeof(*f));
-    if (!f) { free(val); return NULL; }
-    arg_names = lith_copy_value(L, arg_names);
-    if (!arg_names) { free(val); free(f); return NULL; }
-    body = lith_copy_value(L, body);
-    if (!body) { free(val); free(f); lith_free_value(arg_names); return NULL; }
+    f = alloc_raw(L, sizeof(*f));
+    if (!f) return NULL;
     f->name = name;
     f->parent = parent_env;
-    f->args = arg_names;
+    f->args = names;
+    f->nslots = nslots;
     f->body = body;
+    f->code = code;
     f->expect = expect;
     f->exact = exact;
     val->type = LITH_TYPE_CLOSURE;
@@ -768,83 +5629,202 @@ lith_value *lith_make_closure(lith_st *L, lith_env *parent_env,
     return val;
 }
 
+/* the body is analyzed in a scope of its own, inside the scope up
+ * when the lambda expression is inside a closure, and compiled
+ */
+static lith_value *new_lambda(lith_st *L, struct lith_scope *up, lith_env *parent_env,
+                              lith_value *arg_names, lith_value *body,
+                              size_t expect, int exact)
+{
+    struct lith_scope S;
+    struct lith_lambda *P;
+    lith_value *p, *code;
+    size_t slot;
+    S.names = L->nil;
+    S.tail = &S.names;
+    S.parent = up ? up->parent : parent_env;
+    S.up = up;
+    for (p = arg_names; !LITH_IS_NIL(p); p = LITH_CDR(p)) {
+        if (!LITH_IS(p, LITH_TYPE_PAIR)) {
+            if (find_name(S.names, p, &slot)) {
+                redefine_error(L, p);
+                return NULL;
+            }
+            if (!add_name(L, &S, p)) return NULL;
+            break;
+        }
+        if (find_name(S.names, LITH_CAR(p), &slot)) {
+            redefine_error(L, LITH_CAR(p));
+            return NULL;
+        }
+        if (!add_name(L, &S, LITH_CAR(p))) return NULL;
+    }
+    S.collect = 1;
+    if (!analyze_list(L, &S, body)) return NULL;
+    S.collect = 0;
+    body = analyze_list(L, &S, body);
+    if (!body) return NULL;
+    code = NULL;
+    if (!L->walk) {
+        code = compile(L, &S, body);
+        if (!code) return NULL;
+        if (L->disasm) {
+            fprintf(L->disasm, "; lambda ");
+            lith_print_value(L, arg_names, L->disasm);
+            fputc('\n', L->disasm);
+            disassemble(L, CODE(code), L->disasm);
+        }
+    }
+    P = alloc_cell(L, pool_for(L, sizeof(*P), 0));
+    if (!P) return NULL;
+    P->type = LITH__LAMBDA;
+    P->params = arg_names;
+    P->names = S.names;
+    P->nslots = list_length(S.names);
+    P->body = body;
+    P->code = code;
+    P->expect = expect;
+    P->exact = exact;
+    return (lith_value *) P;
+}
+
+/* a closure of the lambda in the environment: made in constant time */
+static lith_value *close_lambda(lith_st *L, lith_env *parent_env,
+                                lith_value *name, lith_value *lambda)
+{
+    struct lith_lambda *P;
+    P = LAMBDA(lambda);
+    return new_closure(L, parent_env, name, P->names, P->nslots,
+        P->body, P->code, P->expect, P->exact);
+}
+
+lith_value *lith_make_closure(lith_st *L, lith_env *parent_env,
+                              lith_value *name, lith_value *arg_names, lith_value *body,
+                              size_t expect, int exact
+)
+{
+    lith_value *lambda;
+    lambda = new_lambda(L, NULL, parent_env, arg_names, body, expect, exact);
+    if (!lambda) return NULL;
+    return close_lambda(L, parent_env, name, lambda);
+}
+
 lith_value *lith_make_string(lith_st *L, char *string, size_t len)
 {
     lith_value *val;
     char *str;
     val = lith_new_value(L);
     if (!val) return NULL;
-    val->type = LITH_TYPE_STRING;
     str = lith__strndup(L, string, len);
-    if (!str) { free(val); return NULL; }
+    if (!str) return NULL;
+    val->type = LITH_TYPE_STRING;
     val->value.string.len = len;
     val->value.string.buf = str;
     return val; 
 }
 
-lith_value *lith_make_pair(lith_st *L, lith_value *car, lith_value *cdr)
+lith_value *lith_make_vector(lith_st *L, size_t len, lith_value *fill)
 {
-    lith_value *val;
+    lith_value *val, **items;
+    size_t i;
+    items = NULL;
+    if (len) {
+        if (len > ((size_t) -1) / sizeof(*items)) {
+            L->error = LITH_ERR_NOMEM;
+            return NULL;
+        }
+        items = emalloc(L, len * sizeof(*items));
+        if (!items) return NULL;
+        for (i = 0; i < len; i++) items[i] = fill;
+    }
     val = lith_new_value(L);
-    if (!val) return NULL;
-    val->type = LITH_TYPE_PAIR;
-    LITH_CAR(val) = car;
-    LITH_CDR(val) = cdr;
+    if (!val) {
+        free(items);
+        return NULL;
+    }
+    val->type = LITH_TYPE_VECTOR;
+    val->value.vector.len = len;
+    val->value.vector.items = items;
     return val;
 }
 
-void lith_free_value(lith_value *val)
+lith_value *lith_make_pair(lith_st *L, lith_value *car, lith_value *cdr)
 {
-    if (LITH_IS(val, LITH_TYPE_PAIR)) {
-        lith_free_value(LITH_CAR(val));
-        lith_free_value(LITH_CDR(val));
-    } else if (LITH_IS(val, LITH_TYPE_BUILTIN)) {
-        free(val->value.callable);
-    } else if (LITH_IS(val, LITH_TYPE_CLOSURE) || LITH_IS(val, LITH_TYPE_MACRO)) {
-        lith_free_value(val->value.callable->args);
-        lith_free_value(val->value.callable->body);
-        free(val->value.callable);
-    } else if (LITH_IS(val, LITH_TYPE_STRING)) {
-        free(val->value.string.buf);
-    } else if (LITH_IS_NIL(val) || LITH_IS(val, LITH_TYPE_BOOLEAN)
-           ||  LITH_IS(val, LITH_TYPE_SYMBOL)) {
-        return;
-    }
-    free(val);
+    struct lith_pair *pair;
+    pair = alloc_cell(L, &L->gc.pairs);
+    if (!pair) return NULL;
+    pair->car = car;
+    pair->cdr = cdr;
+    return (lith_value *) ((char *) pair + LITH_TAG_PAIR);
 }
 
 lith_value *lith_get_symbol(lith_st *L, char *name)
 {
-    lith_value *sym, *p;
-    p = L->symbol_table;
-    while (!LITH_IS_NIL(p)) {
-        sym = LITH_CAR(p);
-        if (LITH_SYM_EQ(sym, name)) return sym;
-        p = LITH_CDR(p);
-    }
-    sym = lith_make_symbol(L, name);
-    if (!sym) return NULL;
-    p = LITH_CONS(L, sym, L->symbol_table);
-    if (!p) { lith_free_value(sym); return NULL; }
-    L->symbol_table = p;
-    return sym;
+    return intern(L, name, strlen(name));
 }
 
-void lith_print_value(lith_st *L, lith_value *val, FILE *file)
+static struct lith_path *find_path(struct lith_path *P, lith_value *val)
+{
+    for (; P; P = P->up)
+        if (P->val == val) return P;
+    return NULL;
+}
+
+static void print_value(lith_st *L, lith_value *val, FILE *file, struct lith_path *P)
 {
+    struct lith_path here;
     lith_callable *fn;
+    size_t i;
+    int first;
     if (LITH_IS_NIL(val)) {
         fprintf(file, "()");
     } else if (LITH_IS(val, LITH_TYPE_SYMBOL)) {
-        fprintf(file, "%s", val->value.symbol);
+        fprintf(file, "%s", val->value.symbol.name);
     } else if (LITH_IS(val, LITH_TYPE_STRING)) {
         print_string(val->value.string, file);
     } else if (LITH_IS(val, LITH_TYPE_BOOLEAN)) {
-        fprintf(file, "#%c", val->value.boolean ? 't' : 'f');
+        fprintf(file, "#%c", (val == LITH_TRUE) ? 't' : 'f');
     } else if (LITH_IS(val, LITH_TYPE_INTEGER)) {
-        fprintf(file, "%ld", val->value.integer);
+        fprintf(file, "%ld", LITH_INTEGER(val));
     } else if (LITH_IS(val, LITH_TYPE_NUMBER)) {
-        fprintf(file, "%.15g", val->value.number);
+        fprintf(file, "%.15g", LITH_NUMBER(val));
+    } else if (LITH_IS(val, LITH_TYPE_VECTOR) && find_path(P, val)) {
+        fprintf(file, "#(...)");
+    } else if (LITH_IS(val, LITH_TYPE_VECTOR)) {
+        here.val = val;
+        here.copy = NULL;
+        here.up = P;
+        fprintf(file, "#(");
+        for (i = 0; i < val->value.vector.len; i++) {
+            if (i) fputc(' ', file);
+            print_value(L, val->value.vector.items[i], file, &here);
+        }
+        fputc(')', file);
+    } else if (LITH_IS(val, LITH_TYPE_F64ARRAY)) {
+        fprintf(file, "#f64(");
+        for (i = 0; i < val->value.array.len; i++)
+            fprintf(file, i ? " %.15g" : "%.15g", val->value.array.items.f64[i]);
+        fputc(')', file);
+    } else if (LITH_IS(val, LITH_TYPE_I64ARRAY)) {
+        fprintf(file, "#i64(");
+        for (i = 0; i < val->value.array.len; i++)
+            fprintf(file, i ? " %ld" : "%ld", val->value.array.items.i64[i]);
+        fputc(')', file);
+    } else if (LITH_IS(val, LITH_TYPE_PMAP)) {
+        first = 1;
+        fprintf(file, "#pmap(");
+        print_map(L, val->value.tree.root, file, &first, P);
+        fputc(')', file);
+    } else if (LITH_IS(val, LITH_TYPE_PVECTOR)) {
+        fprintf(file, "#pvector(");
+        for (i = 0; i < val->value.tree.len; i++) {
+            if (i) fputc(' ', file);
+            print_value(L, vec_ref(val->value.tree.root, i), file, P);
+        }
+        fputc(')', file);
+    } else if (LITH_IS(val, LITH_TYPE_TABLE)) {
+        fprintf(file, "#<table [%lu] at %p>",
+            (unsigned long) val->value.table->count, (void *)val->value.table);
     } else if (LITH_IS_CALLABLE(val)) {
         fn = val->value.callable;
         fprintf(file, "#<%s ", L->types[val->type]);
@@ -852,22 +5832,29 @@ void lith_print_value(lith_st *L, lith_value *val, FILE *file)
             lith_print_value(L, fn->name, file);
         else
             fprintf(file, "[anon]");
-        fprintf(file, "[%zu%s]", fn->expect, fn->exact ? "" : "+");
+        fprintf(file, "[%lu%s]", (unsigned long) fn->expect, fn->exact ? "" : "+");
         fprintf(file, " at %p>", (void *)fn);
+    } else if (LITH_TAG(val) == LITH_TAG_LOCAL) {
+        fprintf(file, "#<local %lu %lu>",
+            (unsigned long) LOCAL_DEPTH(val), (unsigned long) LOCAL_SLOT(val));
+    } else if (IS_LAMBDA(val)) {
+        fprintf(file, "#<lambda ");
+        lith_print_value(L, LAMBDA(val)->params, file);
+        fputc('>', file);
     } else if (!LITH_IS(val, LITH_TYPE_PAIR)) {
         fprintf(file, "#<unknown object at %p>", (void *)val);
     } else {
         fputc('(', file);
-        lith_print_value(L, LITH_CAR(val), file);
+        print_value(L, LITH_CAR(val), file, P);
         val = LITH_CDR(val);
         while (!LITH_IS_NIL(val)) {
             if (LITH_IS(val, LITH_TYPE_PAIR)) {
                 fputc(' ', file);
-                lith_print_value(L, LITH_CAR(val), file);
+                print_value(L, LITH_CAR(val), file, P);
                 val = LITH_CDR(val);
             } else {
                 fprintf(file, " . ");
-                lith_print_value(L, val, file);
+                print_value(L, val, file, P);
                 break;
             }
         }
@@ -875,53 +5862,105 @@ void lith_print_value(lith_st *L, lith_value *val, FILE *file)
     }
 }
 
-lith_value *lith_copy_value(lith_st *L, lith_value *val)
+void lith_print_value(lith_st *L, lith_value *val, FILE *file)
 {
+    print_value(L, val, file, NULL);
+}
+
+static lith_value *copy_value(lith_st *L, lith_value *val, struct lith_path *P)
+{
+    struct lith_path here, *Q;
     lith_value *head, *pair, *p, *v, *w;
     lith_callable *f;
+    size_t i;
     if (!val) return NULL;
-    switch (val->type) {
+    switch (LITH_TYPE_OF(val)) {
     case LITH_TYPE_INTEGER:
-        return lith_make_integer(L, val->value.integer);
+        return lith_make_integer(L, LITH_INTEGER(val));
     case LITH_TYPE_NUMBER:
-        return lith_make_number(L, val->value.number);
+        return lith_make_number(L, LITH_NUMBER(val));
     case LITH_TYPE_STRING:
         return lith_make_string(L, val->value.string.buf, val->value.string.len);
     case LITH_TYPE_BUILTIN:
         f = val->value.callable;
-        return lith_make_builtin(L, lith_copy_value(L, f->name), f->function, f->expect, f->exact);
+        v = lith_make_builtin(L, lith_copy_value(L, f->name), f->function, f->expect, f->exact);
+        if (v) v->value.callable->argv_function = f->argv_function;
+        return v;
     case LITH_TYPE_MACRO:
     case LITH_TYPE_CLOSURE:
         f = val->value.callable;
-        v = lith_make_closure(L, f->parent, lith_copy_value(L, f->name),
-                f->args, f->body, f->expect, f->exact);
+        v = new_closure(L, f->parent, lith_copy_value(L, f->name),
+                f->args, f->nslots, f->body, f->code, f->expect, f->exact);
         if (LITH_IS(val, LITH_TYPE_MACRO))
             v->type = LITH_TYPE_MACRO;
         return v;
     case LITH_TYPE_PAIR:
-        head = lith_copy_value(L, LITH_CAR(val));
+        head = copy_value(L, LITH_CAR(val), P);
         if (!head) return NULL;
         pair = LITH_CONS(L, head, L->nil);
-        if (!pair) { lith_free_value(head); return NULL; }
+        if (!pair) return NULL;
         val = LITH_CDR(val);
         for (p = pair; LITH_IS(val, LITH_TYPE_PAIR);
             val = LITH_CDR(val), p = LITH_CDR(p)) {
-            v = lith_copy_value(L, LITH_CAR(val));
-            if (!v) { lith_free_value(pair); return NULL; }
+            v = copy_value(L, LITH_CAR(val), P);
+            if (!v) return NULL;
             w = LITH_CONS(L, v, L->nil);
-            if (!w) { lith_free_value(pair); lith_free_value(v); }
+            if (!w) return NULL;
             LITH_CDR(p) = w;
         }
         if (!LITH_IS_NIL(val)) {
-            v = lith_copy_value(L, val);
-            if (!v) { lith_free_value(v); return NULL; }
+            v = copy_value(L, val, P);
+            if (!v) return NULL;
             LITH_CDR(p) = v;
         }
         return pair;
+    case LITH_TYPE_VECTOR:
+        if ((Q = find_path(P, val))) return Q->copy;
+        w = lith_make_vector(L, val->value.vector.len, L->nil);
+        if (!w) return NULL;
+        here.val = val;
+        here.copy = w;
+        here.up = P;
+        for (i = 0; i < val->value.vector.len; i++) {
+            v = copy_value(L, val->value.vector.items[i], &here);
+            if (!v) return NULL;
+            w->value.vector.items[i] = v;
+        }
+        return w;
+    case LITH_TYPE_F64ARRAY:
+        w = make_array(L, LITH_TYPE_F64ARRAY, val->value.array.len);
+        if (w && val->value.array.len)
+            memcpy(w->value.array.items.f64, val->value.array.items.f64,
+                val->value.array.len * sizeof(double));
+        return w;
+    case LITH_TYPE_I64ARRAY:
+        w = make_array(L, LITH_TYPE_I64ARRAY, val->value.array.len);
+        if (w && val->value.array.len)
+            memcpy(w->value.array.items.i64, val->value.array.items.i64,
+                val->value.array.len * sizeof(long));
+        return w;
+    case LITH_TYPE_TABLE:
+        if ((Q = find_path(P, val))) return Q->copy;
+        if (!(p = table_list(L, val->value.table, 1))) return NULL;
+        if (!(w = make_table(L))) return NULL;
+        here.val = val;
+        here.copy = w;
+        here.up = P;
+        for (; !LITH_IS_NIL(p); p = LITH_CDR(p)) {
+            if (!(head = copy_value(L, LITH_CAR(LITH_CAR(p)), &here))
+            || !(v = copy_value(L, LITH_CDR(LITH_CAR(p)), &here))
+            || !table_put(L, w->value.table, head, v)) return NULL;
+        }
+        return w;
     default: return val;
     }
 }
 
+lith_value *lith_copy_value(lith_st *L, lith_value *val)
+{
+    return copy_value(L, val, NULL);
+}
+
 void lith_simple_error(lith_st *L, enum lith_error errtype, char *msg)
 {
     L->error = errtype;
@@ -950,6 +5989,7 @@ void lith_print_error(lith_st *L, int full)
         break;
     case LITH_ERR_NOMEM:
         fprintf(stderr, "out of memory");
+        if (E.msg) fprintf(stderr, ": %s", E.msg);
         break;
     case LITH_ERR_UNBOUND:
         fprintf(stderr, "unbound symbol: '%s'", E.sym);
@@ -959,18 +5999,18 @@ void lith_print_error(lith_st *L, int full)
         break;
     case LITH_ERR_NARGS:
         fprintf(stderr, "wrong number of arguments: "
-            "expected %s%zu argument(s) but given %zu argument(s)",
+            "expected %s%lu argument(s) but given %lu argument(s)",
             (E.nargs.exact ? "" : "at least "),
-            E.nargs.expected, E.nargs.got);
+            (unsigned long) E.nargs.expected, (unsigned long) E.nargs.got);
         break;
     case LITH_ERR_TYPE:
         fprintf(stderr, "type error: ");
         if (E.manual)
             fprintf(stderr, "%s", E.msg);
         else
-            fprintf(stderr, "expecting %s instead of %s as the argument number %zu",
+            fprintf(stderr, "expecting %s instead of %s as the argument number %lu",
                 L->types[E.type.expected],
-                L->types[E.type.got], E.type.narg);
+                L->types[E.type.got], (unsigned long) E.type.narg);
         break;
     case LITH_ERR_CUSTOM:
         fprintf(stderr, "error: %s", E.msg);
@@ -992,71 +6032,74 @@ lith_value *lith_read_expr(lith_st *L, char *start, char **end)
 
 lith_env *lith_new_env(lith_st *L, lith_env *parent)
 {
-    return LITH_CONS(L, parent, L->nil);
-}
-
-void lith_free_env(lith_env *V)
-{
-    lith_free_value(LITH_CDR(V));
+    struct lith_namespace *N;
+    N = alloc_cell(L, pool_for(L, sizeof(*N), 0));
+    if (!N) return NULL;
+    N->type = LITH__NAMESPACE;
+    N->parent = parent;
+    N->count = 0;
+    N->cap = 16;
+    N->cells = calloc(N->cap, sizeof(*N->cells));
+    if (!N->cells) {
+        N->cap = 0;
+        L->error = LITH_ERR_NOMEM;
+        return NULL;
+    }
+    return (lith_env *) N;
 }
 
 lith_value *lith_env_get(lith_st *L, lith_env *V, lith_value *name)
 {
-    lith_env *parent;
-    lith_value *kvs, *kv;
-    parent = V;
-    do {
-        kvs = LITH_CDR(parent);
-        parent = LITH_CAR(parent);
-        while (!LITH_IS_NIL(kvs)) {
-            kv = LITH_CAR(kvs);
-            if (LITH_CAR(kv) == name)
-                return LITH_CDR(kv);
-            kvs = LITH_CDR(kvs);
-        }
-    } while (!LITH_IS_NIL(parent));
+    lith_value **p;
+    p = env_find(V, name);
+    if (p) return *p;
     L->error = LITH_ERR_UNBOUND;
-    L->error_state.sym = name->value.symbol;
+    L->error_state.sym = name->value.symbol.name;
     return NULL;
 }
 
 void lith_env_set(lith_st *L, lith_env *V, lith_value *name, lith_value *value)
 {
-    lith_env *parent;
-    lith_value *kvs, *kv;
-    parent = V;
-    do {
-        kvs = LITH_CDR(parent);
-        parent = LITH_CAR(parent);
-        while (!LITH_IS_NIL(kvs)) {
-            kv = LITH_CAR(kvs);
-            if (LITH_CAR(kv) == name) {
-                LITH_CDR(kv) = value;
-                return;
-            }
-            kvs = LITH_CDR(kvs);
-        }
-    } while (!LITH_IS_NIL(parent));
+    lith_value **p;
+    p = env_find(V, name);
+    if (p) {
+        *p = value;
+        return;
+    }
     L->error = LITH_ERR_UNBOUND;
-    L->error_state.sym = name->value.symbol;
+    L->error_state.sym = name->value.symbol.name;
 }
 
 void lith_env_put(lith_st *L, lith_env *V, lith_value *name, lith_value *value)
 {
-    lith_value *kvs, *kv;
-    kvs = LITH_CDR(V);
-    while (!LITH_IS_NIL(kvs)) {
-        kv = LITH_CAR(kvs);
-        if (name == LITH_CAR(kv)) {
-            L->error = LITH_ERR_REDEFINE;
-            L->error_state.sym = name->value.symbol;
+    struct lith_frame *F;
+    lith_value *kv, *kvs, **extras;
+    size_t slot;
+    if (IS_FRAME(V)) {
+        F = FRAME(V);
+        if (find_name(F->names, name, &slot)) {
+            if (F->slots[slot])
+                redefine_error(L, name);
+            else
+                F->slots[slot] = value;
             return;
         }
-        kvs = LITH_CDR(kvs);
+        extras = &F->extras;
+    } else {
+        ns_define(L, NAMESPACE(V), name, value);
+        return;
+    }
+    if (assq(*extras, name)) {
+        redefine_error(L, name);
+        return;
     }
     kv = LITH_CONS(L, name, value);
     if (!kv) return;
-    LITH_CDR(V) = LITH_CONS(L, kv, LITH_CDR(V));
+    kvs = LITH_CONS(L, kv, *extras);
+    if (!kvs) return;
+    *extras = kvs;
+    L->bindings++;
+    L->frame_extras = 1;
 }
 
 void lith_fill_env(lith_st *L, lith_lib lib)
@@ -1069,7 +6112,7 @@ void lith_fill_env(lith_st *L, lith_lib lib)
         name = lith_get_symbol(L, fns->name);
         if (!name) return;
         lith_env_put(L, V, name,
-            lith_make_builtin(L, name, fns->fn, fns->expect, fns->exact));
+            lith_make_builtin_argv(L, name, fns->fn, fns->expect, fns->exact));
     }
 }
 
@@ -1086,7 +6129,7 @@ int lith_expect_nargs(lith_st *L, char *name, size_t expect,
         E->nargs.expected = expect;
         E->nargs.exact = exact;
         E->nargs.got = len;
-        E->expr = lith_copy_value(L, args);
+        E->expr = args;
         return 0;
     } else {
         return 1;
@@ -1103,20 +6146,323 @@ int lith_expect_type(lith_st *L, char *name, size_t narg,
     L->error = LITH_ERR_TYPE;
     E->name = name;
     E->type.expected = type;
-    E->type.got = val->type;
+    E->type.got = LITH_TYPE_OF(val);
     E->type.narg = narg;
-    E->expr = lith_copy_value(L, val);
+    E->expr = val;
     return 0;
 }
 
-lith_value *lith_eval_expr(lith_st *L, lith_env *V, lith_value *expr)
+static lith_value *eval_expr(lith_st *, lith_env *, lith_value *);
+
+/* the evaluator stops before it overflows the C stack:
+ * how much of it is used is measured from the outermost evaluation,
+ * and is not outside of one
+ */
+static int check_depth(lith_st *L)
+{
+    char here;
+    size_t used;
+    if (!L->cstack) return 1;
+    used = (L->cstack > &here) ? (size_t) (L->cstack - &here)
+        : (size_t) (&here - L->cstack);
+    if (used < L->cstack_limit) return 1;
+    lith_simple_error(L, LITH_ERR_NOMEM, "nesting too deep for the C stack");
+    return 0;
+}
+
+/* evaluate a value which is not reachable from anywhere else */
+static lith_value *eval_rooted(lith_st *L, lith_env *V, lith_value *expr)
+{
+    size_t sp;
+    lith_value *val;
+    sp = L->gc.sp;
+    if (!push_root(L, expr)) return NULL;
+    val = eval_expr(L, V, expr);
+    L->gc.sp = sp;
+    return val;
+}
+
+static void name_callable(lith_value *val, lith_value *name)
+{
+    if (LITH_IS_CALLABLE(val) && !val->value.callable->name)
+        val->value.callable->name = name;
+}
+
+/* what is wrong with the arguments and the body of a lambda expression,
+ * the number of the arguments before the rest argument otherwise
+ */
+static char *lambda_error(lith_value *rest, size_t *expect, int *exact)
+{
+    size_t i;
+    lith_value *q;
+    if (!is_proper_list(LITH_CDR(rest)))
+        return "body of lambda expression must be proper list";
+    for (i = 0, q = LITH_CAR(rest); LITH_IS(q, LITH_TYPE_PAIR); q = LITH_CDR(q), i++)
+        if (!LITH_IS(LITH_CAR(q), LITH_TYPE_SYMBOL))
+            return "arguments in lambda expression must be symbols";
+    if (!LITH_IS_NIL(q) && !LITH_IS(q, LITH_TYPE_SYMBOL))
+        return "arguments in lambda expression must be symbols";
+    *expect = i;
+    *exact = LITH_IS_NIL(q);
+    return NULL;
+}
+
+static lith_value *make_lambda(lith_st *L, lith_env *V, lith_value *rest)
+{
+    size_t expect;
+    int exact;
+    char *msg;
+    if (!lith_expect_nargs(L, "{lambda}", 2, rest, 0))
+        return NULL;
+    if ((msg = lambda_error(rest, &expect, &exact))) {
+        lith_simple_error(L, LITH_ERR_SYNTAX, msg);
+        return NULL;
+    }
+    return lith_make_closure(L, V, NULL, LITH_CAR(rest), LITH_CDR(rest),
+        expect, exact);
+}
+
+/* a lambda expression inside a closure in the scope:
+ * it is left to be evaluated as it is when that is an error
+ */
+static lith_value *make_proto(lith_st *L, struct lith_scope *S, lith_value *expr)
+{
+    size_t expect;
+    int exact;
+    lith_value *rest, *lambda;
+    rest = LITH_CDR(expr);
+    if (!LITH_IS(rest, LITH_TYPE_PAIR) || !LITH_IS(LITH_CDR(rest), LITH_TYPE_PAIR)
+    || lambda_error(rest, &expect, &exact)) return expr;
+    lambda = new_lambda(L, S, NULL, LITH_CAR(rest), LITH_CDR(rest), expect, exact);
+    if (lambda || (L->error == LITH_ERR_NOMEM)) return lambda;
+    lith_clear_error_state(L);
+    return expr;
+}
+
+/* the macro and the call are kept reachable by the caller,
+ * the expansion of a call with a macro is made only the first time
+ */
+static lith_value *expand_macro(lith_st *L, lith_env *V,
+                                lith_value *f, lith_value *expr)
+{
+    size_t sp;
+    lith_value *rest, *val;
+    if ((val = find_expansion(L, expr, f))) return val;
+    sp = L->gc.sp;
+    rest = unresolve(L, V, LITH_CDR(expr));
+    if (!rest || !push_root(L, rest)) return NULL;
+    val = apply(L, f, rest);
+    L->gc.sp = sp;
+    if (val) cache_expansion(L, expr, f, val);
+    return val;
+}
+
+static lith_value *eval_macro_call(lith_st *L, lith_env *V,
+                                   lith_value *f, lith_value *expr)
+{
+    lith_value *val;
+    val = expand_macro(L, V, f, expr);
+    if (!val) return NULL;
+    return eval_rooted(L, V, val);
+}
+
+/* a let or begin expression: the frame is made and left on the eval stack,
+ * the body is evaluated in it up to its last expression, which is returned
+ * to be evaluated in place of the whole
+ */
+static lith_value *eval_block(lith_st *L, lith_env *V, lith_value *f,
+                              lith_value *rest, lith_env **env)
+{
+    lith_value *names, *vals, *body, *p, *val, **tail;
+    size_t i, slot;
+    int source;
+    source = 0;
+    if (f == L->forms[LITH_FORM_BEGIN]) {
+        if (!lith_expect_nargs(L, "begin", 1, rest, 0)) return NULL;
+        names = vals = L->nil;
+        body = rest;
+    } else if (is_block(L, rest)) {
+        names = LITH_CAR(LITH_CDR(LITH_CAR(rest)));
+        vals = LITH_CAR(LITH_CDR(rest));
+        body = LITH_CDR(LITH_CDR(rest));
+    } else {
+        if (!lith_expect_nargs(L, "let", 2, rest, 0)) return NULL;
+        vals = LITH_CAR(rest);
+        body = LITH_CDR(rest);
+        if (!is_list(vals)) {
+            lith_expect_type(L, "let", 1, LITH_TYPE_PAIR, vals);
+            return NULL;
+        }
+        names = L->nil;
+        tail = &names;
+        for (p = vals; !LITH_IS_NIL(p); p = LITH_CDR(p)) {
+            val = LITH_CAR(p);
+            if (!LITH_IS(val, LITH_TYPE_PAIR) || !is_proper_list(val)
+            || (list_length(val) != 2)) {
+                lith_simple_error(L, LITH_ERR_SYNTAX,
+                    "bindings in let expression must be (name value) lists");
+                return NULL;
+            }
+            if (!LITH_IS(LITH_CAR(val), LITH_TYPE_SYMBOL)) {
+                lith_simple_error(L, LITH_ERR_SYNTAX,
+                    "names in let expression must be symbols");
+                return NULL;
+            }
+            if (find_name(names, LITH_CAR(val), &slot)) {
+                redefine_error(L, LITH_CAR(val));
+                return NULL;
+            }
+            if (!(*tail = LITH_CONS(L, LITH_CAR(val), L->nil))) return NULL;
+            tail = &LITH_CDR(*tail);
+        }
+        source = 1;
+    }
+    *env = V;
+    if (names != L->False) {
+        *env = new_frame(L, V, names, list_length(names));
+        if (!*env || !push_root(L, *env)) return NULL;
+        for (i = 0; !LITH_IS_NIL(vals); i++, vals = LITH_CDR(vals)) {
+            p = LITH_CAR(vals);
+            val = eval_expr(L, V, source ? LITH_CAR(LITH_CDR(p)) : p);
+            if (!val) return NULL;
+            FRAME(*env)->slots[i] = val;
+        }
+    }
+    for (; !LITH_IS_NIL(LITH_CDR(body)); body = LITH_CDR(body))
+        if (!eval_expr(L, *env, LITH_CAR(body))) return NULL;
+    return LITH_CAR(body);
+}
+
+/* the unquoted parts of the template are evaluated,
+ * the pairs without any are shared with the template
+ */
+static lith_value *eval_template(lith_st *L, lith_env *V, lith_value *x)
+{
+    size_t sp;
+    lith_value *a, *d;
+    int splice;
+    if (!LITH_IS(x, LITH_TYPE_PAIR))
+        return x;
+    a = LITH_CAR(x);
+    if (a == L->sym_unquote) {
+        if (!is_proper_list(x)
+        || !lith_expect_nargs(L, "unquote", 1, LITH_CDR(x), 1)) return NULL;
+        return eval_expr(L, V, LITH_CAR(LITH_CDR(x)));
+    }
+    splice = LITH_IS(a, LITH_TYPE_PAIR) && (LITH_CAR(a) == L->sym_unquote_splicing);
+    if (splice) {
+        if (!is_proper_list(a)
+        || !lith_expect_nargs(L, "unquote-splicing", 1, LITH_CDR(a), 1))
+            return NULL;
+        a = eval_expr(L, V, LITH_CAR(LITH_CDR(a)));
+    } else {
+        a = eval_template(L, V, a);
+    }
+    sp = L->gc.sp;
+    if (!a || !push_root(L, a)) return NULL;
+    d = eval_template(L, V, LITH_CDR(x));
+    if (d) {
+        if (splice)
+            d = append_list(L, a, d);
+        else if ((a != LITH_CAR(x)) || (d != LITH_CDR(x)))
+            d = LITH_CONS(L, a, d);
+        else
+            d = x;
+    }
+    L->gc.sp = sp;
+    return d;
+}
+
+/* the arguments of a call in a list */
+static lith_value *list_of_args(lith_st *L, size_t argc, lith_value **argv)
+{
+    lith_value *list;
+    list = L->nil;
+    while (argc--) {
+        list = LITH_CONS(L, argv[argc], list);
+        if (!list) return NULL;
+    }
+    return list;
+}
+
+/* the callable, when it can be called with the arguments:
+ * the arguments of a call are kept in an array on the eval stack,
+ * they are put in a list only to be shown in the error
+ */
+static lith_callable *check_call(lith_st *L, lith_value *f,
+                                 size_t argc, lith_value **argv)
+{
+    lith_callable *fn;
+    lith_value *args;
+    if (!LITH_IS_CALLABLE(f)) {
+        lith_simple_error(L, LITH_ERR_TYPE, "can not call non-callable");
+        L->error_state.name = "{apply}";
+        return NULL;
+    }
+    fn = f->value.callable;
+    if (fn->exact ? (argc == fn->expect) : (argc >= fn->expect))
+        return fn;
+    args = list_of_args(L, argc, argv);
+    if (args)
+        lith_expect_nargs(L, fn->name ? fn->name->value.symbol.name : "{lambda}",
+            fn->expect, args, fn->exact);
+    return NULL;
+}
+
+/* the frame of a call of the closure, with the arguments in their slots */
+static lith_env *call_frame(lith_st *L, lith_callable *fn,
+                            size_t argc, lith_value **argv)
 {
     size_t i;
-    lith_value *f, *rest, *sym, *val, *args, *p, *q, *r;
-    if (LITH_IS(expr, LITH_TYPE_SYMBOL)) {
-        return lith_copy_value(L, lith_env_get(L, V, expr));
+    lith_env *env;
+    lith_value **slots;
+    env = new_frame(L, fn->parent, fn->args, fn->nslots);
+    if (!env) return NULL;
+    slots = FRAME(env)->slots;
+    for (i = 0; i < fn->expect; i++)
+        slots[i] = argv[i];
+    if (!fn->exact && !(slots[i] = list_of_args(L, argc - i, argv + i)))
+        return NULL;
+    return env;
+}
+
+/* the body of a walked closure is evaluated in the frame of the call,
+ * which is left on the eval stack, up to the last expression:
+ * that one is returned to be evaluated in place of the call
+ */
+static lith_value *walk_body(lith_st *L, lith_callable *fn,
+                             size_t argc, lith_value **argv, lith_env **env)
+{
+    lith_value *body;
+    *env = call_frame(L, fn, argc, argv);
+    if (!*env || !push_root(L, *env)) return NULL;
+    body = fn->body;
+    if (LITH_IS_NIL(body)) return L->nil;
+    for (; !LITH_IS_NIL(LITH_CDR(body)); body = LITH_CDR(body))
+        if (!eval_expr(L, *env, LITH_CAR(body))) return NULL;
+    return LITH_CAR(body);
+}
+
+/* the caller keeps V and expr reachable from the roots,
+ * the values made here are kept on the eval stack while they are in use,
+ * an expression in tail position is evaluated in place of this one:
+ * with its environment on the eval stack, from where this one began
+ */
+static lith_value *eval_expr(lith_st *L, lith_env *V, lith_value *expr)
+{
+    size_t base, sp, argc;
+    lith_value *f, *rest, *sym, *val, *args, *p, *q, *r, **argv;
+    lith_callable *fn;
+    if (!check_depth(L)) return NULL;
+    base = L->gc.sp;
+tail:
+    gc_safepoint(L);
+    if (LITH_TAG(expr) == LITH_TAG_LOCAL) {
+        return local_get(L, V, expr);
+    } else if (LITH_IS(expr, LITH_TYPE_SYMBOL)) {
+        return lith_env_get(L, V, expr);
     } else if (!LITH_IS(expr, LITH_TYPE_PAIR)) {
-        return lith_copy_value(L, expr);
+        return expr;
     } else if (!is_proper_list(expr)) {
         lith_simple_error(L, LITH_ERR_SYNTAX, 
             "atom or proper list expected as expression");
@@ -1125,48 +6471,61 @@ lith_value *lith_eval_expr(lith_st *L, lith_env *V, lith_value *expr)
     f = LITH_CAR(expr);
     rest = LITH_CDR(expr);
     if (LITH_IS(f, LITH_TYPE_SYMBOL)) {
-        if (LITH_SYM_EQ(f, "quote")) {
+        switch (f->value.symbol.form) {
+        case LITH_FORM_QUOTE:
             if (!lith_expect_nargs(L, "quote", 1, rest, 1))
                 return NULL;
-            return lith_copy_value(L, LITH_CAR(rest));
-        } else if (LITH_SYM_EQ(f, "eval!")) {
+            return LITH_CAR(rest);
+        case LITH_FORM_EVAL:
             if (!lith_expect_nargs(L, "eval!", 1, rest, 1))
                 return NULL;
-            val = lith_eval_expr(L, V, LITH_CAR(rest));
-            if (!val) return NULL;
-            return lith_eval_expr(L, V, val); 
-        } else if (LITH_SYM_EQ(f, "if")) {
+            expr = eval_expr(L, V, LITH_CAR(rest));
+            if (!expr) return NULL;
+            goto tail_root;
+        case LITH_FORM_IF:
             if (!lith_expect_nargs(L, "if", 3, rest, 1)) return NULL;
-            val = lith_eval_expr(L, V, LITH_CAR(rest));
+            val = eval_expr(L, V, LITH_CAR(rest));
             if (LITH_IS_ERR(L)) return NULL;
             p = LITH_CDR(rest);
-            return lith_eval_expr(L, V, LITH_CAR(LITH_TO_BOOL(val) ? p : LITH_CDR(p)));
-        } else if (LITH_SYM_EQ(f, "def")) {
+            expr = LITH_CAR(LITH_TO_BOOL(val) ? p : LITH_CDR(p));
+            goto tail;
+        case LITH_FORM_DEF:
             if (!lith_expect_nargs(L, "def", 2, rest, 1))
                 return NULL;
             sym = LITH_CAR(rest);
             p = LITH_CDR(rest);
-            if (!lith_expect_type(L, "def", 1, LITH_TYPE_SYMBOL, sym)) return NULL;
-            val = lith_eval_expr(L, V, LITH_CAR(p));
-            if (LITH_IS_CALLABLE(val))
-                val->value.callable->name = sym;
+            if ((LITH_TAG(sym) != LITH_TAG_LOCAL)
+            && !lith_expect_type(L, "def", 1, LITH_TYPE_SYMBOL, sym)) return NULL;
+            val = eval_expr(L, V, LITH_CAR(p));
             if (!val) return NULL;
-            lith_env_put(L, V, sym, val);
+            name_callable(val, (LITH_TAG(sym) == LITH_TAG_LOCAL)
+                ? local_name(V, sym) : sym);
+            if (LITH_TAG(sym) == LITH_TAG_LOCAL)
+                local_def(L, V, sym, val);
+            else
+                lith_env_put(L, V, sym, val);
+            if (LITH_IS_ERR(L)) return NULL;
             return L->nil;
-        } else if (LITH_SYM_EQ(f, "set!")) {
+        case LITH_FORM_SET:
             if (!lith_expect_nargs(L, "set!", 2, rest, 1))
                 return NULL;
             sym = LITH_CAR(rest);
             val = LITH_CAR(LITH_CDR(rest));
-            if (!lith_expect_type(L, "set!", 1, LITH_TYPE_SYMBOL, sym))
+            if ((LITH_TAG(sym) != LITH_TAG_LOCAL)
+            && !lith_expect_type(L, "set!", 1, LITH_TYPE_SYMBOL, sym))
                 return NULL;
-            val = lith_eval_expr(L, V, val);
+            val = eval_expr(L, V, val);
             if (!val) return NULL;
-            lith_env_set(L, V, sym, val);
-            if (LITH_IS_CALLABLE(val))
-                val->value.callable->name = sym;
+            if (LITH_TAG(sym) == LITH_TAG_LOCAL) {
+                local_set(L, V, sym, val);
+                sym = local_name(V, sym);
+            } else {
+                lith_env_set(L, V, sym, val);
+            }
+            if (LITH_IS_ERR(L)) return NULL;
+            name_callable(val, sym);
             return L->nil;
-        } else if (LITH_SYM_EQ(f, "macro")) {
+        case LITH_FORM_MACRO:
             if (!lith_expect_nargs(L, "macro", 2, rest, 0))
                 return NULL;
             args = LITH_CAR(rest);
@@ -1178,102 +6537,581 @@ lith_value *lith_eval_expr(lith_st *L, lith_env *V, lith_value *expr)
                 return NULL;
             q = LITH_CONS(L, LITH_CDR(args), p);
             if (!q) return NULL;
-            r = LITH_CONS(L, lith_get_symbol(L, "lambda"), q);
-            if (!r) { lith_free_value(q); return NULL; }
-            val = lith_eval_expr(L, V, r);
+            r = LITH_CONS(L, L->forms[LITH_FORM_LAMBDA], q);
+            if (!r) return NULL;
+            val = eval_rooted(L, V, r);
             if (!val) return NULL;
             val->type = LITH_TYPE_MACRO;
             val->value.callable->name = sym;
             lith_env_put(L, V, sym, val);
             return L->nil;
-        } else if (LITH_SYM_EQ(f, "lambda")) {
-            if (!lith_expect_nargs(L, "{lambda}", 2, rest, 0))
-                return NULL;
-            args = LITH_CAR(rest);
-            p = LITH_CDR(rest);
-            if (!is_proper_list(p)) {
-                lith_simple_error(L, LITH_ERR_SYNTAX,
-                    "body of lambda expression must be proper list");
-                return NULL;
-            }
-            for (i = 0, q = args; LITH_IS(q, LITH_TYPE_PAIR); q = LITH_CDR(q), i++) {
-                if (!LITH_IS(LITH_CAR(q), LITH_TYPE_SYMBOL)) {
-                    lith_simple_error(L, LITH_ERR_SYNTAX,
-                        "arguments in lambda expression must be symbols");
+        case LITH_FORM_LAMBDA:
+            if (LITH_IS(rest, LITH_TYPE_PAIR) && IS_LAMBDA(LITH_CAR(rest)))
+                return close_lambda(L, V, NULL, LITH_CAR(rest));
+            return make_lambda(L, V, rest);
+        case LITH_FORM_LET:
+        case LITH_FORM_BEGIN:
+            if (!(expr = eval_block(L, V, f, rest, &V))) return NULL;
+            goto tail_root;
+        case LITH_FORM_COND:
+            for (; !LITH_IS_NIL(rest); rest = LITH_CDR(rest)) {
+                p = LITH_CAR(rest);
+                if (!LITH_IS(p, LITH_TYPE_PAIR) || !is_proper_list(p)) {
+                    lith_simple_error(L, LITH_ERR_CUSTOM,
+                        "cond: expecting a list as clause");
                     return NULL;
                 }
+                if (LITH_CAR(p) != L->sym_else) {
+                    val = eval_expr(L, V, LITH_CAR(p));
+                    if (!val) return NULL;
+                    if (!LITH_TO_BOOL(val)) continue;
+                }
+                expr = eval_block(L, V, L->forms[LITH_FORM_BEGIN], LITH_CDR(p), &V);
+                if (!expr) return NULL;
+                goto tail_root;
             }
-            if (!LITH_IS_NIL(q) && !LITH_IS(q, LITH_TYPE_SYMBOL)) {
-                lith_simple_error(L, LITH_ERR_SYNTAX,
-                    "arguments in lambda expression must be symbols");
-                return NULL;
+            lith_simple_error(L, LITH_ERR_CUSTOM, "cond: no else clause");
+            return NULL;
+        case LITH_FORM_AND:
+        case LITH_FORM_OR:
+            for (; !LITH_IS_NIL(rest); rest = LITH_CDR(rest)) {
+                val = eval_expr(L, V, LITH_CAR(rest));
+                if (!val) return NULL;
+                if (LITH_TO_BOOL(val) != (f == L->forms[LITH_FORM_AND]))
+                    return LITH_IN_BOOL(f == L->forms[LITH_FORM_OR]);
             }
-            return lith_make_closure(L, V, NULL, args, p, i, LITH_IS_NIL(q));
+            return LITH_IN_BOOL(f == L->forms[LITH_FORM_AND]);
+        case LITH_FORM_QUASIQUOTE:
+            if (!lith_expect_nargs(L, "quasiquote", 1, rest, 1))
+                return NULL;
+            return eval_template(L, V, LITH_CAR(rest));
+        default: break;
         }
     }
-    f = lith_eval_expr(L, V, f);
+    f = eval_expr(L, V, f);
     if (!f) return NULL;
-    args = lith_copy_value(L, rest);
-    if (!args) return NULL;
+    sp = L->gc.sp;
+    if (!push_root(L, f)) return NULL;
     if (LITH_IS(f, LITH_TYPE_MACRO)) {
-        val = lith_apply(L, f, args);
-        if (!val) return NULL;
-        return lith_eval_expr(L, V, val);
+        expr = expand_macro(L, V, f, expr);
+        if (!expr) { L->gc.sp = sp; return NULL; }
+        goto tail_root;
     }
-    if (!LITH_IS_NIL(args)) {
-        rest = args;
-        val = lith_eval_expr(L, V, LITH_CAR(rest));
-        if (!val) return NULL;
-        args = LITH_CONS(L, val, L->nil);
-        if (!args) { lith_free_value(val); return NULL; }
-        rest = LITH_CDR(rest);
-        for (p = args; !LITH_IS_NIL(rest); p = LITH_CDR(p), rest = LITH_CDR(rest)) {
-            val = lith_eval_expr(L, V, LITH_CAR(rest));
-            if (!val) { lith_free_value(args); return NULL; }
-            q = LITH_CONS(L, val, L->nil);
-            if (!q) { lith_free_value(args); lith_free_value(val); return NULL; }
-            LITH_CDR(p) = q;
+    for (argc = 0; !LITH_IS_NIL(rest); argc++, rest = LITH_CDR(rest)) {
+        val = eval_expr(L, V, LITH_CAR(rest));
+        /* an evaluation may leave its frame on the eval stack */
+        L->gc.sp = sp + 1 + argc;
+        if (!val || !push_root(L, val)) { L->gc.sp = sp; return NULL; }
+    }
+    argv = L->gc.stack + sp + 1;
+    if (LITH_IS(f, LITH_TYPE_CLOSURE) && !f->value.callable->code) {
+        if (!(fn = check_call(L, f, argc, argv))
+        || !(expr = walk_body(L, fn, argc, argv, &V))) {
+            L->gc.sp = sp;
+            return NULL;
         }
+        goto tail_root;
     }
-    return lith_apply(L, f, args);
+    val = call(L, f, argc, argv);
+    L->gc.sp = sp;
+    return val;
+tail_root:
+    L->gc.sp = base;
+    if (!push_root(L, V) || !push_root(L, expr)) return NULL;
+    goto tail;
 }
 
-lith_value *lith_apply(lith_st *L, lith_value *f, lith_value *args)
+/* the values given to the evaluator are kept on the eval stack,
+ * everything reachable from there survives a collection
+ */
+lith_value *lith_eval_expr(lith_st *L, lith_env *V, lith_value *expr)
 {
-    lith_env *env;
-    lith_value *expected_args, *body, *r;
-    lith_callable *fn;
-    
-    if (!LITH_IS_CALLABLE(f)) {
-        lith_simple_error(L, LITH_ERR_TYPE, "can not call non-callable");
-        L->error_state.name = "{apply}";
+    size_t sp;
+    lith_value *val;
+    char here;
+    sp = L->gc.sp;
+    if (!push_root(L, V) || !push_root(L, expr)) return NULL;
+    if (L->cstack) {
+        val = eval_expr(L, V, expr);
+    } else {
+        L->cstack = &here;
+        val = eval_expr(L, V, expr);
+        L->cstack = NULL;
+    }
+    L->gc.sp = sp;
+    return val;
+}
+
+/* the binding of the global named by the constant k of the code:
+ * the names of the frames between are not that name, which the analyzer
+ * would have made a local otherwise, so without extras in the frames
+ * it is in a namespace, where it stays the same pair for good
+ */
+static lith_value **global_cell(lith_st *L, struct lith_code *code,
+                                lith_env *V, size_t k)
+{
+    struct lith_global_cache *cache;
+    lith_value **p;
+    cache = &code->caches[k];
+    if (cache->cell && (cache->bindings == L->bindings))
+        return cache->cell;
+    p = env_find(V, code->consts[k]);
+    if (!p) {
+        L->error = LITH_ERR_UNBOUND;
+        L->error_state.sym = code->consts[k]->value.symbol.name;
         return NULL;
     }
+    if (!L->frame_extras) {
+        cache->cell = p;
+        cache->bindings = L->bindings;
+    }
+    return p;
+}
+
+/* the call sites learn what they call:
+ * the first call of a numeric builtin on two fixnums, or on two floats,
+ * makes the site run it without calling it, for as long as it calls the
+ * same builtin on the same types, the site is called as before after
+ * the first call which is not so
+ */
+enum { NUM_ADD, NUM_SUBTRACT, NUM_MULTIPLY, NUM_LT, NUM_GT, NUM_EQ, NUM_LE, NUM_GE };
+
+static struct lith_numop {
+    lith_builtin_argv_function fn;
+    int op;
+} numops[] = {
+    {builtin__add, NUM_ADD}, {builtin__sum, NUM_ADD},
+    {builtin__subtract, NUM_SUBTRACT}, {builtin__difference, NUM_SUBTRACT},
+    {builtin__multiply, NUM_MULTIPLY}, {builtin__product, NUM_MULTIPLY},
+    {builtin__is_less_than, NUM_LT}, {builtin__less, NUM_LT},
+    {builtin__is_greater_than, NUM_GT}, {builtin__greater, NUM_GT},
+    {builtin__is_num_equal, NUM_EQ}, {builtin__num_equal, NUM_EQ},
+    {builtin__less_or_equal, NUM_LE}, {builtin__greater_or_equal, NUM_GE},
+    {NULL, 0}
+};
+
+/* the factors whose product is surely a fixnum */
+#define LITH_HALF_FIXNUM (1L << (4 * sizeof(long) - 2))
+
+/* NULL when the result is not a fixnum */
+static lith_value *fixnum_op(int op, long a, long b)
+{
+    long r;
+    switch (op) {
+    case NUM_ADD: r = a + b; break;
+    case NUM_SUBTRACT: r = a - b; break;
+    case NUM_MULTIPLY:
+        if ((a >= LITH_HALF_FIXNUM) || (a <= -LITH_HALF_FIXNUM)
+        || (b >= LITH_HALF_FIXNUM) || (b <= -LITH_HALF_FIXNUM)) return NULL;
+        r = a * b;
+        break;
+    case NUM_LT: return LITH_IN_BOOL(a < b);
+    case NUM_GT: return LITH_IN_BOOL(a > b);
+    case NUM_EQ: return LITH_IN_BOOL(a == b);
+    case NUM_LE: return LITH_IN_BOOL(a <= b);
+    default: return LITH_IN_BOOL(a >= b);
+    }
+    return LITH_FITS_FIXNUM(r) ? LITH_FIXNUM(r) : NULL;
+}
+
+static lith_value *flonum_op(lith_st *L, int op, double x, double y)
+{
+    switch (op) {
+    case NUM_ADD: return lith_make_number(L, x + y);
+    case NUM_SUBTRACT: return lith_make_number(L, x - y);
+    case NUM_MULTIPLY: return lith_make_number(L, x * y);
+    case NUM_LT: return LITH_IN_BOOL(x < y);
+    case NUM_GT: return LITH_IN_BOOL(x > y);
+    case NUM_EQ: return LITH_IN_BOOL(x == y);
+    case NUM_LE: return LITH_IN_BOOL(!(x > y));
+    default: return LITH_IN_BOOL(!(x < y));
+    }
+}
+
+/* the call op and its operand, on the first call of a builtin
+ * with two arguments there */
+static void quicken(unsigned int *op, lith_value *f, lith_value **argv)
+{
+    int k, tail;
+    tail = op[0] == OP_TAILCALL;
+    for (k = 0; numops[k].fn; k++)
+        if (numops[k].fn == f->value.callable->argv_function) break;
+    if (numops[k].fn && (LITH_TAG(argv[0]) == LITH_TAG_FIXNUM)
+    && (LITH_TAG(argv[1]) == LITH_TAG_FIXNUM)) {
+        op[0] = OP_FIXNUM2;
+        op[1] = 2 * k + tail;
+    } else if (numops[k].fn && LITH_IS(argv[0], LITH_TYPE_NUMBER)
+    && LITH_IS(argv[1], LITH_TYPE_NUMBER)) {
+        op[0] = OP_FLONUM2;
+        op[1] = 2 * k + tail;
+    } else {
+        op[0] = tail ? OP_TAILCALLX : OP_CALLX;
+    }
+}
+
+/* the virtual machine:
+ * runs the bytecode of a closure in a new frame,
+ * the stack of the machine is the top of the eval stack,
+ * each running closure has there where to return, itself and its frame,
+ * then the values it works with:
+ * a call of a compiled closure is run here, without recursion,
+ * a tail call replaces the running closure and its frame
+ */
+static lith_value *run_code(lith_st *L, lith_value *f,
+                            size_t argc, lith_value **argv)
+{
+    lith_callable *fn;
+    struct lith_code *code;
+    unsigned int *ip;
+    lith_value **consts, **stk, *val, **p, *a, *b;
+    struct lith_global_cache *cache;
+    struct lith_numop *num;
+    lith_env *V;
+    size_t top, base, sp, n, i;
+    if (!check_depth(L)) return NULL;
     fn = f->value.callable;
-    if (!lith_expect_nargs(L,
-        fn->name ? fn->name->value.symbol : "{lambda}",
-        fn->expect, args, fn->exact)) return NULL;
-    if (LITH_IS(f, LITH_TYPE_BUILTIN))
-        return (*fn->function)(L, args);
-    env = lith_new_env(L, fn->parent);
-    body = fn->body;
-    expected_args = fn->args;
-    while (LITH_IS(expected_args, LITH_TYPE_PAIR)) {
-        lith_env_put(L, env, LITH_CAR(expected_args), LITH_CAR(args));
-        expected_args = LITH_CDR(expected_args);
-        args = LITH_CDR(args);
-    }
-    if (!LITH_IS_NIL(expected_args))
-        lith_env_put(L, env, expected_args, args);
-    r = NULL;
-    while (!LITH_IS_NIL(body)) {
-        if (r) lith_free_value(r);
-        r = lith_eval_expr(L, env, LITH_CAR(body));
-        body = LITH_CDR(body);
+    V = call_frame(L, fn, argc, argv);
+    if (!V) return NULL;
+    top = L->gc.sp;
+    base = top + 2;
+    if (!reserve_stack(L, 4)) return NULL;
+    stk = L->gc.stack;
+    stk[top] = stk[top + 1] = L->nil;
+    stk[base] = f;
+    stk[base + 1] = V;
+    L->gc.sp = base + 2;
+enter:
+    gc_safepoint(L);
+    code = CODE(fn->code);
+    if (!reserve_stack(L, code->maxstack)) goto fail;
+    stk = L->gc.stack;
+    sp = base + 2;
+    ip = code->insns;
+    consts = code->consts;
+    for (;;) {
+        switch (*ip++) {
+        case OP_CONST:
+            stk[sp++] = consts[*ip++];
+            break;
+        case OP_LOCAL0:
+            val = FRAME(V)->slots[*ip];
+            if (!val && !(val = local_get(L, V, MAKE_LOCAL(0, *ip))))
+                goto fail;
+            ip++;
+            stk[sp++] = val;
+            break;
+        case OP_LOCAL:
+            val = local_get(L, V, MAKE_LOCAL(ip[0], ip[1]));
+            if (!val) goto fail;
+            ip += 2;
+            stk[sp++] = val;
+            break;
+        case OP_GLOBAL:
+            cache = &code->caches[*ip];
+            if (cache->cell && (cache->bindings == L->bindings)) {
+                val = *cache->cell;
+            } else {
+                p = global_cell(L, code, V, *ip);
+                if (!p) goto fail;
+                val = *p;
+            }
+            ip++;
+            stk[sp++] = val;
+            break;
+        case OP_DEFLOCAL:
+            name_callable(stk[sp - 1], slot_name(FRAME(V), *ip));
+            local_def(L, V, MAKE_LOCAL(0, *ip), stk[sp - 1]);
+            if (LITH_IS_ERR(L)) goto fail;
+            ip++;
+            stk[sp - 1] = L->nil;
+            break;
+        case OP_DEFGLOBAL:
+            name_callable(stk[sp - 1], consts[*ip]);
+            L->gc.sp = sp;
+            lith_env_put(L, V, consts[*ip++], stk[sp - 1]);
+            if (LITH_IS_ERR(L)) goto fail;
+            stk[sp - 1] = L->nil;
+            break;
+        case OP_SETLOCAL:
+            local_set(L, V, MAKE_LOCAL(ip[0], ip[1]), stk[sp - 1]);
+            if (LITH_IS_ERR(L)) goto fail;
+            name_callable(stk[sp - 1], local_name(V, MAKE_LOCAL(ip[0], ip[1])));
+            ip += 2;
+            stk[sp - 1] = L->nil;
+            break;
+        case OP_SETGLOBAL:
+            p = global_cell(L, code, V, *ip);
+            if (!p) goto fail;
+            *p = stk[sp - 1];
+            name_callable(stk[sp - 1], consts[*ip++]);
+            stk[sp - 1] = L->nil;
+            break;
+        case OP_POP:
+            sp--;
+            break;
+        case OP_JUMP:
+            ip = code->insns + *ip;
+            break;
+        case OP_JUMPF:
+            val = stk[--sp];
+            ip = LITH_TO_BOOL(val) ? (ip + 1) : (code->insns + *ip);
+            break;
+        case OP_GUARD:
+            val = stk[--sp];
+            ip = (val == consts[ip[0]]) ? (ip + 2) : (code->insns + ip[1]);
+            break;
+        case OP_MACRO:
+            if (!LITH_IS(stk[sp - 1], LITH_TYPE_MACRO)) {
+                ip += 2;
+                break;
+            }
+            L->gc.sp = sp;
+            val = eval_macro_call(L, V, stk[sp - 1], consts[ip[0]]);
+            stk = L->gc.stack;
+            if (!val) goto fail;
+            stk[sp - 1] = val;
+            ip = code->insns + ip[1];
+            break;
+        case OP_CALL:
+        case OP_TAILCALL:
+            f = stk[sp - *ip - 1];
+            if ((*ip == 2) && LITH_IS(f, LITH_TYPE_BUILTIN)) {
+                quicken(ip - 1, f, stk + sp - 2);
+                if ((ip[-1] == OP_FIXNUM2) || (ip[-1] == OP_FLONUM2)) {
+                    ip--;
+                    break;
+                }
+            }
+            /* fall through */
+        case OP_CALLX:
+        case OP_TAILCALLX:
+            n = *ip++;
+            f = stk[sp - n - 1];
+            L->gc.sp = sp;
+            if (!LITH_IS(f, LITH_TYPE_CLOSURE) || !f->value.callable->code) {
+                val = call(L, f, n, stk + sp - n);
+                stk = L->gc.stack;
+                if (!val) goto fail;
+                sp -= n;
+                stk[sp - 1] = val;
+                break;
+            }
+            if (!(fn = check_call(L, f, n, stk + sp - n))
+            || !(V = call_frame(L, fn, n, stk + sp - n)))
+                goto fail;
+            sp -= n;
+            L->gc.sp = sp;
+            if (!reserve_stack(L, 4)) goto fail;
+            stk = L->gc.stack;
+            if ((ip[-2] == OP_CALL) || (ip[-2] == OP_CALLX)) {
+                stk[sp] = LITH_FIXNUM(ip - code->insns);
+                stk[sp + 1] = LITH_FIXNUM(base);
+                base = sp + 2;
+            }
+            stk[base] = f;
+            stk[base + 1] = V;
+            L->gc.sp = base + 2;
+            goto enter;
+        case OP_CLOSURE:
+            L->gc.sp = sp;
+            val = close_lambda(L, V, NULL, consts[*ip++]);
+            stk = L->gc.stack;
+            if (!val) goto fail;
+            stk[sp++] = val;
+            break;
+        case OP_EVAL:
+            L->gc.sp = sp;
+            val = eval_expr(L, V, consts[*ip++]);
+            stk = L->gc.stack;
+            if (!val) goto fail;
+            stk[sp++] = val;
+            break;
+        case OP_ENTER:
+            val = new_frame(L, V, consts[ip[0]], list_length(consts[ip[0]]));
+            if (!val) goto fail;
+            n = ip[1];
+            sp -= n;
+            for (i = 0; i < n; i++)
+                FRAME(val)->slots[i] = stk[sp + i];
+            V = val;
+            stk[base + 1] = V;
+            ip += 2;
+            break;
+        case OP_LEAVE:
+            V = FRAME(V)->parent;
+            stk[base + 1] = V;
+            break;
+        case OP_CONS:
+            val = LITH_CONS(L, stk[sp - 2], stk[sp - 1]);
+            if (!val) goto fail;
+            stk[--sp - 1] = val;
+            break;
+        case OP_APPEND:
+            val = append_list(L, stk[sp - 2], stk[sp - 1]);
+            if (!val) goto fail;
+            stk[--sp - 1] = val;
+            break;
+        case OP_CELL:
+            stk[sp++] = LITH_CDR(consts[*ip++]);
+            break;
+        case OP_TEMP:
+            val = stk[base + 2 + *ip++];
+            stk[sp++] = val;
+            break;
+        case OP_SLIDE:
+            n = *ip++;
+            stk[sp - n - 1] = stk[sp - 1];
+            sp -= n;
+            break;
+        case OP_FIXNUM2:
+        case OP_FLONUM2:
+            num = &numops[*ip >> 1];
+            f = stk[sp - 3];
+            a = stk[sp - 2];
+            b = stk[sp - 1];
+            if (!LITH_IS(f, LITH_TYPE_BUILTIN) || (f->value.callable->argv_function != num->fn)
+            || ((ip[-1] == OP_FIXNUM2)
+                ? ((LITH_TAG(a) != LITH_TAG_FIXNUM) || (LITH_TAG(b) != LITH_TAG_FIXNUM))
+                : (!LITH_IS(a, LITH_TYPE_NUMBER) || !LITH_IS(b, LITH_TYPE_NUMBER)))) {
+                ip[-1] = (*ip & 1) ? OP_TAILCALLX : OP_CALLX;
+                *ip = 2;
+                ip--;
+                break;
+            }
+            if (ip[-1] == OP_FLONUM2) {
+                val = flonum_op(L, num->op, LITH_NUMBER(a), LITH_NUMBER(b));
+            } else if (!(val = fixnum_op(num->op, LITH_FIXNUM_VALUE(a), LITH_FIXNUM_VALUE(b)))) {
+                L->gc.sp = sp;
+                val = (*num->fn)(L, 2, stk + sp - 2);
+            }
+            if (!val) goto fail;
+            ip++;
+            sp -= 2;
+            stk[sp - 1] = val;
+            break;
+        case OP_RETURN:
+            val = stk[sp - 1];
+            if (base == top + 2) {
+                L->gc.sp = top;
+                return val;
+            }
+            sp = base - 2;
+            i = LITH_FIXNUM_VALUE(stk[base - 2]);
+            base = LITH_FIXNUM_VALUE(stk[base - 1]);
+            stk[sp - 1] = val;
+            fn = stk[base]->value.callable;
+            V = stk[base + 1];
+            code = CODE(fn->code);
+            ip = code->insns + i;
+            consts = code->consts;
+            break;
+        }
     }
+fail:
+    L->gc.sp = top;
+    return NULL;
+}
+
+/* the arguments are on the eval stack, under its top */
+static lith_value *call(lith_st *L, lith_value *f, size_t argc, lith_value **argv)
+{
+    size_t sp;
+    lith_env *env;
+    lith_value *expr, *r;
+    lith_callable *fn;
+    
+    if (!(fn = check_call(L, f, argc, argv))) return NULL;
+    if (LITH_IS(f, LITH_TYPE_BUILTIN) && fn->argv_function)
+        return (*fn->argv_function)(L, argc, argv);
+    sp = L->gc.sp;
+    if (LITH_IS(f, LITH_TYPE_BUILTIN)) {
+        expr = list_of_args(L, argc, argv);
+        r = (expr && push_root(L, expr)) ? (*fn->function)(L, expr) : NULL;
+        L->gc.sp = sp;
+        return r;
+    }
+    if (fn->code)
+        return run_code(L, f, argc, argv);
+    expr = walk_body(L, fn, argc, argv, &env);
+    r = expr ? eval_expr(L, env, expr) : NULL;
+    L->gc.sp = sp;
     return r;
 }
 
+/* the arguments in the list are put on the eval stack */
+static lith_value *apply(lith_st *L, lith_value *f, lith_value *args)
+{
+    size_t sp, argc;
+    lith_value *val;
+    sp = L->gc.sp;
+    for (argc = 0; LITH_IS(args, LITH_TYPE_PAIR); argc++, args = LITH_CDR(args)) {
+        if (!push_root(L, LITH_CAR(args))) {
+            L->gc.sp = sp;
+            return NULL;
+        }
+    }
+    val = call(L, f, argc, L->gc.stack + sp);
+    L->gc.sp = sp;
+    return val;
+}
+
+lith_value *lith_apply(lith_st *L, lith_value *f, lith_value *args)
+{
+    size_t sp;
+    lith_value *val;
+    char here;
+    sp = L->gc.sp;
+    if (!push_root(L, f) || !push_root(L, args)) return NULL;
+    if (L->cstack) {
+        val = apply(L, f, args);
+    } else {
+        L->cstack = &here;
+        val = apply(L, f, args);
+        L->cstack = NULL;
+    }
+    L->gc.sp = sp;
+    return val;
+}
+
+lith_value *lith_call(lith_st *L, lith_value *f, size_t argc, lith_value **argv)
+{
+    return call(L, f, argc, argv);
+}
+
+int lith_reserve_stack(lith_st *L, size_t n)
+{
+    return reserve_stack(L, n);
+}
+
+int lith_check_depth(lith_st *L)
+{
+    return check_depth(L);
+}
+
+int lith_push_root(lith_st *L, lith_value *val)
+{
+    return push_root(L, val);
+}
+
+lith_value **lith_env_find(lith_env *V, lith_value *name)
+{
+    return env_find(V, name);
+}
+
+void lith_disassemble(lith_st *L, lith_value *f, FILE *file)
+{
+    lith_callable *fn;
+    lith_print_value(L, f, file);
+    fputc('\n', file);
+    if (!LITH_IS(f, LITH_TYPE_CLOSURE) && !LITH_IS(f, LITH_TYPE_MACRO))
+        return;
+    fn = f->value.callable;
+    if (fn->code)
+        disassemble(L, CODE(fn->code), file);
+    else
+        fprintf(file, "; not compiled\n");
+}
+
 void lith_run_string(lith_st *L, lith_env *V, char *input, int repl)
 {
     char *end;
@@ -1291,10 +7129,8 @@ void lith_run_string(lith_st *L, lith_env *V, char *input, int repl)
             if ((res = lith_eval_expr(L, V, expr))) {
                 printf("-> ");
                 lith_print_value(L, res, stdout);
-                lith_free_value(res);
                 putchar('\n');
             }
-            lith_free_value(expr);
         }
     }
     
@@ -1317,12 +7153,8 @@ void lith_run_file(lith_st *L, lith_env *V, char *filename)
     end = contents;
     while (!LITH_IS_ERR(L)) {
         if ((expr = lith_read_expr(L, end, &end))) {
-            if ((result = lith_eval_expr(L, V, expr))) {
-                lith_free_value(result);
-            } else {
+            if (!(result = lith_eval_expr(L, V, expr)))
                 break;
-            }
-            lith_free_value(expr);
         }
     }
     free(contents);
@@ -1336,6 +7168,5 @@ void lith_run_file(lith_st *L, lith_env *V, char *filename)
         fprintf(stderr, "error occurred when evaluating the expression:\n\t");
         lith_print_value(L, expr, stderr);
         fputc('\n', stderr);
-        lith_free_value(expr);
     }
 }
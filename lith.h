@@ -2,6 +2,7 @@
 #ifndef lith_h
 #define lith_h
 
+#include <limits.h>
 #include <stddef.h>
 #include <stdio.h>
 
@@ -11,6 +12,9 @@ typedef struct lith_value lith_value;
 typedef struct lith_value lith_env;
 typedef struct lith_state lith_st;
 typedef struct lith_string lith_string;
+typedef struct lith_vector lith_vector;
+typedef struct lith_array lith_array;
+typedef struct lith_table lith_table;
 typedef struct lith_callable lith_callable;
 typedef struct lith_lib_fn *lith_lib;
 
@@ -37,53 +41,164 @@ enum lith_value_type {
     LITH_TYPE_BUILTIN,
     LITH_TYPE_CLOSURE,
     LITH_TYPE_MACRO,
+    LITH_TYPE_VECTOR,
+    LITH_TYPE_F64ARRAY,
+    LITH_TYPE_I64ARRAY,
+    LITH_TYPE_TABLE,
+    LITH_TYPE_PMAP,
+    LITH_TYPE_PVECTOR,
     
     LITH_NTYPES /* number of types */
 };
 
+/* the special forms, known by the symbol heading the expression */
+enum lith_form {
+    LITH_FORM_NONE,
+    LITH_FORM_QUOTE,
+    LITH_FORM_EVAL,
+    LITH_FORM_IF,
+    LITH_FORM_DEF,
+    LITH_FORM_SET,
+    LITH_FORM_MACRO,
+    LITH_FORM_LAMBDA,
+    LITH_FORM_LET,
+    LITH_FORM_BEGIN,
+    LITH_FORM_COND,
+    LITH_FORM_AND,
+    LITH_FORM_OR,
+    LITH_FORM_QUASIQUOTE,
+
+    LITH_NFORMS /* number of special forms, and none */
+};
+
 /* ISO C forbids forward references to 'enum' types */
 typedef enum lith_value_type lith_valtype;
 
 typedef lith_value *(*lith_builtin_function)(lith_st *, lith_value *);
+/* the arguments in an array, which is valid until the builtin evaluates
+ * anything or calls anything */
+typedef lith_value *(*lith_builtin_argv_function)(lith_st *, size_t, lith_value **);
+
+/* a value is a word: the low bits tell what the rest of the word is
+ *   heap: pointer to a struct lith_value, which has a type
+ *   fixnum: integer in the upper bits
+ *   pair: pointer to a struct lith_pair
+ *   flonum: a double with a small exponent, rotated and offset
+ *   nil, boolean: nothing or the truth value in the upper bits
+ *   local: a variable of a closure, by its place in the frames
+ */
+#define LITH_TAG_BITS 3
+#define LITH_TAG_MASK 7
+#define LITH_TAG_HEAP 0
+#define LITH_TAG_FIXNUM 1
+#define LITH_TAG_PAIR 2
+#define LITH_TAG_FLONUM 3
+#define LITH_TAG_NIL 4
+#define LITH_TAG_BOOLEAN 5
+#define LITH_TAG_LOCAL 6
+
+#define LITH_WORD(p) ((size_t) (p))
+#define LITH_TAG(p) (LITH_WORD(p) & LITH_TAG_MASK)
+#define LITH_IMMEDIATE(w, tag) ((lith_value *) (((size_t) (w) << LITH_TAG_BITS) | (tag)))
+
+#define LITH_NIL LITH_IMMEDIATE(0, LITH_TAG_NIL)
+#define LITH_FALSE LITH_IMMEDIATE(0, LITH_TAG_BOOLEAN)
+#define LITH_TRUE LITH_IMMEDIATE(1, LITH_TAG_BOOLEAN)
+
+/* integers out of this range are allocated on the heap */
+#define LITH_FIXNUM_MAX (LONG_MAX >> LITH_TAG_BITS)
+#define LITH_FIXNUM_MIN (-LITH_FIXNUM_MAX - 1)
+#define LITH_FITS_FIXNUM(n) (((n) >= LITH_FIXNUM_MIN) && ((n) <= LITH_FIXNUM_MAX))
+#define LITH_FIXNUM(n) LITH_IMMEDIATE(n, LITH_TAG_FIXNUM)
+#define LITH_FIXNUM_VALUE(p) (((long) LITH_WORD(p)) >> LITH_TAG_BITS)
+
+/* the doubles are 64 bits wide: some fit in a word of 64 bits */
+#if ULONG_MAX > 0xFFFFFFFFUL
+#define LITH_SMALL_FLOATS
+#endif
+
+struct lith_pair {
+    lith_value *car, *cdr;
+};
 
 struct lith_value {
     lith_valtype type;
     union {
-        int boolean;
         long integer;
         double number;
         struct lith_string {
             size_t len;
             char *buf;
         } string;
-        char *symbol;
-        struct {
-            struct lith_value *car, *cdr;
-        } pair;
+        /* the items are together, outside of the heap */
+        struct lith_vector {
+            size_t len;
+            lith_value **items;
+        } vector;
+        /* the numbers or the integers themselves, not their values */
+        struct lith_array {
+            size_t len;
+            union {
+                double *f64;
+                long *i64;
+            } items;
+        } array;
+        /* a hash table, with the keys compared by equal? */
+        struct lith_table *table;
+        /* a persistent map or vector: how many values, and the nodes */
+        struct lith_tree {
+            size_t len;
+            lith_value *root;
+        } tree;
+        struct lith_symbol {
+            char *name;
+            enum lith_form form;
+        } symbol;
         struct lith_callable {
             int exact;
             size_t expect;
             lith_value *name;
+            /* a builtin has one of these */
             lith_builtin_function function;
+            lith_builtin_argv_function argv_function;
             lith_env *parent;
+            /* the names of the slots of the frame:
+             * the arguments, then the variables defined in the body */
             lith_value *args, *body;
+            size_t nslots;
+            /* the bytecode of the body, NULL when the body is walked */
+            lith_value *code;
         } *callable;
     } value;
 };
 
 
-#define LITH_IS(p, q) ((p)->type == (q))
-#define LITH_IS_NIL(p) (LITH_IS(p, LITH_TYPE_NIL))
+extern lith_valtype lith_tag_types[LITH_TAG_MASK + 1];
 
-#define LITH_SYM_EQ(S, s) !strcmp((S)->value.symbol, (s))
+#define LITH_TYPE_OF(p) (LITH_TAG(p) ? lith_tag_types[LITH_TAG(p)] : (p)->type)
+#define LITH_IS(p, q) (LITH_TYPE_OF(p) == (q))
+#define LITH_IS_NIL(p) ((p) == LITH_NIL)
 
-#define LITH_CAR(p) ((p)->value.pair.car)
-#define LITH_CDR(p) ((p)->value.pair.cdr)
+#define LITH_SYM_EQ(S, s) !strcmp((S)->value.symbol.name, (s))
+
+#define LITH_CAR(p) (((struct lith_pair *) (LITH_WORD(p) - LITH_TAG_PAIR))->car)
+#define LITH_CDR(p) (((struct lith_pair *) (LITH_WORD(p) - LITH_TAG_PAIR))->cdr)
 #define LITH_CONS lith_make_pair
 
+#define LITH_INTEGER(p) \
+    ((LITH_TAG(p) == LITH_TAG_FIXNUM) ? LITH_FIXNUM_VALUE(p) : (p)->value.integer)
+#define LITH_NUMBER(p) \
+    ((LITH_TAG(p) == LITH_TAG_FLONUM) ? lith_flonum_value(p) : (p)->value.number)
+
+/* the heap is made of pages of equally sized cells,
+ * with one pool of pages for each size class,
+ * separately for values and for raw blocks owned by values,
+ * and one more pool for the pairs */
+#define LITH_NCLASSES 9
+
 #define LITH_IS_CALLABLE(F) \
-    (LITH_IS(F, LITH_TYPE_MACRO) || LITH_IS(F, LITH_TYPE_CLOSURE) || \
-    LITH_IS(F, LITH_TYPE_BUILTIN))
+    ((LITH_TAG(F) == LITH_TAG_HEAP) && (((F)->type == LITH_TYPE_MACRO) \
+    || ((F)->type == LITH_TYPE_CLOSURE) || ((F)->type == LITH_TYPE_BUILTIN)))
 
 struct lith_state {
     enum lith_error error;
@@ -101,17 +216,81 @@ struct lith_state {
         } type;
     } error_state;
     char *types[LITH_NTYPES];
+    lith_value *forms[LITH_NFORMS];
+    /* the symbols with a meaning inside the special forms */
+    lith_value *sym_else, *sym_unquote, *sym_unquote_splicing;
     lith_value *nil;
     lith_value *True, *False;
-    lith_value *symbol_table;
+    /* the builtin called by the pipelines fused by the compiler */
+    lith_value *pipeline;
+    /* the symbols by name, held weakly: unused symbols are collected */
+    struct lith_symbol_table {
+        struct lith_symbol_slot {
+            unsigned long hash;
+            size_t len;
+            lith_value *sym;
+        } *slots;
+        size_t count, cap;
+    } symbols;
+    /* the expansions of the macro calls, by the call:
+     * held while the call is reachable */
+    struct lith_expansion_table {
+        struct lith_expansion {
+            lith_value *form, *macro, *expansion;
+        } *slots;
+        size_t count, cap;
+    } expansions;
+    /* the constants read from the source, by what they are made of:
+     * each is made once and shared, held weakly */
+    struct lith_constant_table {
+        struct lith_constant_slot {
+            unsigned long hash;
+            lith_value *val;
+        } *slots;
+        size_t count, cap;
+    } constants;
     lith_env *global;
+    /* counts the bindings made, the bytecode remembers where it found
+     * the global bindings it uses until another one is made:
+     * not once a frame got a binding which its closure does not name */
+    unsigned long bindings;
+    int frame_extras;
     char *filename;
+    /* closures are compiled to bytecode unless walk is set,
+     * optimized by the compiler when optimize is set,
+     * the bytecode is shown on disasm when it is not NULL */
+    int walk, optimize;
+    FILE *disasm;
+    /* where the outermost evaluation began on the C stack,
+     * the evaluator uses at most cstack_limit bytes of it from there */
+    char *cstack;
+    size_t cstack_limit;
+    struct lith_gc {
+        struct lith_pool {
+            size_t size, npages, nfree;
+            int raw;
+            void *free;
+            struct lith_page *pages;
+        } pools[2][LITH_NCLASSES];
+        struct lith_pool pairs;
+        struct lith_page *free_pages;
+        size_t nfree_pages;
+        void **chunks;
+        size_t nchunks;
+        size_t count, threshold, collections;
+        /* the eval stack: values in use by the evaluator */
+        lith_value **stack;
+        size_t sp, cap;
+        /* values marked but whose children are not yet marked */
+        lith_value **gray;
+        size_t ngray, graycap;
+    } gc;
 };
 
 struct lith_lib_fn {
     char *name;
     size_t expect; int exact;
-    lith_builtin_function fn;
+    lith_builtin_argv_function fn;
 };
 
 extern struct lith_lib_fn lith_builtins[];
@@ -119,8 +298,8 @@ extern struct lith_lib_fn lith_builtins[];
 #define LITH_IS_ERR(L) ((L)->error != LITH_ERR_OK)
 #define LITH_AT_END_NO_ERR(L) (((L)->error == LITH_ERR_EOF) && (L)->error_state.success)
 
-#define LITH_TO_BOOL(B) ((!LITH_IS_NIL(B)) && !(LITH_IS(B, LITH_TYPE_BOOLEAN) && !((B)->value.boolean)))
-#define LITH_IN_BOOL(B) ((B) ? L->True : L->False)
+#define LITH_TO_BOOL(B) (((B) != LITH_NIL) && ((B) != LITH_FALSE))
+#define LITH_IN_BOOL(B) ((B) ? LITH_TRUE : LITH_FALSE)
 
 /* Public functions: the API of this library */
 
@@ -132,14 +311,25 @@ void lith_simple_error(lith_st *, enum lith_error, char *);
 
 lith_value *lith_new_value(lith_st *);
 void lith_print_value(lith_st *, lith_value *, FILE *);
-void lith_free_value(lith_value *);
 lith_value *lith_copy_value(lith_st *, lith_value *);
 
+struct lith_heap_stats {
+    size_t pages, free_pages, cells, free_cells, collections;
+};
+
+/* values not reachable from the global environment
+ * or from the arguments of the running evaluation are collected */
+void lith_collect_garbage(lith_st *);
+void lith_get_heap_stats(lith_st *, struct lith_heap_stats *);
+
 lith_value *lith_make_integer(lith_st *, long);
 lith_value *lith_make_number(lith_st *, double);
+double lith_flonum_value(lith_value *);
 lith_value *lith_make_symbol(lith_st *, char *);
 lith_value *lith_make_string(lith_st *, char *, size_t);
+lith_value *lith_make_vector(lith_st *, size_t, lith_value *);
 lith_value *lith_make_builtin(lith_st *, lith_value *, lith_builtin_function, size_t, int);
+lith_value *lith_make_builtin_argv(lith_st *, lith_value *, lith_builtin_argv_function, size_t, int);
 lith_value *lith_make_closure(lith_st *, lith_env *, lith_value *, lith_value *, lith_value *, size_t, int);
 lith_value *lith_make_pair(lith_st *, lith_value *, lith_value *);
 
@@ -151,8 +341,23 @@ lith_value *lith_eval_expr(lith_st *, lith_env *, lith_value *);
 
 lith_value *lith_apply(lith_st *, lith_value *f, lith_value *args);
 
+/* for the code made by lithc: a call with the arguments on the eval stack,
+ * under its top, room on the eval stack for n more values, whether the
+ * C stack has room for one more call, and where a name is bound */
+lith_value *lith_call(lith_st *, lith_value *f, size_t argc, lith_value **argv);
+int lith_reserve_stack(lith_st *, size_t n);
+int lith_check_depth(lith_st *);
+lith_value **lith_env_find(lith_env *, lith_value *);
+
+void lith_disassemble(lith_st *, lith_value *, FILE *);
+
 lith_env *lith_new_env(lith_st *, lith_env *);
-void lith_free_env(lith_env *);
+
+/* keeps a value from being collected by pushing it at the top of the
+ * eval stack, which is never popped below it: called when nothing is
+ * being evaluated, with the stack empty, the value stays there for as
+ * long as the lith_st is used */
+int lith_push_root(lith_st *, lith_value *);
 
 lith_value *lith_env_get(lith_st *, lith_env *, lith_value *);
 void lith_env_set(lith_st *, lith_env *, lith_value *, lith_value *);
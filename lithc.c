@@ -0,0 +1,1186 @@
+/* lithc: translates a lith program to C
+ *
+ * the functions defined at the top of the program, by def or by func,
+ * become C functions when their bodies need nothing but their arguments,
+ * their variables, the globals and calls: the variables are kept on the
+ * eval stack, the calls of the functions made so and of the builtins are
+ * made directly while their names are bound to them, the builtins found
+ * by their names when the program starts, and a function calling itself
+ * in tail position jumps back to its start.
+ * the rest of the program is kept as source, and run in order with the
+ * definitions of the functions by the evaluator of lith.c, which the
+ * translated program is linked with, with the library embedded in it
+ */
+
+#include "lith.h"
+
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define LITHC_MAX_NAMES 64
+
+/* the variables of a function, of a let or of a begin, by their slots:
+ * those defined by def are NULL until they are defined,
+ * the variables outside are used until then */
+struct scope {
+    struct scope *up;
+    size_t n;
+    lith_value *names[LITHC_MAX_NAMES];
+    size_t slots[LITHC_MAX_NAMES];
+    int defs[LITHC_MAX_NAMES];
+};
+
+struct lithc {
+    lith_st *L;
+    lith_env *V;
+    /* the functions made, the sources kept and the steps of the program,
+     * the body of the function being made */
+    FILE *out, *sources, *steps, *code;
+    size_t nsources;
+    lith_value **consts, **globals;
+    size_t nconsts, nglobals, cconsts, cglobals;
+    /* the names of the macros defined at the top of the program */
+    lith_value *macros;
+    struct function {
+        lith_value *name;
+        size_t nargs;
+    } *fns;
+    size_t nfns, cfns;
+    /* the builtins the code made calls without looking them up, by their
+     * index in lith_builtins here and how many arguments they are given */
+    struct called {
+        long b;
+        size_t nargs;
+    } *builtins;
+    size_t nbuiltins, cbuiltins;
+    /* the function being made: its index, the slots in use and
+     * the most used, whether it jumps to its start, may fail, uses the
+     * bindings of globals, fixnum arithmetic, names values or calls */
+    size_t fn, top, max;
+    int indent, again, fails, cells, longs, names, calls;
+    /* the helpers used by the functions made */
+    int uses_cells, uses_names, uses_calls;
+};
+
+/* the numeric builtins run without calling them on two fixnums */
+static struct numop {
+    char *name, *op;
+} numops[] = {
+    {"+", "+"}, {":+", "+"}, {"-", "-"}, {":-", "-"}, {"*", "*"}, {":*", "*"},
+    {"<", "<"}, {":<", "<"}, {">", ">"}, {":>", ">"},
+    {"=", "=="}, {":==", "=="}, {"<=", "<="}, {">=", ">="},
+    {NULL, NULL}
+};
+
+static void fatal(char *msg)
+{
+    fprintf(stderr, "lithc: %s\n", msg);
+    exit(1);
+}
+
+static void *grow(void *p, size_t *cap, size_t size)
+{
+    *cap = *cap ? 2 * *cap : 16;
+    p = realloc(p, *cap * size);
+    if (!p) fatal("out of memory");
+    return p;
+}
+
+static FILE *temporary(void)
+{
+    FILE *f;
+    if (!(f = tmpfile())) fatal("can not make a temporary file");
+    return f;
+}
+
+static char *slurp(FILE *f)
+{
+    char *buf;
+    size_t len, cap;
+    cap = BUFSIZ;
+    len = 0;
+    if (!(buf = malloc(cap))) fatal("out of memory");
+    while ((len += fread(buf + len, 1, cap - len - 1, f)) == cap - 1) {
+        cap *= 2;
+        if (!(buf = realloc(buf, cap))) fatal("out of memory");
+    }
+    buf[len] = 0;
+    return buf;
+}
+
+static char *slurp_file(char *filename)
+{
+    FILE *f;
+    char *buf;
+    if (!(f = fopen(filename, "rb"))) {
+        fprintf(stderr, "lithc: can not open '%s'\n", filename);
+        exit(1);
+    }
+    buf = slurp(f);
+    fclose(f);
+    return buf;
+}
+
+/* the length of a proper list, -1 for anything else */
+static long length(lith_value *x)
+{
+    long n;
+    for (n = 0; LITH_IS(x, LITH_TYPE_PAIR); n++)
+        x = LITH_CDR(x);
+    return LITH_IS_NIL(x) ? n : -1;
+}
+
+#define CADR(x) LITH_CAR(LITH_CDR(x))
+#define CDDR(x) LITH_CDR(LITH_CDR(x))
+#define CADDR(x) LITH_CAR(CDDR(x))
+
+/* the source as a C string literal, split after the newlines */
+static void put_string(FILE *f, char *s, size_t len)
+{
+    size_t i;
+    unsigned char c;
+    fputc('"', f);
+    for (i = 0; i < len; i++) {
+        c = s[i];
+        if (c == '\n') {
+            fputs((i + 1 < len) ? "\\n\"\n    \"" : "\\n", f);
+        } else if ((c == '"') || (c == '\\') || (c == '?')) {
+            fprintf(f, "\\%c", c);
+        } else if ((c < ' ') || (c > '~')) {
+            fprintf(f, "\\%03o", c);
+        } else {
+            fputc(c, f);
+        }
+    }
+    fputc('"', f);
+}
+
+/* the index of the constant, -1 when it can not be made in C */
+static long constant(struct lithc *T, lith_value *x)
+{
+    size_t i;
+    double d;
+    for (i = 0; i < T->nconsts; i++)
+        if (T->consts[i] == x) return i;
+    switch (LITH_TYPE_OF(x)) {
+    case LITH_TYPE_NUMBER:
+        d = LITH_NUMBER(x);
+        /* not a NaN or an infinity */
+        if ((d != d) || (d - d != 0)) return -1;
+        break;
+    case LITH_TYPE_PAIR:
+        if ((constant(T, LITH_CAR(x)) < 0) || (constant(T, LITH_CDR(x)) < 0))
+            return -1;
+        break;
+    case LITH_TYPE_VECTOR:
+        for (i = 0; i < x->value.vector.len; i++)
+            if (constant(T, x->value.vector.items[i]) < 0) return -1;
+        break;
+    case LITH_TYPE_NIL:
+    case LITH_TYPE_BOOLEAN:
+    case LITH_TYPE_INTEGER:
+    case LITH_TYPE_STRING:
+    case LITH_TYPE_SYMBOL:
+        break;
+    default:
+        return -1;
+    }
+    if (T->nconsts == T->cconsts)
+        T->consts = grow(T->consts, &T->cconsts, sizeof(*T->consts));
+    T->consts[T->nconsts] = x;
+    return T->nconsts++;
+}
+
+static void make_constant(struct lithc *T, FILE *f, size_t i)
+{
+    lith_value *x;
+    char buf[64];
+    long n;
+    x = T->consts[i];
+    if (LITH_IS(x, LITH_TYPE_VECTOR)) {
+        fprintf(f, "    K[%lu] = lith_make_vector(L, %lu, LITH_NIL);\n",
+            (unsigned long) i, (unsigned long) x->value.vector.len);
+        for (n = 0; n < (long) x->value.vector.len; n++)
+            fprintf(f, "    K[%lu]->value.vector.items[%ld] = K[%ld];\n", (unsigned long) i,
+                n, constant(T, x->value.vector.items[n]));
+        return;
+    }
+    fprintf(f, "    K[%lu] = ", (unsigned long) i);
+    switch (LITH_TYPE_OF(x)) {
+    case LITH_TYPE_NIL:
+        fputs("LITH_NIL", f);
+        break;
+    case LITH_TYPE_BOOLEAN:
+        fputs((x == LITH_TRUE) ? "LITH_TRUE" : "LITH_FALSE", f);
+        break;
+    case LITH_TYPE_INTEGER:
+        n = LITH_INTEGER(x);
+        if (n == -LONG_MAX - 1)
+            fprintf(f, "lith_make_integer(L, -%ldL - 1)", LONG_MAX);
+        else
+            fprintf(f, "lith_make_integer(L, %ldL)", n);
+        break;
+    case LITH_TYPE_NUMBER:
+        sprintf(buf, "%.17g", LITH_NUMBER(x));
+        if (!strpbrk(buf, ".e")) strcat(buf, ".0");
+        fprintf(f, "lith_make_number(L, %s)", buf);
+        break;
+    case LITH_TYPE_STRING:
+        fputs("lith_make_string(L, ", f);
+        put_string(f, x->value.string.buf, x->value.string.len);
+        fprintf(f, ", %lu)", (unsigned long) x->value.string.len);
+        break;
+    case LITH_TYPE_SYMBOL:
+        fputs("lith_get_symbol(L, ", f);
+        put_string(f, x->value.symbol.name, strlen(x->value.symbol.name));
+        fputc(')', f);
+        break;
+    default:
+        fprintf(f, "lith_make_pair(L, K[%ld], K[%ld])",
+            constant(T, LITH_CAR(x)), constant(T, LITH_CDR(x)));
+        break;
+    }
+    fputs(";\n", f);
+}
+
+static size_t global(struct lithc *T, lith_value *name)
+{
+    size_t i;
+    for (i = 0; i < T->nglobals; i++)
+        if (T->globals[i] == name) return i;
+    constant(T, name);
+    if (T->nglobals == T->cglobals)
+        T->globals = grow(T->globals, &T->cglobals, sizeof(*T->globals));
+    T->globals[T->nglobals] = name;
+    return T->nglobals++;
+}
+
+/* the function made last with the name, if it takes n arguments */
+static long function(struct lithc *T, lith_value *name, size_t n)
+{
+    size_t j;
+    for (j = T->nfns; j-- > 0; )
+        if (T->fns[j].name == name)
+            return (T->fns[j].nargs == n) ? (long) j : -1;
+    return -1;
+}
+
+/* the builtin bound to the name now, if it takes n arguments */
+static long builtin(struct lithc *T, lith_value *name, size_t n)
+{
+    lith_value **p;
+    struct lith_lib_fn *b;
+    if (!(p = lith_env_find(T->V, name)) || !LITH_IS(*p, LITH_TYPE_BUILTIN))
+        return -1;
+    for (b = lith_builtins; b->name; b++) {
+        if (b->fn == (*p)->value.callable->argv_function)
+            return (b->exact ? (n == b->expect) : (n >= b->expect))
+                ? (long) (b - lith_builtins) : -1;
+    }
+    return -1;
+}
+
+/* the index in B of the builtin called with n arguments: the program
+ * made finds it by its name when it starts */
+static long called(struct lithc *T, long b, size_t n)
+{
+    size_t k;
+    for (k = 0; k < T->nbuiltins; k++)
+        if ((T->builtins[k].b == b) && (T->builtins[k].nargs == n))
+            return (long) k;
+    if (T->nbuiltins == T->cbuiltins)
+        T->builtins = grow(T->builtins, &T->cbuiltins, sizeof(*T->builtins));
+    T->builtins[k].b = b;
+    T->builtins[k].nargs = n;
+    T->nbuiltins++;
+    return (long) k;
+}
+
+static int find(struct scope *S, lith_value *name, struct scope **in, size_t *at)
+{
+    size_t i;
+    for (; S; S = S->up) {
+        for (i = 0; i < S->n; i++) {
+            if (S->names[i] == name) {
+                *in = S;
+                *at = i;
+                return 1;
+            }
+        }
+    }
+    return 0;
+}
+
+static int has_name(struct scope *S, lith_value *name)
+{
+    size_t i;
+    for (i = 0; i < S->n; i++)
+        if (S->names[i] == name) return 1;
+    return 0;
+}
+
+/* the macro calls are expanded, but for those of the names
+ * which are variables there */
+
+static lith_value *expand(struct lithc *, struct scope *, lith_value *);
+
+static lith_value *expand_list(struct lithc *T, struct scope *S, lith_value *x)
+{
+    lith_value *a, *d;
+    if (!LITH_IS(x, LITH_TYPE_PAIR)) return x;
+    if (!(a = expand(T, S, LITH_CAR(x)))
+    || !(d = expand_list(T, S, LITH_CDR(x)))) return NULL;
+    if ((a == LITH_CAR(x)) && (d == LITH_CDR(x))) return x;
+    return LITH_CONS(T->L, a, d);
+}
+
+static lith_value *expand(struct lithc *T, struct scope *S, lith_value *x)
+{
+    struct scope B, *in;
+    lith_value *f, *y, *b, *bs, **p, **tail;
+    size_t i;
+    if (!LITH_IS(x, LITH_TYPE_PAIR) || (length(x) < 0)) return x;
+    f = LITH_CAR(x);
+    if (!LITH_IS(f, LITH_TYPE_SYMBOL)) return expand_list(T, S, x);
+    switch (f->value.symbol.form) {
+    case LITH_FORM_NONE:
+        if (find(S, f, &in, &i)) break;
+        if (!(p = lith_env_find(T->V, f)) || !LITH_IS(*p, LITH_TYPE_MACRO)) {
+            /* one defined later is expanded by the evaluator */
+            for (y = T->macros; !LITH_IS_NIL(y); y = LITH_CDR(y))
+                if (LITH_CAR(y) == f) return NULL;
+            break;
+        }
+        if (!(y = lith_apply(T->L, *p, LITH_CDR(x)))) {
+            lith_clear_error_state(T->L);
+            return NULL;
+        }
+        return expand(T, S, y);
+    case LITH_FORM_IF:
+    case LITH_FORM_BEGIN:
+    case LITH_FORM_AND:
+    case LITH_FORM_OR:
+        break;
+    case LITH_FORM_DEF:
+    case LITH_FORM_SET:
+        if (length(x) != 3) return x;
+        if (!(y = expand(T, S, CADDR(x)))) return NULL;
+        return LITH_CONS(T->L, f, LITH_CONS(T->L, CADR(x),
+            LITH_CONS(T->L, y, LITH_NIL)));
+    case LITH_FORM_COND:
+        bs = LITH_NIL;
+        tail = &bs;
+        for (y = LITH_CDR(x); LITH_IS(y, LITH_TYPE_PAIR); y = LITH_CDR(y)) {
+            b = LITH_CAR(y);
+            if ((length(b) > 0) && !(b = expand_list(T, S, b))) return NULL;
+            if (!(*tail = LITH_CONS(T->L, b, LITH_NIL))) return NULL;
+            tail = &LITH_CDR(*tail);
+        }
+        return LITH_CONS(T->L, f, bs);
+    case LITH_FORM_LET:
+        if ((length(x) < 3) || (length(CADR(x)) < 0)) return x;
+        B.up = S;
+        B.n = 0;
+        bs = LITH_NIL;
+        tail = &bs;
+        for (y = CADR(x); !LITH_IS_NIL(y); y = LITH_CDR(y)) {
+            b = LITH_CAR(y);
+            if ((length(b) == 2) && LITH_IS(LITH_CAR(b), LITH_TYPE_SYMBOL)) {
+                if (B.n == LITHC_MAX_NAMES) return NULL;
+                B.names[B.n++] = LITH_CAR(b);
+                if (!(b = expand_list(T, S, LITH_CDR(b)))
+                || !(b = LITH_CONS(T->L, LITH_CAR(LITH_CAR(y)), b))) return NULL;
+            }
+            if (!(*tail = LITH_CONS(T->L, b, LITH_NIL))) return NULL;
+            tail = &LITH_CDR(*tail);
+        }
+        if (!(y = expand_list(T, &B, CDDR(x)))) return NULL;
+        return LITH_CONS(T->L, f, LITH_CONS(T->L, bs, y));
+    default:
+        return x;
+    }
+    return expand_list(T, S, x);
+}
+
+/* the code of the function being made: the lines ending with an opening
+ * brace indent those after them, those beginning with a closing one
+ * are indented less
+ */
+static void line(struct lithc *T, char *fmt, ...)
+{
+    va_list ap;
+    int i;
+    if (*fmt == '}') T->indent--;
+    for (i = 0; i < T->indent; i++)
+        fputs("    ", T->code);
+    va_start(ap, fmt);
+    vfprintf(T->code, fmt, ap);
+    va_end(ap);
+    fputc('\n', T->code);
+    if (fmt[strlen(fmt) - 1] == '{') T->indent++;
+}
+
+static unsigned long slot(struct lithc *T)
+{
+    if (++T->top > T->max) T->max = T->top;
+    return T->top - 1;
+}
+
+static int add_name(struct lithc *T, struct scope *S, lith_value *name, int def)
+{
+    if (S->n == LITHC_MAX_NAMES) return 0;
+    S->names[S->n] = name;
+    S->slots[S->n] = slot(T);
+    S->defs[S->n++] = def;
+    return 1;
+}
+
+/* the variables defined by def in the frame, the expression evaluated in */
+static int prescan(struct lithc *T, struct scope *S, lith_value *x)
+{
+    lith_value *f, *p;
+    if (!LITH_IS(x, LITH_TYPE_PAIR) || (length(x) < 0)) return 1;
+    f = LITH_CAR(x);
+    if (LITH_IS(f, LITH_TYPE_SYMBOL)) {
+        switch (f->value.symbol.form) {
+        case LITH_FORM_NONE:
+        case LITH_FORM_IF:
+        case LITH_FORM_SET:
+        case LITH_FORM_AND:
+        case LITH_FORM_OR:
+            break;
+        case LITH_FORM_DEF:
+            if ((length(x) != 3) || !LITH_IS(CADR(x), LITH_TYPE_SYMBOL))
+                return 1;
+            if (!has_name(S, CADR(x)) && !add_name(T, S, CADR(x), 1))
+                return 0;
+            return prescan(T, S, CADDR(x));
+        case LITH_FORM_LET:
+            /* the values, the body is in a frame of its own */
+            if ((length(x) < 2) || (length(CADR(x)) < 0)) return 1;
+            for (p = CADR(x); !LITH_IS_NIL(p); p = LITH_CDR(p))
+                if ((length(LITH_CAR(p)) == 2) && !prescan(T, S, CADR(LITH_CAR(p))))
+                    return 0;
+            return 1;
+        case LITH_FORM_COND:
+            /* the tests, the bodies are in frames of their own */
+            for (p = LITH_CDR(x); LITH_IS(p, LITH_TYPE_PAIR); p = LITH_CDR(p)) {
+                if ((length(LITH_CAR(p)) > 0) && !prescan(T, S, LITH_CAR(LITH_CAR(p))))
+                    return 0;
+            }
+            return 1;
+        default:
+            return 1;
+        }
+    }
+    for (; !LITH_IS_NIL(x); x = LITH_CDR(x))
+        if (!prescan(T, S, LITH_CAR(x))) return 0;
+    return 1;
+}
+
+static void ref(struct lithc *T, struct scope *S, lith_value *name, unsigned long d)
+{
+    struct scope *in;
+    size_t i;
+    if (!find(S, name, &in, &i)) {
+        T->cells = T->fails = 1;
+        line(T, "if (!(p = CELL(%lu))) goto fail;", (unsigned long) global(T, name));
+        line(T, "R(%lu) = *p;", d);
+    } else if (!in->defs[i]) {
+        if (in->slots[i] != d)
+            line(T, "R(%lu) = R(%lu);", d, (unsigned long) in->slots[i]);
+    } else {
+        line(T, "if (!(R(%lu) = R(%lu))) {", d, (unsigned long) in->slots[i]);
+        ref(T, in->up, name, d);
+        line(T, "}");
+    }
+}
+
+static void assign(struct lithc *T, struct scope *S, lith_value *name, unsigned long d)
+{
+    struct scope *in;
+    size_t i;
+    if (!find(S, name, &in, &i)) {
+        T->cells = T->fails = 1;
+        line(T, "if (!(p = CELL(%lu))) goto fail;", (unsigned long) global(T, name));
+        line(T, "*p = R(%lu);", d);
+    } else if (!in->defs[i]) {
+        line(T, "R(%lu) = R(%lu);", (unsigned long) in->slots[i], d);
+    } else {
+        line(T, "if (R(%lu)) {", (unsigned long) in->slots[i]);
+        line(T, "R(%lu) = R(%lu);", (unsigned long) in->slots[i], d);
+        line(T, "} else {");
+        assign(T, in->up, name, d);
+        line(T, "}");
+    }
+}
+
+static int gen(struct lithc *, struct scope *, lith_value *, unsigned long, int);
+
+static int quoted(struct lithc *T, lith_value *x, unsigned long d)
+{
+    long k;
+    if (LITH_IS_NIL(x))
+        line(T, "R(%lu) = LITH_NIL;", d);
+    else if (LITH_IS(x, LITH_TYPE_BOOLEAN))
+        line(T, "R(%lu) = %s;", d, (x == LITH_TRUE) ? "LITH_TRUE" : "LITH_FALSE");
+    else if ((k = constant(T, x)) >= 0)
+        line(T, "R(%lu) = K[%ld];", d, k);
+    return LITH_IS_NIL(x) || LITH_IS(x, LITH_TYPE_BOOLEAN) || (k >= 0);
+}
+
+/* a body evaluated in a frame of its own, with the variables in S */
+static int block(struct lithc *T, struct scope *S, lith_value *body,
+                 unsigned long d, int tail)
+{
+    lith_value *p;
+    size_t i;
+    for (p = body; !LITH_IS_NIL(p); p = LITH_CDR(p))
+        if (!prescan(T, S, LITH_CAR(p))) return 0;
+    for (i = 0; i < S->n; i++)
+        if (S->defs[i]) line(T, "R(%lu) = NULL;", (unsigned long) S->slots[i]);
+    for (; !LITH_IS_NIL(LITH_CDR(body)); body = LITH_CDR(body))
+        if (!gen(T, S, LITH_CAR(body), d, 0)) return 0;
+    return gen(T, S, LITH_CAR(body), d, tail);
+}
+
+static int gen_let(struct lithc *T, struct scope *S, lith_value *rest,
+                   unsigned long d, int tail)
+{
+    struct scope B;
+    lith_value *p, *b;
+    size_t top, i;
+    int ok;
+    top = T->top;
+    B.up = S;
+    B.n = 0;
+    if (length(LITH_CAR(rest)) < 0) return 0;
+    for (p = LITH_CAR(rest); !LITH_IS_NIL(p); p = LITH_CDR(p)) {
+        b = LITH_CAR(p);
+        if ((length(b) != 2) || !LITH_IS(LITH_CAR(b), LITH_TYPE_SYMBOL)
+        || has_name(&B, LITH_CAR(b)) || !add_name(T, &B, LITH_CAR(b), 0))
+            return 0;
+    }
+    for (i = 0, p = LITH_CAR(rest); i < B.n; i++, p = LITH_CDR(p))
+        if (!gen(T, S, CADR(LITH_CAR(p)), B.slots[i], 0)) return 0;
+    ok = block(T, &B, LITH_CDR(rest), d, tail);
+    T->top = top;
+    return ok;
+}
+
+static int gen_cond(struct lithc *T, struct scope *S, lith_value *rest,
+                    unsigned long d, int tail)
+{
+    struct scope B;
+    lith_value *c;
+    size_t top, open;
+    int last;
+    for (open = 0, last = 0; !last && !LITH_IS_NIL(rest); rest = LITH_CDR(rest)) {
+        c = LITH_CAR(rest);
+        if (length(c) < 2) return 0;
+        last = LITH_CAR(c) == T->L->sym_else;
+        if (!last) {
+            if (!gen(T, S, LITH_CAR(c), d, 0)) return 0;
+            line(T, "if (LITH_TO_BOOL(R(%lu))) {", d);
+        }
+        top = T->top;
+        B.up = S;
+        B.n = 0;
+        if (!block(T, &B, LITH_CDR(c), d, tail)) return 0;
+        T->top = top;
+        if (!last) {
+            line(T, "} else {");
+            open++;
+        }
+    }
+    if (!last) {
+        T->fails = 1;
+        line(T, "lith_simple_error(L, LITH_ERR_CUSTOM, \"cond: no else clause\");");
+        line(T, "goto fail;");
+    }
+    while (open--)
+        line(T, "}");
+    return 1;
+}
+
+static int gen_test(struct lithc *T, struct scope *S, lith_value *rest,
+                    unsigned long d, int and)
+{
+    size_t open;
+    for (open = 0; !LITH_IS_NIL(rest); rest = LITH_CDR(rest), open++) {
+        if (!gen(T, S, LITH_CAR(rest), d, 0)) return 0;
+        line(T, "if (%sLITH_TO_BOOL(R(%lu))) {", and ? "" : "!", d);
+    }
+    line(T, "R(%lu) = %s;", d, and ? "LITH_TRUE" : "LITH_FALSE");
+    while (open--) {
+        line(T, "} else {");
+        line(T, "R(%lu) = %s;", d, and ? "LITH_FALSE" : "LITH_TRUE");
+        line(T, "}");
+    }
+    return 1;
+}
+
+static int gen_def(struct lithc *T, struct scope *S, lith_value *name,
+                   lith_value *x, unsigned long d, int def)
+{
+    long k;
+    size_t i;
+    if (def) {
+        for (i = 0; (i < S->n) && (S->names[i] != name); i++)
+            ;
+        if ((i == S->n) || !S->defs[i]) return 0;
+    }
+    k = constant(T, name);
+    if (!gen(T, S, x, d, 0)) return 0;
+    T->names = 1;
+    line(T, "name(R(%lu), K[%ld]);", d, k);
+    if (def) {
+        T->fails = 1;
+        line(T, "if (R(%lu)) {", (unsigned long) S->slots[i]);
+        line(T, "L->error = LITH_ERR_REDEFINE;");
+        line(T, "L->error_state.sym = K[%ld]->value.symbol.name;", k);
+        line(T, "goto fail;");
+        line(T, "}");
+        line(T, "R(%lu) = R(%lu);", (unsigned long) S->slots[i], d);
+    } else {
+        assign(T, S, name, d);
+    }
+    line(T, "R(%lu) = LITH_NIL;", d);
+    return 1;
+}
+
+static void gen_numop(struct lithc *T, char *op, long k, unsigned long t)
+{
+    unsigned long x, y;
+    x = t + 1;
+    y = t + 2;
+    if ((op[0] == '+') || (op[0] == '-')) {
+        T->longs = 1;
+        line(T, "if (IS_FN(R(%lu), B[%ld].fn) && FIX2(R(%lu), R(%lu))", t, k, x, y);
+        line(T, "&& LITH_FITS_FIXNUM(w = LITH_FIXNUM_VALUE(R(%lu)) %s LITH_FIXNUM_VALUE(R(%lu)))) {", x, op, y);
+        line(T, "val = LITH_FIXNUM(w);");
+    } else if (op[0] == '*') {
+        line(T, "if (IS_FN(R(%lu), B[%ld].fn) && FIX2(R(%lu), R(%lu))", t, k, x, y);
+        line(T, "&& SMALL(R(%lu)) && SMALL(R(%lu))) {", x, y);
+        line(T, "val = LITH_FIXNUM(LITH_FIXNUM_VALUE(R(%lu)) * LITH_FIXNUM_VALUE(R(%lu)));", x, y);
+    } else {
+        line(T, "if (IS_FN(R(%lu), B[%ld].fn) && FIX2(R(%lu), R(%lu))) {", t, k, x, y);
+        line(T, "val = LITH_IN_BOOL(LITH_FIXNUM_VALUE(R(%lu)) %s LITH_FIXNUM_VALUE(R(%lu)));", x, op, y);
+    }
+    line(T, "} else {");
+}
+
+static int gen_call(struct lithc *T, struct scope *S, lith_value *f,
+                    lith_value *args, unsigned long d, int tail)
+{
+    struct scope *in;
+    struct numop *num;
+    lith_value *p;
+    unsigned long t, i, n;
+    size_t at;
+    long j, b, k;
+    t = T->top;
+    n = length(args);
+    T->top += n + 1;
+    if (T->top > T->max) T->max = T->top;
+    if (!gen(T, S, f, t, 0)) return 0;
+    for (i = 1, p = args; !LITH_IS_NIL(p); p = LITH_CDR(p), i++)
+        if (!gen(T, S, LITH_CAR(p), t + i, 0)) return 0;
+    T->top = t;
+    T->fails = T->calls = 1;
+    j = b = -1;
+    if (LITH_IS(f, LITH_TYPE_SYMBOL) && !find(S, f, &in, &at)
+    && ((j = function(T, f, n)) < 0))
+        b = builtin(T, f, n);
+    k = (b >= 0) ? called(T, b, n) : -1;
+    num = NULL;
+    if ((b >= 0) && (n == 2))
+        for (num = numops; num->name && strcmp(num->name, lith_builtins[b].name); num++)
+            ;
+    if (num && num->name) {
+        gen_numop(T, num->op, k, t);
+    } else if ((j >= 0) && (j == (long) T->fn) && tail) {
+        T->again = 1;
+        line(T, "if (R(%lu) == F[%ld]) {", t, j);
+        for (i = 0; i < n; i++)
+            line(T, "R(%lu) = R(%lu);", i, t + 1 + i);
+        line(T, "goto top;");
+        line(T, "}");
+    }
+    if (tail && (b < 0)) {
+        /* left for the entry of the function to make, in the slots
+         * from the first on, as the slots are given back */
+        line(T, "for (i = 0; i <= %lu; i++)", n);
+        T->indent++;
+        line(T, "R(i) = R(%lu + i);", t);
+        T->indent--;
+        line(T, "L->gc.sp = sp + %lu;", n + 1);
+        line(T, "tail_argc = %lu;", n);
+        if (j >= 0)
+            line(T, "tail_body = (R(0) == F[%ld]) ? body_%ld : NULL;", j, j);
+        else
+            line(T, "tail_body = NULL;");
+        line(T, "return TAIL;");
+        return 1;
+    }
+    if (j >= 0) {
+        line(T, "val = (R(%lu) == F[%ld]) ? fn_%ld(L, %lu, &R(%lu))", t, j, j, n, t + 1);
+        line(T, "    : call(L, R(%lu), %lu, &R(%lu));", t, n, t + 1);
+    } else if (b >= 0) {
+        line(T, "val = IS_FN(R(%lu), B[%ld].fn) ? (*B[%ld].fn)(L, %lu, &R(%lu))",
+            t, k, k, n, t + 1);
+        line(T, "    : call(L, R(%lu), %lu, &R(%lu));", t, n, t + 1);
+    } else {
+        line(T, "val = call(L, R(%lu), %lu, &R(%lu));", t, n, t + 1);
+    }
+    if (num && num->name)
+        line(T, "}");
+    line(T, "if (!val) goto fail;");
+    line(T, "R(%lu) = val;", d);
+    return 1;
+}
+
+/* the value of the expression in the slot d, 0 when it can not be made */
+static int gen(struct lithc *T, struct scope *S, lith_value *x, unsigned long d, int tail)
+{
+    lith_value *f, *rest;
+    long n;
+    if (LITH_IS(x, LITH_TYPE_SYMBOL)) {
+        ref(T, S, x, d);
+        return 1;
+    }
+    if (!LITH_IS(x, LITH_TYPE_PAIR)) return quoted(T, x, d);
+    if ((n = length(x) - 1) < 0) return 0;
+    f = LITH_CAR(x);
+    rest = LITH_CDR(x);
+    if (LITH_IS(f, LITH_TYPE_SYMBOL)) {
+        switch (f->value.symbol.form) {
+        case LITH_FORM_NONE:
+            break;
+        case LITH_FORM_QUOTE:
+            return (n == 1) && quoted(T, LITH_CAR(rest), d);
+        case LITH_FORM_IF:
+            if ((n != 3) || !gen(T, S, LITH_CAR(rest), d, 0)) return 0;
+            line(T, "if (LITH_TO_BOOL(R(%lu))) {", d);
+            if (!gen(T, S, CADR(rest), d, tail)) return 0;
+            line(T, "} else {");
+            if (!gen(T, S, CADDR(rest), d, tail)) return 0;
+            line(T, "}");
+            return 1;
+        case LITH_FORM_DEF:
+        case LITH_FORM_SET:
+            return (n == 2) && LITH_IS(LITH_CAR(rest), LITH_TYPE_SYMBOL)
+                && gen_def(T, S, LITH_CAR(rest), CADR(rest), d,
+                    f->value.symbol.form == LITH_FORM_DEF);
+        case LITH_FORM_LET:
+            return (n >= 2) && gen_let(T, S, rest, d, tail);
+        case LITH_FORM_BEGIN:
+            if (n >= 1) {
+                struct scope B;
+                size_t top;
+                top = T->top;
+                B.up = S;
+                B.n = 0;
+                if (!block(T, &B, rest, d, tail)) return 0;
+                T->top = top;
+                return 1;
+            }
+            return 0;
+        case LITH_FORM_COND:
+            return gen_cond(T, S, rest, d, tail);
+        case LITH_FORM_AND:
+        case LITH_FORM_OR:
+            return gen_test(T, S, rest, d, f->value.symbol.form == LITH_FORM_AND);
+        default:
+            return 0;
+        }
+    }
+    return gen_call(T, S, f, rest, d, tail);
+}
+
+/* (def NAME (lambda PARAMS BODY ...)) with the exact parameters */
+static int is_function(struct lithc *T, lith_value *x)
+{
+    lith_value *p, *q;
+    if ((length(x) != 3) || (LITH_CAR(x) != T->L->forms[LITH_FORM_DEF])
+    || !LITH_IS(CADR(x), LITH_TYPE_SYMBOL)) return 0;
+    x = CADDR(x);
+    if ((length(x) < 3) || (LITH_CAR(x) != T->L->forms[LITH_FORM_LAMBDA])
+    || (length(CADR(x)) < 0) || (length(CADR(x)) > LITHC_MAX_NAMES)) return 0;
+    for (p = CADR(x); !LITH_IS_NIL(p); p = LITH_CDR(p)) {
+        if (!LITH_IS(LITH_CAR(p), LITH_TYPE_SYMBOL)) return 0;
+        for (q = LITH_CDR(p); !LITH_IS_NIL(q); q = LITH_CDR(q))
+            if (LITH_CAR(q) == LITH_CAR(p)) return 0;
+    }
+    return 1;
+}
+
+static int compile(struct lithc *T, lith_value *name, lith_value *params,
+                   lith_value *body)
+{
+    struct scope B;
+    lith_value *p;
+    unsigned long d, n;
+    char *code;
+    int ok;
+    T->top = T->max = 0;
+    T->indent = 1;
+    T->again = T->fails = T->cells = T->longs = T->names = T->calls = 0;
+    B.up = NULL;
+    B.n = 0;
+    for (p = params; !LITH_IS_NIL(p); p = LITH_CDR(p))
+        add_name(T, &B, LITH_CAR(p), 0);
+    n = B.n;
+    if (!(body = expand_list(T, &B, body))) return 0;
+    if (T->nfns == T->cfns)
+        T->fns = grow(T->fns, &T->cfns, sizeof(*T->fns));
+    T->fn = T->nfns++;
+    T->fns[T->fn].name = name;
+    T->fns[T->fn].nargs = n;
+    T->code = temporary();
+    d = slot(T);
+    ok = block(T, &B, body, d, 1);
+    if (!ok) {
+        T->nfns--;
+    } else {
+        rewind(T->code);
+        code = slurp(T->code);
+        fprintf(T->out, "/* %s */\n", name->value.symbol.name);
+        fprintf(T->out, "static lith_value *fn_%lu(lith_st *, size_t, lith_value **);\n\n",
+            (unsigned long) T->fn);
+        fprintf(T->out, "static lith_value *body_%lu(lith_st *L, size_t argc, lith_value **argv)\n{\n",
+            (unsigned long) T->fn);
+        if (n) fprintf(T->out, "    lith_value *args[%lu];\n", n);
+        fprintf(T->out, "    lith_value *val%s;\n", T->cells ? ", **p" : "");
+        fprintf(T->out, "    size_t sp, i;\n%s", T->longs ? "    long w;\n" : "");
+        fputs("    sp = L->gc.sp;\n", T->out);
+        if (n) fprintf(T->out, "    for (i = 0; i < %lu; i++)\n        args[i] = argv[i];\n", n);
+        fprintf(T->out, "    if (!lith_check_depth(L) || !lith_reserve_stack(L, %lu))\n"
+            "        return NULL;\n", (unsigned long) T->max);
+        fprintf(T->out, "    L->gc.sp = sp + %lu;\n", (unsigned long) T->max);
+        if (n) fprintf(T->out, "    for (i = 0; i < %lu; i++)\n        R(i) = args[i];\n", n);
+        fprintf(T->out, "    for (i = %lu; i < %lu; i++)\n        R(i) = NULL;\n",
+            n, (unsigned long) T->max);
+        if (T->again) fputs("top:\n", T->out);
+        fputs(code, T->out);
+        fprintf(T->out, "    val = R(%lu);\n    L->gc.sp = sp;\n    return val;\n", d);
+        if (T->fails) fputs("fail:\n    L->gc.sp = sp;\n    return NULL;\n", T->out);
+        fputs("}\n\n", T->out);
+        fprintf(T->out, "static lith_value *fn_%lu(lith_st *L, size_t argc, lith_value **argv)\n{\n"
+            "    size_t base;\n    base = L->gc.sp;\n"
+            "    return tail(L, base, body_%lu(L, argc, argv));\n}\n\n",
+            (unsigned long) T->fn, (unsigned long) T->fn);
+        free(code);
+        T->uses_cells |= T->cells;
+        T->uses_names |= T->names;
+        T->uses_calls |= T->calls;
+    }
+    fclose(T->code);
+    return ok;
+}
+
+/* the text of the value, as lith_print_value shows it */
+static char *printed(struct lithc *T, lith_value *x)
+{
+    FILE *f;
+    char *s;
+    f = temporary();
+    lith_print_value(T->L, x, f);
+    rewind(f);
+    s = slurp(f);
+    fclose(f);
+    return s;
+}
+
+static void keep_source(struct lithc *T, char *start, char *end)
+{
+    char *s;
+    for (s = start; (s < end) && strchr(" \t\r\n", *s); s++)
+        ;
+    if (s == end) return;
+    fprintf(T->sources, "static char source_%lu[] = ", (unsigned long) T->nsources);
+    put_string(T->sources, start, end - start);
+    fputs(";\n\n", T->sources);
+    fprintf(T->steps, "    if (!run(L, V, source_%lu)) return;\n", (unsigned long) T->nsources++);
+}
+
+/* the forms at the top of the program: the macros are defined as they
+ * are read, a function is made of each definition of one that can be,
+ * which is also defined for the macros to use, the rest is kept */
+static void translate(struct lithc *T, char *src)
+{
+    lith_st *L;
+    lith_value *x, *f, **p;
+    char *start, *end, *pending, *s;
+    L = T->L;
+    T->macros = LITH_NIL;
+    for (end = src; (x = lith_read_expr(L, end, &end)); ) {
+        if ((length(x) > 2) && (LITH_CAR(x) == L->forms[LITH_FORM_MACRO])
+        && LITH_IS(CADR(x), LITH_TYPE_PAIR))
+            T->macros = LITH_CONS(L, LITH_CAR(CADR(x)), T->macros);
+    }
+    lith_clear_error_state(L);
+    pending = end = src;
+    for (;;) {
+        start = end;
+        if (!(x = lith_read_expr(L, end, &end))) break;
+        if (LITH_IS(x, LITH_TYPE_PAIR) && (LITH_CAR(x) == L->forms[LITH_FORM_MACRO])) {
+            lith_eval_expr(L, T->V, x);
+            lith_clear_error_state(L);
+            continue;
+        }
+        while (x && LITH_IS(x, LITH_TYPE_PAIR) && LITH_IS(LITH_CAR(x), LITH_TYPE_SYMBOL)
+        && (p = lith_env_find(T->V, LITH_CAR(x))) && LITH_IS(*p, LITH_TYPE_MACRO))
+            x = lith_apply(L, *p, LITH_CDR(x));
+        if (!x || !is_function(T, x)) {
+            lith_clear_error_state(L);
+            continue;
+        }
+        f = CADDR(x);
+        if (compile(T, CADR(x), CADR(f), CDDR(f))) {
+            keep_source(T, pending, start);
+            pending = end;
+            s = printed(T, x);
+            fprintf(T->steps, "    if (!define(L, %lu, K[%ld], fn_%lu, %ld, ",
+                (unsigned long) T->fn, constant(T, CADR(x)),
+                (unsigned long) T->fn, length(CADR(f)));
+            put_string(T->steps, s, strlen(s));
+            fputs(")) return;\n", T->steps);
+            free(s);
+        }
+        lith_eval_expr(L, T->V, x);
+        lith_clear_error_state(L);
+    }
+    lith_clear_error_state(L);
+    keep_source(T, pending, pending + strlen(pending));
+}
+
+static void copy(FILE *from, FILE *to)
+{
+    char *s;
+    rewind(from);
+    s = slurp(from);
+    fputs(s, to);
+    free(s);
+}
+
+#define MAX1(n) ((unsigned long) ((n) ? (n) : 1))
+
+static void write_program(struct lithc *T, FILE *f, char *filename, char *prelude)
+{
+    size_t i;
+    fputs("/* made by lithc from ", f);
+    put_string(f, filename, strlen(filename));
+    fputs(" */\n\n#include \"lith.h\"\n\n#include <stdio.h>\n#include <string.h>\n\n", f);
+    fputs("/* the slots of the running function on the eval stack */\n"
+        "#define R(i) (L->gc.stack[sp + (i)])\n"
+        "#define IS_FN(f, fn) ((LITH_TAG(f) == LITH_TAG_HEAP) && ((f)->type == LITH_TYPE_BUILTIN) \\\n"
+        "    && ((f)->value.callable->argv_function == (fn)))\n"
+        "#define FIX2(a, b) ((LITH_TAG(a) == LITH_TAG_FIXNUM) && (LITH_TAG(b) == LITH_TAG_FIXNUM))\n"
+        "/* the factors whose product is surely a fixnum */\n"
+        "#define HALF_FIXNUM (1L << (4 * sizeof(long) - 2))\n"
+        "#define SMALL(a) ((LITH_FIXNUM_VALUE(a) < HALF_FIXNUM) && (LITH_FIXNUM_VALUE(a) > -HALF_FIXNUM))\n"
+        "#define CELL(g) ((G[g].cell && (G[g].bindings == L->bindings)) ? G[g].cell : cell(L, g))\n\n", f);
+    fputs("/* the namespace of the program, the constants and the functions made,\n"
+        " * which are kept on the eval stack, the functions from roots on */\n", f);
+    fprintf(f, "static lith_env *V;\nstatic lith_value *K[%lu];\n", MAX1(T->nconsts));
+    if (T->nfns)
+        fprintf(f, "static lith_value *F[%lu];\nstatic size_t roots;\n", (unsigned long) T->nfns);
+    fputc('\n', f);
+    if (T->uses_cells) {
+        fputs("/* the bindings of the globals, by the constant naming them,\n"
+            " * which stay where they are until another binding is made */\n"
+            "static struct global {\n    size_t name;\n    lith_value **cell;\n"
+            "    unsigned long bindings;\n} G[] = {\n", f);
+        for (i = 0; i < T->nglobals; i++)
+            fprintf(f, "    {%ld, NULL, 0}%s\n", constant(T, T->globals[i]),
+                (i + 1 < T->nglobals) ? "," : "");
+        fputs("};\n\n"
+            "static lith_value **cell(lith_st *L, size_t g)\n{\n"
+            "    lith_value **p;\n"
+            "    if (!(p = lith_env_find(V, K[G[g].name]))) {\n"
+            "        L->error = LITH_ERR_UNBOUND;\n"
+            "        L->error_state.sym = K[G[g].name]->value.symbol.name;\n"
+            "        return NULL;\n    }\n"
+            "    G[g].cell = p;\n    G[g].bindings = L->bindings;\n    return p;\n}\n\n", f);
+    }
+    if (T->nbuiltins) {
+        fputs("/* the builtins called without looking them up, found by their names\n"
+            " * when the program starts, with how many arguments they are given */\n"
+            "static struct builtin {\n    char *name;\n    size_t nargs;\n"
+            "    lith_builtin_argv_function fn;\n} B[] = {\n", f);
+        for (i = 0; i < T->nbuiltins; i++) {
+            fputs("    {", f);
+            put_string(f, lith_builtins[T->builtins[i].b].name,
+                strlen(lith_builtins[T->builtins[i].b].name));
+            fprintf(f, ", %lu, NULL}%s\n", (unsigned long) T->builtins[i].nargs,
+                (i + 1 < T->nbuiltins) ? "," : "");
+        }
+        fprintf(f, "};\n\n"
+            "static int find_builtins(void)\n{\n"
+            "    struct lith_lib_fn *b;\n    size_t i;\n"
+            "    for (i = 0; i < %lu; i++) {\n"
+            "        for (b = lith_builtins; b->name && strcmp(b->name, B[i].name); b++)\n"
+            "            ;\n"
+            "        if (!b->name || (b->exact ? (B[i].nargs != b->expect) : (B[i].nargs < b->expect))) {\n"
+            "            fprintf(stderr, \"lith: no builtin '%%s' taking %%lu arguments, \"\n"
+            "                \"as when the program was translated\\n\", B[i].name, (unsigned long) B[i].nargs);\n"
+            "            return 0;\n        }\n"
+            "        B[i].fn = b->fn;\n    }\n"
+            "    return 1;\n}\n\n", (unsigned long) T->nbuiltins);
+    }
+    if (T->uses_calls || T->nfns)
+        fputs("/* the macros were expanded when the program was translated */\n"
+            "static lith_value *call(lith_st *L, lith_value *f, size_t argc, lith_value **argv)\n{\n"
+            "    if (LITH_IS(f, LITH_TYPE_MACRO)) {\n"
+            "        lith_simple_error(L, LITH_ERR_CUSTOM, \"macro not known when translated called\");\n"
+            "        return NULL;\n    }\n"
+            "    return lith_call(L, f, argc, argv);\n}\n\n", f);
+    if (T->nfns)
+        fputs("/* a call in tail position, but of the function itself, is made\n"
+            " * by the entry of the function: the function called, then the\n"
+            " * arguments, are left on the top of the eval stack,\n"
+            " * with the body of the function called when it is a function made */\n"
+            "static size_t tail_argc;\n"
+            "static lith_builtin_argv_function tail_body;\n"
+            "#define TAIL ((lith_value *) &tail_argc)\n\n"
+            "static lith_value *tail(lith_st *, size_t, lith_value *);\n\n", f);
+    if (T->uses_names)
+        fputs("static void name(lith_value *val, lith_value *sym)\n{\n"
+            "    if (LITH_IS_CALLABLE(val) && !val->value.callable->name)\n"
+            "        val->value.callable->name = sym;\n}\n\n", f);
+    copy(T->out, f);
+    if (T->nfns) {
+        fputs("/* the bodies of the functions made, by their number */\n"
+            "static struct made {\n    lith_builtin_argv_function body;\n    size_t nargs;\n"
+            "} made[] = {\n", f);
+        for (i = 0; i < T->nfns; i++)
+            fprintf(f, "    {body_%lu, %lu}%s\n", (unsigned long) i,
+                (unsigned long) T->fns[i].nargs, (i + 1 < T->nfns) ? "," : "");
+        fprintf(f, "};\n\n"
+            "static lith_value *tail(lith_st *L, size_t base, lith_value *val)\n{\n"
+            "    lith_value **stk;\n    lith_builtin_argv_function body;\n    size_t i, n;\n"
+            "    while (val == TAIL) {\n"
+            "        n = tail_argc;\n        stk = L->gc.stack;\n"
+            "        for (i = 0; i <= n; i++)\n"
+            "            stk[base + i] = stk[L->gc.sp - n - 1 + i];\n"
+            "        L->gc.sp = base + n + 1;\n"
+            "        if (!(body = tail_body)) {\n"
+            "            for (i = 0; (i < %lu) && (F[i] != stk[base]); i++)\n"
+            "                ;\n"
+            "            if ((i < %lu) && (made[i].nargs == n)) body = made[i].body;\n"
+            "        }\n"
+            "        val = body ? (*body)(L, n, stk + base + 1)\n"
+            "            : call(L, stk[base], n, stk + base + 1);\n    }\n"
+            "    L->gc.sp = base;\n"
+            "    return val;\n}\n\n", (unsigned long) T->nfns, (unsigned long) T->nfns);
+    }
+    fputs("static void make_constants(lith_st *L)\n{\n", f);
+    for (i = 0; i < T->nconsts; i++)
+        make_constant(T, f, i);
+    fputs("}\n\n/* the library, run in the global environment */\nstatic char prelude[] = ", f);
+    put_string(f, prelude, strlen(prelude));
+    fputs(";\n\n", f);
+    copy(T->sources, f);
+    fputs("/* the expressions are evaluated as lith_run_file does */\n"
+        "static int run(lith_st *L, lith_env *env, char *src)\n{\n"
+        "    char *end;\n    lith_value *expr;\n"
+        "    end = src;\n    expr = NULL;\n"
+        "    while (!LITH_IS_ERR(L)) {\n"
+        "        if ((expr = lith_read_expr(L, end, &end)) && !lith_eval_expr(L, env, expr))\n"
+        "            break;\n    }\n"
+        "    if (LITH_AT_END_NO_ERR(L)) {\n"
+        "        lith_clear_error_state(L);\n        return 1;\n    }\n"
+        "    lith_print_error(L, 1);\n"
+        "    if (expr) {\n"
+        "        fprintf(stderr, \"error occurred when evaluating the expression:\\n\\t\");\n"
+        "        lith_print_value(L, expr, stderr);\n"
+        "        fputc('\\n', stderr);\n    }\n"
+        "    return 0;\n}\n\n", f);
+    if (T->nfns)
+        fputs("static int define(lith_st *L, size_t j, lith_value *sym,\n"
+            "                  lith_builtin_argv_function fn, size_t nargs, char *expr)\n{\n"
+            "    lith_value *f;\n"
+            "    if ((f = lith_make_builtin_argv(L, sym, fn, nargs, 1))) {\n"
+            "        L->gc.stack[roots + j] = F[j] = f;\n"
+            "        lith_env_put(L, V, sym, f);\n    }\n"
+            "    if (!LITH_IS_ERR(L)) return 1;\n"
+            "    lith_print_error(L, 1);\n"
+            "    fprintf(stderr, \"error occurred when evaluating the expression:\\n\\t%s\\n\", expr);\n"
+            "    return 0;\n}\n\n", f);
+    fputs("static void steps(lith_st *L)\n{\n", f);
+    copy(T->steps, f);
+    fputs("}\n\n", f);
+    fputs("int main(int argc, char **argv)\n{\n"
+        "    lith_st T, *L;\n    lith_value *arguments, *str, **tail;\n    size_t i;\n    int j;\n"
+        "    L = &T;\n", f);
+    if (T->nbuiltins)
+        fputs("    if (!find_builtins())\n        return 6;\n", f);
+    fputs("    lith_init(L);\n"
+        "    L->filename = \"lib.lith\";\n"
+        "    if (!run(L, L->global, prelude))\n        return 6;\n"
+        "    V = lith_new_env(L, L->global);\n"
+        "    make_constants(L);\n", f);
+    fprintf(f, "    if (!V || LITH_IS_ERR(L) || !lith_reserve_stack(L, %lu)) {\n"
+        "        lith_print_error(L, 1);\n        return 6;\n    }\n",
+        (unsigned long) (T->nconsts + 1 + T->nfns));
+    fprintf(f, "    for (i = 0; i < %lu; i++)\n        L->gc.stack[L->gc.sp++] = K[i];\n",
+        (unsigned long) T->nconsts);
+    fputs("    L->gc.stack[L->gc.sp++] = V;\n", f);
+    if (T->nfns)
+        fprintf(f, "    roots = L->gc.sp;\n"
+            "    for (i = 0; i < %lu; i++)\n        L->gc.stack[L->gc.sp++] = NULL;\n",
+            (unsigned long) T->nfns);
+    fputs("    arguments = LITH_NIL;\n    tail = &arguments;\n"
+        "    for (j = 1; j < argc; j++) {\n"
+        "        str = lith_make_string(L, argv[j], strlen(argv[j]));\n"
+        "        if (!str || !(*tail = LITH_CONS(L, str, LITH_NIL)))\n            return 16;\n"
+        "        tail = &LITH_CDR(*tail);\n    }\n"
+        "    lith_env_put(L, V, lith_get_symbol(L, \"arguments\"), arguments);\n"
+        "    L->filename = ", f);
+    put_string(f, filename, strlen(filename));
+    fputs(";\n    steps(L);\n    lith_free(L);\n    return 0;\n}\n", f);
+}
+
+int main(int argc, char **argv)
+{
+    struct lithc C, *T;
+    lith_st S, *L;
+    FILE *out;
+    char *prelude, *src;
+    if ((argc < 2) || (argc > 3)) {
+        fprintf(stderr, "usage: %s FILE [OUT.c]\n"
+            "    translates the lith program in FILE to C, written to OUT.c\n"
+            "    or to the standard output, to be built with lith.c:\n"
+            "        cc -o prog OUT.c lith.c\n", argv[0]);
+        return 2;
+    }
+    L = &S;
+    lith_init(L);
+    /* the values made are kept in the C data of lithc only */
+    L->gc.threshold = (size_t) -1;
+    prelude = slurp_file("lib.lith");
+    src = slurp_file(argv[1]);
+    lith_run_file(L, L->global, "lib.lith");
+    if (LITH_IS_ERR(L))
+        return 6;
+    memset(&C, 0, sizeof(C));
+    T = &C;
+    T->L = L;
+    T->V = lith_new_env(L, L->global);
+    T->out = temporary();
+    T->sources = temporary();
+    T->steps = temporary();
+    translate(T, src);
+    out = (argc == 3) ? fopen(argv[2], "w") : stdout;
+    if (!out) {
+        fprintf(stderr, "lithc: can not open '%s'\n", argv[2]);
+        return 1;
+    }
+    write_program(T, out, argv[1], prelude);
+    if ((out != stdout) && fclose(out)) fatal("can not write the output");
+    lith_free(L);
+    return 0;
+}
@@ -18,10 +18,11 @@ static void show_help(char *progname)
     show_version();
     fprintf(stderr,
         "usage: \n"
-        "    %s [-h | --help] [-v | --version] [-i | --interactive]\n"
-        "    %s [(-e | --evaluate) expr ...]\n"
-        "    %s [--] FILE [ARGS] ...\n\n",
-        progname, progname, progname);
+        "    %s [-h | --help] [-v | --version]\n"
+        "    %s [FLAGS] [-i | --interactive]\n"
+        "    %s [FLAGS] [(-e | --evaluate) expr ...]\n"
+        "    %s [FLAGS] [--] FILE [ARGS] ...\n\n",
+        progname, progname, progname, progname);
     fprintf(stderr,
         "Available options: \n\n"
         "    -e expr ...\n"
@@ -33,6 +34,14 @@ static void show_help(char *progname)
         "            run an interactive session (REPL)\n\n"
         "    -v, --version\n"
         "            show version\n\n"
+        "Available flags: \n\n"
+        "    -d, --disasm\n"
+        "            show the bytecode of the closures as they are compiled\n\n"
+        "    -O0, -O1\n"
+        "            compile without or with (the default) folding constants\n"
+        "            and inlining small closures\n\n"
+        "    -w, --walk\n"
+        "            run closures by walking their bodies, without compiling\n\n"
         "");
 }
 
@@ -44,10 +53,8 @@ static lith_value *get_list_of_arguments(lith_st *L, char **arg)
         return NULL;
     for (; *arg; arg++) {
         str = lith_make_string(L, *arg, strlen(*arg));
-        if (!str || LITH_IS_ERR(L)) {
-            lith_free_value(arguments);
+        if (!str || LITH_IS_ERR(L))
             return NULL;
-        }
         if (LITH_IS_NIL(cur)) {
             arguments = LITH_CONS(L, str, L->nil);
             cur = arguments;
@@ -84,8 +91,7 @@ static char *read_line(int *line_empty)
 
 int main(int argc, char **argv)
 {
-    int ret, empty_line;
-    size_t len;
+    int ret, empty_line, i, walk, disasm, optimize;
     lith_st T, *L;
     lith_env *V;
     lith_value *arguments;
@@ -93,15 +99,27 @@ int main(int argc, char **argv)
     
     enum { LITH__REPL, LITH__EXPR, LITH__RUN_FILE } state;
     
-    if (argc < 2) {
+    ret = walk = disasm = 0;
+    optimize = 1;
+    #define OPT(short_form, long_form) \
+       ((strcmp(opt, short_form) == 0) \
+       || (strcmp(opt, long_form) == 0))
+    for (i = 1; (opt = argv[i]); i++) {
+        if (OPT("-d", "--disasm"))
+            disasm = 1;
+        else if (OPT("-w", "--walk"))
+            walk = 1;
+        else if (!strcmp(opt, "-O0") || !strcmp(opt, "-O1"))
+            optimize = opt[2] - '0';
+        else
+            break;
+    }
+    
+    if (!opt) {
         show_help(argv[0]);
         return 2;
     }
 
-    opt = argv[1];
-    #define OPT(short_form, long_form) \
-       ((strcmp(opt, short_form) == 0) \
-       || (strcmp(opt, long_form) == 0))
     if (opt[0] == '-') {
         if (OPT("-v", "--version")) {
             show_version();
@@ -113,40 +131,47 @@ int main(int argc, char **argv)
             state = LITH__REPL;
         } else if (OPT("-e", "--evaluate")) {
             state = LITH__EXPR;
-            if (!argv[2]) {
+            if (!argv[i+1]) {
                 fprintf(stderr,
-                    "lith: expecting at least one argument for '%s'\n", argv[1]);
+                    "lith: expecting at least one argument for '%s'\n", opt);
                 return 3;
             }
-            expr = argv+2;
+            expr = argv+i+1;
         } else if (!strcmp(opt, "--")) {
-            if (!argv[2]) {
+            if (!argv[i+1]) {
                 fprintf(stderr, "lith: expecting filename after '--'\n");
                 return 4;
             }
             state = LITH__RUN_FILE;
-            filename = argv[2];
-            args = argv+3;
+            filename = argv[i+1];
+            args = argv+i+2;
         } else {
             fprintf(stderr,
                 "lith: invalid option '%s': "
                 "try '%s --help' for available options\n",
-                argv[1], argv[0]);
+                opt, argv[0]);
             return 5;
         }
     } else {
         state = LITH__RUN_FILE;
-        filename = argv[1];
-        args = argv+2;
+        filename = opt;
+        args = argv+i+1;
     }
     #undef OPT
     
     L = &T;
     lith_init(L);
-    V = lith_new_env(L, L->global);
+    L->walk = walk;
+    L->optimize = optimize;
     lith_run_file(L, L->global, "lib.lith");
     if (LITH_IS_ERR(L))
         return 6;
+    if (disasm)
+        L->disasm = stderr;
+    /* not reachable from the global environment: made a root */
+    V = lith_new_env(L, L->global);
+    if (!V || !lith_push_root(L, V))
+        return 7;
     
     switch (state) {
     case LITH__EXPR:
@@ -185,7 +210,6 @@ int main(int argc, char **argv)
         break;
     }
         
-    lith_free_env(V);
     lith_free(L);
     
     return ret;